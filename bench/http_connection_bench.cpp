@@ -0,0 +1,186 @@
+#include <benchmark/benchmark.h>
+
+#include <spdlog/spdlog.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+#include "aifs/event_loop.h"
+#include "aifs/http/express_router.h"
+#include "aifs/http/http_connection.h"
+#include "aifs/task.h"
+#include "aifs/tcp_acceptor.h"
+#include "aifs/unix_socket.h"
+
+using namespace aifs;
+using namespace aifs::http;
+
+namespace {
+constexpr std::string_view request = "GET /users/42 HTTP/1.1\r\n"
+                                     "Host: www.example.com\r\n"
+                                     "Accept: application/json\r\n"
+                                     "\r\n";
+constexpr std::string_view body = R"({"id":42,"name":"user"})";
+
+void addRoutes(ExpressRouter& router)
+{
+    router.get("/users/:id", [](const Request&, Response& resp) -> Task<HandlerStatus> {
+        resp.setHeader("Content-Type", "application/json");
+        co_await resp.send(std::string { body });
+        co_return HandlerStatus::Accepted;
+    });
+}
+
+// Sends one request at a time over the connection, once per iteration.
+Task<> keepAliveClient(benchmark::State& state, UnixSocket& socket)
+{
+    char buf[1024];
+    for (auto _ : state) {
+        co_await socket.send(request);
+        std::size_t received = 0;
+        while (received < body.size() || std::string_view(buf + received - body.size(), body.size()) != body) {
+            received += static_cast<std::size_t>(co_await socket.receive({ buf + received, sizeof buf - received }));
+        }
+    }
+    socket.close();
+}
+
+// Requests per second through HTTPConnection and ExpressRouter, with every
+// thread running a loop and a connection of its own. Build with
+// -DAIFS_FRAME_POOL=OFF to compare against frames from the global
+// operator new.
+void BM_Requests(benchmark::State& state)
+{
+    spdlog::set_level(spdlog::level::warn);
+#ifdef AIFS_NO_FRAME_POOL
+    state.SetLabel("operator new");
+#else
+    state.SetLabel("frame pool");
+#endif
+
+    EventLoop ev;
+    ExpressRouter router;
+    addRoutes(router);
+    auto [server, client] = UnixSocket::pair(ev);
+    HTTPConnection<> conn { ev, router, std::move(server), { .maxRequests = std::numeric_limits<std::size_t>::max() } };
+    ev.spawn(conn.handle());
+    ev.spawn(keepAliveClient(state, *client));
+    ev.run();
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+
+int freePort()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ::bind(fd, reinterpret_cast<sockaddr*>(&addr), len);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    ::close(fd);
+    return ntohs(addr.sin_port);
+}
+
+int connectTo(int port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<unsigned short>(port));
+    ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    return fd;
+}
+
+// Reads one response, and with untilClose everything up to the end of the
+// stream. Returns false if the stream ended first.
+bool readResponse(int fd, bool untilClose)
+{
+    char buf[1024];
+    std::size_t received = 0;
+    for (;;) {
+        auto n = ::read(fd, buf + received, sizeof buf - received);
+        if (n <= 0) {
+            return untilClose && n == 0 && std::string_view(buf, received).ends_with(body);
+        }
+        received += static_cast<std::size_t>(n);
+        if (!untilClose && std::string_view(buf, received).ends_with(body)) {
+            return true;
+        }
+    }
+}
+
+Task<> serve(EventLoop& ev, Router& router, std::unique_ptr<TCPSocket> socket, ConnectionOptions options)
+{
+    HTTPConnection<> conn { ev, router, std::move(socket), options };
+    co_await conn.handle();
+}
+
+Task<> acceptConnections(EventLoop& ev, TCPAcceptor& acceptor, Router& router, ConnectionOptions options)
+{
+    try {
+        for (;;) {
+            ev.spawn(serve(ev, router, co_await acceptor.accept(), options));
+        }
+    } catch (const std::system_error&) {
+        // Canceled at the end of the run.
+    }
+}
+
+// A client in the style of wrk making one request at a time over TCP,
+// either on one keep-alive connection or, as before keep-alive support,
+// on a new connection for every request that the server closes after
+// answering.
+void BM_Connections(benchmark::State& state)
+{
+    spdlog::set_level(spdlog::level::warn);
+    bool keepAlive = state.range(0) != 0;
+    ConnectionOptions options;
+    options.maxRequests = keepAlive ? std::numeric_limits<std::size_t>::max() : 1;
+
+    int port = freePort();
+    EventLoop ev;
+    ExpressRouter router;
+    addRoutes(router);
+    TCPAcceptor acceptor { ev, port, { .address = "127.0.0.1" } };
+    ev.spawn(acceptConnections(ev, acceptor, router, options));
+    std::thread server([&] { ev.run(); });
+
+    int fd = keepAlive ? connectTo(port) : -1;
+    for (auto _ : state) {
+        if (!keepAlive) {
+            fd = connectTo(port);
+        }
+        bool answered = ::write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size())
+            && readResponse(fd, !keepAlive);
+        if (!keepAlive) {
+            ::close(fd);
+        }
+        if (!answered) {
+            state.SkipWithError("No response");
+            break;
+        }
+    }
+    if (keepAlive) {
+        ::close(fd);
+    }
+
+    ev.post([&] { acceptor.cancel(); });
+    server.join();
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+} // namespace
+
+BENCHMARK(BM_Requests)->Threads(1)->Threads(4)->UseRealTime();
+BENCHMARK(BM_Connections)->ArgName("keep_alive")->Arg(0)->Arg(1)->UseRealTime();
@@ -0,0 +1,76 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "aifs/http/fast_request_parser.h"
+#include "aifs/http/http_connection.h"
+
+using namespace aifs::http;
+
+namespace {
+// What a browser sends for a page.
+constexpr std::string_view browser_request = "GET /docs/index.html?lang=en HTTP/1.1\r\n"
+                                             "Host: www.example.com\r\n"
+                                             "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:120.0) Gecko/20100101 Firefox/120.0\r\n"
+                                             "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+                                             "Accept-Language: en-US,en;q=0.5\r\n"
+                                             "Accept-Encoding: gzip, deflate, br\r\n"
+                                             "Referer: https://www.example.com/\r\n"
+                                             "Connection: keep-alive\r\n"
+                                             "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark\r\n"
+                                             "Upgrade-Insecure-Requests: 1\r\n"
+                                             "Sec-Fetch-Dest: document\r\n"
+                                             "Sec-Fetch-Mode: navigate\r\n"
+                                             "Sec-Fetch-Site: same-origin\r\n"
+                                             "\r\n";
+
+// Parse copies requests of input, which arrive in reads of chunk bytes.
+template <typename Parser>
+void parseRequests(benchmark::State& state, std::string_view request, std::size_t copies)
+{
+    std::string input;
+    for (std::size_t i = 0; i < copies; ++i) {
+        input += request;
+    }
+    auto chunk = static_cast<std::size_t>(state.range(0));
+
+    Parser parser;
+    for (auto _ : state) {
+        for (std::size_t begin = 0; begin < input.size(); begin += chunk) {
+            std::span<const char> data { input.data() + begin, std::min(chunk, input.size() - begin) };
+            while (!data.empty()) {
+                data = data.subspan(parser.consume(data));
+                if (!parser.m_complete) {
+                    break;
+                }
+                benchmark::DoNotOptimize(parser.m_headers.data());
+                parser.next();
+            }
+        }
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * input.size()));
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * copies));
+}
+
+template <typename Parser>
+void BM_Single(benchmark::State& state)
+{
+    parseRequests<Parser>(state, browser_request, 1);
+}
+
+template <typename Parser>
+void BM_Pipelined(benchmark::State& state)
+{
+    parseRequests<Parser>(state, browser_request, 16);
+}
+} // namespace
+
+// One read holding everything, and reads of a typical TCP segment size.
+BENCHMARK(BM_Single<RequestParser>)->Arg(1 << 20)->Arg(1460);
+BENCHMARK(BM_Single<FastRequestParser>)->Arg(1 << 20)->Arg(1460);
+BENCHMARK(BM_Pipelined<RequestParser>)->Arg(1 << 20)->Arg(1460);
+BENCHMARK(BM_Pipelined<FastRequestParser>)->Arg(1 << 20)->Arg(1460);
@@ -0,0 +1,99 @@
+#include <benchmark/benchmark.h>
+
+#include <spdlog/spdlog.h>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#include "aifs/awaitable.h"
+#include "aifs/event_loop.h"
+#include "aifs/http/response.h"
+#include "aifs/output_queue.h"
+#include "aifs/task.h"
+#include "aifs/tcp_socket.h"
+
+using namespace aifs;
+using namespace aifs::http;
+
+namespace {
+// Header fields an API response typically carries besides the ones the
+// Response adds itself.
+constexpr std::array<std::pair<std::string_view, std::string_view>, 8> fields { {
+    { "Content-Type", "application/json; charset=utf-8" },
+    { "Cache-Control", "private, max-age=0, no-cache" },
+    { "X-Request-Id", "4bf92f3577b34da6a3ce929d0e0e4736" },
+    { "Vary", "Accept-Encoding" },
+    { "Server", "aifs" },
+    { "Access-Control-Allow-Origin", "*" },
+    { "Strict-Transport-Security", "max-age=31536000; includeSubDomains" },
+    { "X-Content-Type-Options", "nosniff" },
+} };
+
+// Takes everything sent at once and throws it away, so that only the
+// serialization is measured.
+class DiscardSocket : public StreamSocket {
+public:
+    unsigned short remote_port() const override { return 0; }
+    void cancel() override { }
+    void close() override { }
+
+protected:
+    struct Ready {
+        ssize_t n;
+
+        [[nodiscard]] bool await_ready() const noexcept { return true; }
+        void await_suspend(std::coroutine_handle<>) const noexcept { }
+        ssize_t await_resume() const noexcept { return n; }
+    };
+
+    Awaitable<ssize_t> doReceive(std::span<char>) override { return Ready { 0 }; }
+    Awaitable<ssize_t> doSend(std::span<const char> buffer) override { return Ready { static_cast<ssize_t>(buffer.size()) }; }
+
+    Awaitable<ssize_t> doSendv(std::span<const iovec> buffers) override
+    {
+        std::size_t n = 0;
+        for (const auto& buffer : buffers) {
+            n += buffer.iov_len;
+        }
+        return Ready { static_cast<ssize_t>(n) };
+    }
+};
+
+// Bytes per second of header blocks with range(0) fields set by the
+// handler, besides the status line, Date and Content-Length. The responses
+// answer HEAD requests, so that no body is queued behind the header.
+void BM_Header(benchmark::State& state)
+{
+    spdlog::set_level(spdlog::level::warn);
+    EventLoop ev;
+    DiscardSocket socket;
+    OutputQueue output { ev, socket };
+    ev.spawn([](benchmark::State& state, OutputQueue& output) -> Task<> {
+        auto count = static_cast<std::size_t>(state.range(0));
+        std::size_t bytes = 0;
+        for (auto _ : state) {
+            Response resp { output };
+            resp.setHeadRequest(true);
+            for (std::size_t i = 0; i < count; ++i) {
+                resp.setHeader(fields[i].first, fields[i].second);
+            }
+            co_await resp.send(R"({"id":42})");
+            bytes += output.queued();
+            co_await output.flush();
+        }
+        state.SetBytesProcessed(static_cast<std::int64_t>(bytes));
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+    }(state, output));
+    ev.run();
+}
+} // namespace
+
+BENCHMARK(BM_Header)->ArgName("fields")->Arg(0)->Arg(2)->Arg(8);
@@ -0,0 +1,114 @@
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "aifs/http/route_tree.h"
+
+using namespace aifs;
+using namespace aifs::http;
+
+namespace {
+// The routes of a REST API, four for every resource.
+std::vector<std::string> patterns(std::size_t routes)
+{
+    std::vector<std::string> result;
+    for (std::size_t i = 0; i < routes / 4; ++i) {
+        auto base = "/api/v1/resource" + std::to_string(i);
+        result.push_back(base);
+        result.push_back(base + "/search");
+        result.push_back(base + "/:id");
+        result.push_back(base + "/:id/items");
+    }
+    return result;
+}
+
+// Paths that name a route literally, the only ones the linear scan can
+// match, or with parameters, paths that match the others.
+std::vector<std::string> paths(std::size_t routes, bool params)
+{
+    std::vector<std::string> result;
+    for (std::size_t i = 0; i < routes / 4; ++i) {
+        auto base = "/api/v1/resource" + std::to_string(i);
+        result.push_back(params ? base + "/42" : base);
+        result.push_back(params ? base + "/42/items" : base + "/search");
+    }
+    return result;
+}
+
+HandlerFn handler()
+{
+    return [](const Request&, Response&) -> Task<HandlerStatus> { co_return HandlerStatus::Accepted; };
+}
+
+// ExpressRouter as it was before the route tree: every route in a list,
+// its path compared in full with the URL.
+class LinearRoutes {
+public:
+    void insert(std::string path, HandlerFn fn) { m_routes.push_back({ std::move(path), std::move(fn) }); }
+
+    [[nodiscard]] const HandlerFn* find(std::string_view path) const
+    {
+        for (const auto& route : m_routes) {
+            if (route.path == path) {
+                return &route.fn;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    struct Route {
+        std::string path;
+        HandlerFn fn;
+    };
+
+    std::vector<Route> m_routes;
+};
+
+// Looks up every path in turn, so that the routes are hit evenly.
+template <typename Find>
+void lookUp(benchmark::State& state, const std::vector<std::string>& paths, Find find)
+{
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(find(paths[i]));
+        if (++i == paths.size()) {
+            i = 0;
+        }
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+
+void BM_LinearScan(benchmark::State& state)
+{
+    auto routes = static_cast<std::size_t>(state.range(0));
+    LinearRoutes table;
+    for (auto& pattern : patterns(routes)) {
+        table.insert(std::move(pattern), handler());
+    }
+    lookUp(state, paths(routes, false), [&](std::string_view path) { return table.find(path); });
+}
+
+template <bool Params>
+void BM_RouteTree(benchmark::State& state)
+{
+    auto routes = static_cast<std::size_t>(state.range(0));
+    RouteTree tree;
+    for (const auto& pattern : patterns(routes)) {
+        tree.insert(pattern, handler());
+    }
+    lookUp(state, paths(routes, Params), [&](std::string_view path) {
+        RouteParams params;
+        return tree.find(path, params);
+    });
+}
+} // namespace
+
+BENCHMARK(BM_LinearScan)->ArgName("routes")->Arg(40)->Arg(400);
+BENCHMARK(BM_RouteTree<false>)->ArgName("routes")->Arg(40)->Arg(400);
+BENCHMARK(BM_RouteTree<true>)->ArgName("routes")->Arg(40)->Arg(400);
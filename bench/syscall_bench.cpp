@@ -0,0 +1,248 @@
+#include <benchmark/benchmark.h>
+
+#include <spdlog/spdlog.h>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "aifs/event_loop.h"
+#include "aifs/http/express_router.h"
+#include "aifs/http/http_connection.h"
+#include "aifs/io_uring_reactor.h"
+#include "aifs/task.h"
+#include "aifs/unix_socket.h"
+
+// The wrappers the library calls into libc for are replaced, so that they
+// count the syscalls they make on threads that ask for it, which is why
+// this benchmark is built on its own.
+namespace {
+thread_local bool counting = false;
+thread_local std::size_t syscalls = 0;
+
+// The libc function name, to forward to.
+template <typename Fn>
+Fn* next(const char* name)
+{
+    return reinterpret_cast<Fn*>(::dlsym(RTLD_NEXT, name));
+}
+} // namespace
+
+extern "C" {
+ssize_t recv(int fd, void* buf, size_t n, int flags)
+{
+    static auto* fn = next<decltype(recv)>("recv");
+    if (counting) {
+        ++syscalls;
+    }
+    return fn(fd, buf, n, flags);
+}
+
+ssize_t send(int fd, const void* buf, size_t n, int flags)
+{
+    static auto* fn = next<decltype(send)>("send");
+    if (counting) {
+        ++syscalls;
+    }
+    return fn(fd, buf, n, flags);
+}
+
+ssize_t recvmsg(int fd, msghdr* msg, int flags)
+{
+    static auto* fn = next<decltype(recvmsg)>("recvmsg");
+    if (counting) {
+        ++syscalls;
+    }
+    return fn(fd, msg, flags);
+}
+
+ssize_t sendmsg(int fd, const msghdr* msg, int flags)
+{
+    static auto* fn = next<decltype(sendmsg)>("sendmsg");
+    if (counting) {
+        ++syscalls;
+    }
+    return fn(fd, msg, flags);
+}
+
+ssize_t read(int fd, void* buf, size_t n)
+{
+    static auto* fn = next<decltype(read)>("read");
+    if (counting) {
+        ++syscalls;
+    }
+    return fn(fd, buf, n);
+}
+
+ssize_t write(int fd, const void* buf, size_t n)
+{
+    static auto* fn = next<decltype(write)>("write");
+    if (counting) {
+        ++syscalls;
+    }
+    return fn(fd, buf, n);
+}
+
+int select(int n, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, timeval* timeout)
+{
+    static auto* fn = next<decltype(select)>("select");
+    if (counting) {
+        ++syscalls;
+    }
+    return fn(n, readfds, writefds, exceptfds, timeout);
+}
+
+int epoll_wait(int epfd, epoll_event* events, int max, int timeout)
+{
+    static auto* fn = next<decltype(epoll_wait)>("epoll_wait");
+    if (counting) {
+        ++syscalls;
+    }
+    return fn(epfd, events, max, timeout);
+}
+
+int epoll_ctl(int epfd, int op, int fd, epoll_event* event) noexcept
+{
+    static auto* fn = next<decltype(epoll_ctl)>("epoll_ctl");
+    if (counting) {
+        ++syscalls;
+    }
+    return fn(epfd, op, fd, event);
+}
+
+// For epoll_pwait2 and io_uring_enter, which have no libc wrappers.
+long syscall(long number, ...) noexcept
+{
+    static auto* fn = next<long(long, ...) noexcept>("syscall");
+    if (counting) {
+        ++syscalls;
+    }
+    va_list args;
+    va_start(args, number);
+    long a[6];
+    for (auto& arg : a) {
+        arg = va_arg(args, long);
+    }
+    va_end(args);
+    return fn(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+}
+
+using namespace aifs;
+using namespace aifs::http;
+
+namespace {
+constexpr std::string_view request = "GET /users/42 HTTP/1.1\r\n"
+                                     "Host: www.example.com\r\n"
+                                     "Accept: application/json\r\n"
+                                     "\r\n";
+constexpr std::string_view body = R"({"id":42,"name":"user"})";
+
+void writeAll(int fd, std::string_view data)
+{
+    while (!data.empty()) {
+        auto n = ::write(fd, data.data(), data.size());
+        if (n <= 0) {
+            return;
+        }
+        data.remove_prefix(static_cast<std::size_t>(n));
+    }
+}
+
+// Reads until the end of the stream or until size bytes have arrived,
+// or, if size is 0, until the end of the first response. Returns how many
+// bytes were read.
+std::size_t readResponses(int fd, std::size_t size)
+{
+    char buf[16384];
+    std::size_t received = 0;
+    std::size_t kept = 0;
+    for (;;) {
+        auto n = ::read(fd, buf + kept, sizeof buf - kept);
+        if (n <= 0) {
+            return received;
+        }
+        received += static_cast<std::size_t>(n);
+        kept = size ? 0 : kept + static_cast<std::size_t>(n);
+        if (size ? received >= size : std::string_view(buf, kept).ends_with(body)) {
+            return received;
+        }
+    }
+}
+
+// Syscalls the server makes per request, with range(1) requests
+// pipelined at a time from a blocking client on another thread. Every
+// receive and send is tried before waiting for readiness, so on a busy
+// connection most requests cost a receive and a send.
+void BM_SyscallsPerRequest(benchmark::State& state)
+{
+    spdlog::set_level(spdlog::level::warn);
+    auto backend = static_cast<Backend>(state.range(0));
+    if (backend == Backend::io_uring && !IoUringReactor::supported()) {
+        state.SkipWithError("io_uring is not supported");
+        return;
+    }
+    auto pipelined = static_cast<std::size_t>(state.range(1));
+
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        state.SkipWithError("socketpair failed");
+        return;
+    }
+    ::fcntl(fds[0], F_SETFL, ::fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    std::size_t served = 0;
+    std::thread server([&] {
+        EventLoop ev { backend };
+        ExpressRouter router;
+        router.get("/users/:id", [](const Request&, Response& resp) -> Task<HandlerStatus> {
+            resp.setHeader("Content-Type", "application/json");
+            co_await resp.send(std::string { body });
+            co_return HandlerStatus::Accepted;
+        });
+        HTTPConnection<> conn { ev, router, std::make_unique<UnixSocket>(ev, fds[0]),
+            { .maxRequests = std::numeric_limits<std::size_t>::max() } };
+        counting = true;
+        ev.spawn(conn.handle());
+        ev.run();
+        counting = false;
+        served = syscalls;
+    });
+
+    // Every response has the same size.
+    writeAll(fds[1], request);
+    auto size = readResponses(fds[1], 0);
+
+    std::string requests;
+    for (std::size_t i = 0; i < pipelined; ++i) {
+        requests += request;
+    }
+    for (auto _ : state) {
+        writeAll(fds[1], requests);
+        readResponses(fds[1], size * pipelined);
+    }
+    ::close(fds[1]);
+    server.join();
+
+    auto handled = static_cast<double>((state.iterations() * pipelined) + 1);
+    state.counters["syscalls_per_request"] = static_cast<double>(served) / handled;
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * pipelined));
+}
+} // namespace
+
+BENCHMARK(BM_SyscallsPerRequest)
+    ->ArgNames({ "backend", "pipelined" })
+    ->ArgsProduct({ { static_cast<int>(Backend::select), static_cast<int>(Backend::epoll), static_cast<int>(Backend::io_uring) }, { 1, 16 } })
+    ->UseRealTime();
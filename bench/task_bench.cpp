@@ -0,0 +1,63 @@
+#include <benchmark/benchmark.h>
+
+#include <spdlog/spdlog.h>
+
+#include <cstdint>
+
+#include "aifs/event_loop.h"
+#include "aifs/task.h"
+
+using namespace aifs;
+
+namespace {
+Task<int> value(int v)
+{
+    co_return v;
+}
+
+// Recurses n times, every level completing synchronously.
+Task<int> depth(int n)
+{
+    if (n == 0) {
+        co_return 0;
+    }
+    co_return co_await depth(n - 1) + 1;
+}
+
+// Runs fn, a coroutine taking the state, to completion on a loop.
+template <typename Fn>
+void runOnLoop(benchmark::State& state, Fn fn)
+{
+    spdlog::set_level(spdlog::level::warn);
+    EventLoop ev;
+    ev.spawn(fn(state));
+    ev.run();
+}
+
+// A chain of range(0) nested co_awaits, so the time per item is the cost
+// of one level: creating the frame, transferring to it and back.
+void BM_AwaitDepth(benchmark::State& state)
+{
+    runOnLoop(state, [](benchmark::State& state) -> Task<> {
+        auto n = static_cast<int>(state.range(0));
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(co_await depth(n));
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * state.range(0)));
+    });
+}
+
+// Tasks awaited one after another from the same coroutine.
+void BM_AwaitLoop(benchmark::State& state)
+{
+    runOnLoop(state, [](benchmark::State& state) -> Task<> {
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(co_await value(1));
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+    });
+}
+} // namespace
+
+BENCHMARK(BM_AwaitDepth)->RangeMultiplier(8)->Range(1, 4096);
+BENCHMARK(BM_AwaitLoop);
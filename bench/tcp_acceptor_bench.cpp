@@ -0,0 +1,92 @@
+#include <benchmark/benchmark.h>
+
+#include <spdlog/spdlog.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "aifs/event_loop.h"
+#include "aifs/task.h"
+#include "aifs/tcp_acceptor.h"
+
+using namespace aifs;
+
+namespace {
+// Connections waiting in the backlog at every wakeup of the acceptor.
+constexpr std::size_t storm = 64;
+
+int freePort()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ::bind(fd, reinterpret_cast<sockaddr*>(&addr), len);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    ::close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// Connect count clients, which the kernel completes before anything is
+// accepted. They are reset when closed, so that no port is left in
+// TIME_WAIT.
+std::vector<int> connectClients(int port, std::size_t count)
+{
+    std::vector<int> fds;
+    for (std::size_t i = 0; i < count; ++i) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        linger reset { 1, 0 };
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<unsigned short>(port));
+        ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        fds.push_back(fd);
+    }
+    return fds;
+}
+
+// Connections accepted per second when storm of them are waiting, taking
+// up to range(0) per readiness notification. With 1 every connection
+// costs a wakeup of its own.
+void BM_AcceptRate(benchmark::State& state)
+{
+    spdlog::set_level(spdlog::level::warn);
+    int port = freePort();
+    EventLoop ev;
+    TCPAcceptor acceptor { ev, port, { .address = "127.0.0.1", .acceptBatch = static_cast<std::size_t>(state.range(0)) } };
+    ev.spawn([](benchmark::State& state, TCPAcceptor& acceptor, int port) -> Task<> {
+        for (auto _ : state) {
+            state.PauseTiming();
+            auto clients = connectClients(port, storm);
+            state.ResumeTiming();
+
+            std::vector<TCPAcceptor::SocketPtr> accepted;
+            while (accepted.size() < storm) {
+                for (auto& socket : co_await acceptor.acceptBatch()) {
+                    accepted.push_back(std::move(socket));
+                }
+            }
+
+            state.PauseTiming();
+            for (int fd : clients) {
+                ::close(fd);
+            }
+            accepted.clear();
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * storm));
+    }(state, acceptor, port));
+    ev.run();
+}
+} // namespace
+
+BENCHMARK(BM_AcceptRate)->ArgName("batch")->Arg(1)->Arg(16)->Arg(64);
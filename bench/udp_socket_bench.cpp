@@ -0,0 +1,74 @@
+#include <benchmark/benchmark.h>
+
+#include <spdlog/spdlog.h>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "aifs/event_loop.h"
+#include "aifs/task.h"
+#include "aifs/udp_socket.h"
+
+using namespace aifs;
+
+namespace {
+// Datagrams sent and then received per iteration, each the size of a
+// typical metrics line.
+constexpr std::size_t burst = 32;
+constexpr std::size_t payload_size = 64;
+
+// Packets per second over loopback, with one datagram per syscall or,
+// with range(0) set, all of them with one sendmmsg() and as few recvmmsg()
+// as it takes.
+void BM_Datagrams(benchmark::State& state)
+{
+    spdlog::set_level(spdlog::level::warn);
+    EventLoop ev;
+    UDPSocket receiver { ev, 0, { .address = "127.0.0.1" } };
+    UDPSocket sender { ev, 0, { .address = "127.0.0.1" } };
+    ev.spawn([](benchmark::State& state, UDPSocket& receiver, UDPSocket& sender) -> Task<> {
+        auto to = receiver.local_endpoint();
+        char payload[payload_size] {};
+        std::vector<iovec> iovecs(burst, iovec { payload, sizeof payload });
+        std::vector<mmsghdr> messages(burst);
+        for (std::size_t i = 0; i < burst; ++i) {
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_name = &to;
+            messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+        DatagramBatch batch { burst, payload_size };
+        char buf[payload_size];
+        sockaddr_storage from;
+
+        for (auto _ : state) {
+            if (state.range(0)) {
+                std::size_t sent = 0;
+                while (sent < burst) {
+                    sent += static_cast<std::size_t>(co_await sender.sendBatch(std::span { messages }.subspan(sent)));
+                }
+                std::size_t received = 0;
+                while (received < burst) {
+                    received += static_cast<std::size_t>(co_await receiver.receiveBatch(batch));
+                }
+            } else {
+                for (std::size_t i = 0; i < burst; ++i) {
+                    co_await sender.sendTo({ payload, sizeof payload }, to);
+                }
+                for (std::size_t i = 0; i < burst; ++i) {
+                    co_await receiver.receiveFrom(buf, from);
+                }
+            }
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * burst));
+    }(state, receiver, sender));
+    ev.run();
+}
+} // namespace
+
+BENCHMARK(BM_Datagrams)->ArgName("batched")->Arg(0)->Arg(1);
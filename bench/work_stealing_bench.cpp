@@ -0,0 +1,111 @@
+#include <benchmark/benchmark.h>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#include "aifs/event_loop.h"
+#include "aifs/task.h"
+#include "aifs/unix_socket.h"
+#include "aifs/work_stealing_executor.h"
+
+using namespace aifs;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Connections whose requests only need I/O, and connections whose
+// requests also need CPU work, each making requests round trips.
+constexpr std::size_t io_connections = 8;
+constexpr std::size_t cpu_connections = 8;
+constexpr std::size_t requests = 50;
+
+// Stands in for a handler encoding a large JSON document, a few hundred
+// microseconds of work.
+void burn()
+{
+    std::uint64_t h = 14695981039346656037ull;
+    for (std::uint64_t i = 0; i < 200000; ++i) {
+        h = (h ^ i) * 1099511628211ull;
+        benchmark::DoNotOptimize(h);
+    }
+}
+
+// Answers every request until the client closes, doing the CPU work first
+// if cpu is set, on the executor if there is one.
+Task<> serve(EventLoop& ev, WorkStealingExecutor* executor, UnixSocket& socket, bool cpu)
+{
+    char buf[64];
+    try {
+        for (;;) {
+            auto n = co_await socket.receive(buf);
+            if (cpu && executor) {
+                co_await executor->schedule();
+                burn();
+                co_await ev.schedule();
+            } else if (cpu) {
+                burn();
+            }
+            co_await socket.send({ buf, static_cast<std::size_t>(n) });
+        }
+    } catch (const std::system_error&) {
+        // The end of the stream.
+    }
+}
+
+// Makes the round trips, recording how long each took if latencies is set.
+Task<> ping(UnixSocket& socket, std::vector<double>* latencies)
+{
+    char buf[64] = "ping";
+    for (std::size_t i = 0; i < requests; ++i) {
+        auto start = Clock::now();
+        co_await socket.send({ buf, 4 });
+        co_await socket.receive(buf);
+        if (latencies) {
+            latencies->push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+        }
+    }
+    socket.close();
+}
+
+// Latency of the I/O-only requests while the CPU-bound ones run on the
+// loop itself, or on a WorkStealingExecutor with one worker per core.
+void BM_MixedWorkload(benchmark::State& state)
+{
+    spdlog::set_level(spdlog::level::warn);
+    std::unique_ptr<WorkStealingExecutor> executor;
+    if (state.range(0)) {
+        executor = std::make_unique<WorkStealingExecutor>();
+    }
+
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        EventLoop ev;
+        std::vector<std::unique_ptr<UnixSocket>> sockets;
+        for (std::size_t i = 0; i < io_connections + cpu_connections; ++i) {
+            auto [server, client] = UnixSocket::pair(ev);
+            bool cpu = i >= io_connections;
+            ev.spawn(serve(ev, executor.get(), *server, cpu));
+            ev.spawn(ping(*client, cpu ? nullptr : &latencies));
+            sockets.push_back(std::move(server));
+            sockets.push_back(std::move(client));
+        }
+        ev.run();
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies[static_cast<std::size_t>(p * static_cast<double>(latencies.size() - 1))]; };
+    state.counters["p50_us"] = percentile(0.5);
+    state.counters["p99_us"] = percentile(0.99);
+    state.counters["max_us"] = latencies.back();
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * (io_connections + cpu_connections) * requests));
+}
+} // namespace
+
+BENCHMARK(BM_MixedWorkload)->ArgName("executor")->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -4,6 +4,8 @@
 #include "aifs/http/express_router.h"
 #include <aifs/event_loop.h>
 #include <aifs/http/http_server.h>
+#include <aifs/http/response_cache.h>
+#include <aifs/http/static_files.h>
 #include <aifs/task.h>
 #include <aifs/tcp_acceptor.h>
 
@@ -22,15 +24,18 @@ class FakeTCPSocket : public StreamSocket {
 public:
     FakeTCPSocket() { spdlog::info("Fake TCP socket"); }
     virtual unsigned short remote_port() const { return 0; }
-    virtual Awaitable<ssize_t> receive(std::span<char> buffer)
+    virtual void cancel() { }
+    virtual void close() { }
+
+protected:
+    virtual Awaitable<ssize_t> doReceive(std::span<char> buffer)
     {
         return Awaitable<ssize_t> { ImmediateResult<ssize_t>{0} };
     }
-    virtual Awaitable<ssize_t> send(std::span<const char> buffer)
+    virtual Awaitable<ssize_t> doSend(std::span<const char> buffer)
     {
         return Awaitable<ssize_t> { ImmediateResult<ssize_t>{0} };
     }
-    virtual void close() const { }
 };
 
 int main()
@@ -40,7 +45,7 @@ int main()
         EventLoop ev;
 
         ExpressRouter router {};
-        router.get("/hello", [](auto, auto resp) -> Task<HandlerStatus> {
+        router.get("/hello", [](const Request&, Response& resp) -> Task<HandlerStatus> {
             spdlog::info("'/hello' handler called");
             resp.setStatus(200);
             resp.setHeader("Content-Type", "text/plain");
@@ -48,7 +53,7 @@ int main()
             co_return HandlerStatus::Accepted;
         });
 
-        router.get("/foo", [](auto, auto resp) -> Task<HandlerStatus> {
+        router.get("/foo", [](const Request&, Response& resp) -> Task<HandlerStatus> {
             spdlog::info("'/foo' handler called");
             resp.setStatus(200);
             resp.setHeader("Content-Type", "text/plain");
@@ -56,16 +61,28 @@ int main()
             co_return HandlerStatus::Accepted;
         });
 
+        router.get("/users/:id", [](const Request& req, Response& resp) -> Task<HandlerStatus> {
+            resp.setHeader("Content-Type", "text/plain");
+            co_await resp.send(fmt::format("User {}", *req.param("id")));
+            co_return HandlerStatus::Accepted;
+        });
+
+        StaticFiles assets { "public" };
+        assets.mount(router, "/static");
+
 #if 0
-        ev.spawn([]() -> Task<> {
+        ev.spawn([](EventLoop& ev) -> Task<> {
             FakeTCPSocket s {};
-            Response r { s };
+            OutputQueue out { ev, s };
+            Response r { out };
             r.setStatus(200);
             co_await r.send("Hello, world");
-        }());
+            co_await out.flush();
+        }(ev));
 #endif
         TCPAcceptor acceptor { ev, 8080 };
-        HTTPServer server { ev, acceptor, router };
+        ResponseCache cache { ev, router };
+        HTTPServer server { ev, acceptor, cache };
         ev.spawn(server.start());
 
         ev.run();
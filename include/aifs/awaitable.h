@@ -1,27 +1,49 @@
 #pragma once
 
 #include <coroutine>
-#include <memory>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace aifs {
 /**
  * Type-erased Awaitable type for polymorphic interfaces with
  * Awaitable operations.
+ *
+ * Operations of up to inline_size bytes are stored inside the Awaitable
+ * itself, so awaiting one does not allocate. Code that knows the concrete
+ * type of a socket, acceptor or timer should await its operations directly
+ * instead.
  */
 template <typename T = void>
 class Awaitable {
 private:
+    // Enough for the vectored socket operations, which carry a msghdr.
+    static constexpr std::size_t inline_size = 160;
+
     struct Concept {
         virtual ~Concept() = default;
+        virtual bool await_ready() = 0;
         virtual T await_resume() = 0;
         virtual void await_suspend(std::coroutine_handle<>) noexcept = 0;
     };
 
     template <typename Impl>
     struct Model : Concept {
-        Model(Impl&& i)
-            : impl_ { std::move(i) }
+        template <typename I>
+        explicit Model(I&& i)
+            : impl_ { std::forward<I>(i) }
+        {
+        }
+
+        bool await_ready() override
         {
+            if constexpr (requires { impl_.await_ready(); }) {
+                return impl_.await_ready();
+            } else {
+                return false;
+            }
         }
 
         T await_resume() override { return impl_.await_resume(); }
@@ -34,14 +56,39 @@ private:
         Impl impl_;
     };
 
+    template <typename Impl>
+    static constexpr bool fits_inline = sizeof(Model<Impl>) <= inline_size
+        && alignof(Model<Impl>) <= alignof(std::max_align_t);
+
 public:
     template <typename Impl>
+        requires(!std::is_same_v<std::remove_cvref_t<Impl>, Awaitable>)
     Awaitable(Impl&& impl)
-        : impl_ { std::make_unique<Model<Impl>>(std::forward<Impl>(impl)) }
     {
+        using Type = Model<std::remove_cvref_t<Impl>>;
+        if constexpr (fits_inline<std::remove_cvref_t<Impl>>) {
+            impl_ = ::new (static_cast<void*>(storage_)) Type { std::forward<Impl>(impl) };
+            inline_ = true;
+        } else {
+            impl_ = new Type { std::forward<Impl>(impl) };
+        }
+    }
+
+    // The operation may be registered with an EventLoop by address, so an
+    // Awaitable stays where it was created.
+    Awaitable(const Awaitable&) = delete;
+    Awaitable& operator=(const Awaitable&) = delete;
+
+    ~Awaitable()
+    {
+        if (inline_) {
+            impl_->~Concept();
+        } else {
+            delete impl_;
+        }
     }
 
-    [[nodiscard]] constexpr bool await_ready() const noexcept { return false; }
+    [[nodiscard]] bool await_ready() { return impl_->await_ready(); }
 
     [[nodiscard]] T await_resume() { return impl_->await_resume(); }
 
@@ -51,6 +98,8 @@ public:
     }
 
 private:
-    std::unique_ptr<Concept> impl_;
+    alignas(std::max_align_t) std::byte storage_[inline_size];
+    Concept* impl_;
+    bool inline_ { false };
 };
-} // namespace aifs
\ No newline at end of file
+} // namespace aifs
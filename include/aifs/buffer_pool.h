@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "non_copyable.h"
+
+namespace aifs {
+struct BufferPoolStats {
+    std::uint64_t acquired { 0 }; // Buffers lent out so far
+    std::uint64_t hits { 0 }; // ... of which were reused rather than allocated
+    std::size_t inUse { 0 };
+    std::size_t peakInUse { 0 };
+    std::size_t cached { 0 }; // Free buffers kept for reuse
+
+    [[nodiscard]] double hitRate() const { return acquired ? static_cast<double>(hits) / acquired : 0.0; }
+};
+
+/**
+ * Fixed-size I/O buffers lent out for as long as data is being processed,
+ * so that idle connections do not each hold a buffer of their own. Every
+ * EventLoop has one; it must only be used from that loop's thread, and
+ * buffers must be returned before the pool goes away.
+ */
+class BufferPool : private NonCopyable {
+public:
+    static constexpr std::size_t default_buffer_size = 16 * 1024;
+
+    /**
+     * A buffer borrowed from a BufferPool, returned when destroyed. size()
+     * is the number of bytes in use, at most capacity().
+     */
+    class Buffer {
+    public:
+        Buffer() = default;
+
+        Buffer(Buffer&& other) noexcept
+            : m_pool { std::exchange(other.m_pool, nullptr) }
+            , m_data { std::exchange(other.m_data, nullptr) }
+            , m_size { std::exchange(other.m_size, 0) }
+        {
+        }
+
+        Buffer& operator=(Buffer&& other) noexcept
+        {
+            if (this != &other) {
+                release();
+                m_pool = std::exchange(other.m_pool, nullptr);
+                m_data = std::exchange(other.m_data, nullptr);
+                m_size = std::exchange(other.m_size, 0);
+            }
+            return *this;
+        }
+
+        ~Buffer() { release(); }
+
+        [[nodiscard]] char* data() const { return m_data; }
+        [[nodiscard]] std::size_t size() const { return m_size; }
+        [[nodiscard]] std::size_t capacity() const { return m_pool ? m_pool->m_bufferSize : 0; }
+        void resize(std::size_t size) { m_size = std::min(size, capacity()); }
+
+        // The bytes in use, and the whole buffer.
+        [[nodiscard]] std::span<char> bytes() const { return { m_data, m_size }; }
+        [[nodiscard]] std::span<char> space() const { return { m_data, capacity() }; }
+
+        explicit operator bool() const { return m_data != nullptr; }
+
+        /**
+         * Give the buffer back to its pool now.
+         */
+        void release()
+        {
+            if (m_pool) {
+                m_pool->put(m_data);
+                m_pool = nullptr;
+                m_data = nullptr;
+                m_size = 0;
+            }
+        }
+
+    private:
+        friend class BufferPool;
+
+        Buffer(BufferPool* pool, char* data)
+            : m_pool { pool }
+            , m_data { data }
+        {
+        }
+
+        BufferPool* m_pool { nullptr };
+        char* m_data { nullptr };
+        std::size_t m_size { 0 };
+    };
+
+    explicit BufferPool(std::size_t bufferSize = default_buffer_size, std::size_t maxCached = 1024)
+        : m_bufferSize { bufferSize }
+        , m_maxCached { maxCached }
+    {
+    }
+
+    ~BufferPool()
+    {
+        for (auto* data : m_free) {
+            delete[] data;
+        }
+    }
+
+    [[nodiscard]] std::size_t bufferSize() const { return m_bufferSize; }
+
+    Buffer acquire()
+    {
+        ++m_stats.acquired;
+        m_stats.peakInUse = std::max(m_stats.peakInUse, ++m_stats.inUse);
+        if (m_free.empty()) {
+            return Buffer { this, new char[m_bufferSize] };
+        }
+        ++m_stats.hits;
+        auto* data = m_free.back();
+        m_free.pop_back();
+        return Buffer { this, data };
+    }
+
+    [[nodiscard]] BufferPoolStats stats() const
+    {
+        auto stats = m_stats;
+        stats.cached = m_free.size();
+        return stats;
+    }
+
+private:
+    void put(char* data)
+    {
+        --m_stats.inUse;
+        if (m_free.size() < m_maxCached) {
+            m_free.push_back(data);
+        } else {
+            delete[] data;
+        }
+    }
+
+    std::size_t m_bufferSize;
+    std::size_t m_maxCached;
+    std::vector<char*> m_free;
+    BufferPoolStats m_stats;
+};
+} // namespace aifs
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "non_copyable.h"
+
+namespace aifs {
+/**
+ * Chase-Lev work-stealing deque of T pointers.
+ *
+ * The owning thread push()es and pop()s at the bottom, in LIFO order, while
+ * any other thread may steal() from the top. The buffer grows as needed;
+ * buffers that were replaced are kept until the deque is destroyed, since a
+ * thief may still be reading from them.
+ */
+template <typename T>
+class ChaseLevDeque : private NonCopyable {
+public:
+    explicit ChaseLevDeque(std::size_t capacity = 256)
+    {
+        m_buffers.push_back(std::make_unique<Buffer>(std::bit_ceil(std::max<std::size_t>(capacity, 2))));
+        m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    void push(T* item)
+    {
+        auto bottom = m_bottom.load(std::memory_order_relaxed);
+        auto top = m_top.load(std::memory_order_acquire);
+        auto* buffer = m_buffer.load(std::memory_order_relaxed);
+        if (bottom - top >= static_cast<std::int64_t>(buffer->m_capacity)) {
+            buffer = grow(buffer, top, bottom);
+        }
+        buffer->put(bottom, item);
+        m_bottom.store(bottom + 1, std::memory_order_release);
+    }
+
+    T* pop()
+    {
+        auto bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        auto* buffer = m_buffer.load(std::memory_order_relaxed);
+        // Claim the bottom item before looking at the top, so that a thief
+        // either sees the claim or the owner sees the theft.
+        m_bottom.store(bottom, std::memory_order_seq_cst);
+        auto top = m_top.load(std::memory_order_seq_cst);
+        if (top > bottom) {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        auto* item = buffer->get(bottom);
+        if (top == bottom) {
+            // Last item: race the thieves for it.
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    T* steal()
+    {
+        auto top = m_top.load(std::memory_order_seq_cst);
+        auto bottom = m_bottom.load(std::memory_order_seq_cst);
+        if (top >= bottom) {
+            return nullptr;
+        }
+        auto* item = m_buffer.load(std::memory_order_acquire)->get(top);
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return m_top.load(std::memory_order_acquire) >= m_bottom.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Buffer {
+        explicit Buffer(std::size_t capacity)
+            : m_capacity { capacity }
+            , m_slots { std::make_unique<std::atomic<T*>[]>(capacity) }
+        {
+        }
+
+        T* get(std::int64_t i) const
+        {
+            return m_slots[static_cast<std::size_t>(i) & (m_capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(std::int64_t i, T* item)
+        {
+            m_slots[static_cast<std::size_t>(i) & (m_capacity - 1)].store(item, std::memory_order_relaxed);
+        }
+
+        std::size_t m_capacity; // Always a power of two
+        std::unique_ptr<std::atomic<T*>[]> m_slots;
+    };
+
+    Buffer* grow(Buffer* old, std::int64_t top, std::int64_t bottom)
+    {
+        m_buffers.push_back(std::make_unique<Buffer>(old->m_capacity * 2));
+        auto* buffer = m_buffers.back().get();
+        for (auto i = top; i < bottom; ++i) {
+            buffer->put(i, old->get(i));
+        }
+        m_buffer.store(buffer, std::memory_order_release);
+        return buffer;
+    }
+
+    alignas(64) std::atomic<std::int64_t> m_top { 0 };
+    alignas(64) std::atomic<std::int64_t> m_bottom { 0 };
+    std::atomic<Buffer*> m_buffer;
+    std::vector<std::unique_ptr<Buffer>> m_buffers; // Owned by the pushing thread
+};
+} // namespace aifs
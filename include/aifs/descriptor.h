@@ -1,7 +1,24 @@
 #pragma once
 
 namespace aifs {
+struct Operation;
+
+enum OpType { read_op = 0,
+    write_op = 1,
+    pri_op = 2,
+    max_op = 3 };
+
 struct Descriptor {
     int m_fd;
+
+    // Bookkeeping owned by the EventLoop and its reactor backend: the pending
+    // operation for each OpType, and bitmasks with one bit per OpType.
+    Operation* m_ops[max_op] {};
+    unsigned m_interest { 0 }; // Operation types currently waited for
+    unsigned m_armed { 0 }; // Events registered with the kernel (epoll)
+    bool m_registered { false };
+    void* m_backend { nullptr }; // Per-descriptor state of the backend, if any
 };
+
+constexpr unsigned opMask(OpType type) { return 1u << type; }
 } // namespace aifs
@@ -3,29 +3,32 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <optional>
-#include <queue>
+#include <stdexcept>
 #include <thread>
+#include <utility>
 #include <vector>
 
+#include "buffer_pool.h"
 #include "descriptor.h"
+#include "mpsc_queue.h"
 #include "non_copyable.h"
 #include "operation.h"
+#include "posted_operation.h"
+#include "reactor.h"
 #include "task.h"
+#include "timer_wheel.h"
 
 namespace aifs {
 class EventLoop final : private NonCopyable {
 public:
-    using MSDuration = std::chrono::milliseconds;
-    using TimerHandle = std::pair<MSDuration, Operation*>;
-    enum OpType { read_op = 0,
-        write_op = 1,
-        pri_op = 2,
-        max_op = 3 };
+    using Duration = std::chrono::microseconds;
+    using OpType = aifs::OpType;
 
 public:
-    EventLoop();
+    explicit EventLoop(Backend backend = Backend::epoll);
     ~EventLoop();
 
     /**
@@ -37,55 +40,192 @@ public:
             return;
         }
 
+        m_thread = std::this_thread::get_id();
         while (!isStop()) {
             runOnce();
         }
+        m_thread = std::thread::id {};
     }
 
+    /**
+     * Stop the loop. May be called from any thread.
+     */
     void stop()
     {
         spdlog::info("Stop loop");
         m_stopped = true;
+        wakeup();
     }
 
-    void callLater(MSDuration when, Operation* op)
+    /**
+     * Whether the calling thread is the one running this loop.
+     */
+    [[nodiscard]] bool runningInThisThread() const
     {
-        // Add the handle to the schedule, and the sort the schedule to have to
-        // earliest expiring Timer as the first entry.
-        m_schedule.emplace_back(time() + when, op);
-        std::ranges::push_heap(m_schedule, std::ranges::greater {}, &TimerHandle::first);
-        workStarted();
+        return m_thread.load(std::memory_order_relaxed) == std::this_thread::get_id();
     }
 
-    MSDuration time()
+    /**
+     * Call fn on this loop's thread. May be called from any thread; fn runs
+     * on a later iteration of the loop, never inside post() itself. Work
+     * posted to a loop that no longer runs is dropped when the loop is
+     * destroyed.
+     */
+    template <typename Fn>
+    void post(Fn&& fn)
+    {
+        enqueue(new PostedCallback<Fn> { std::forward<Fn>(fn) });
+    }
+
+    /**
+     * Call fn right away if the calling thread runs this loop, otherwise
+     * post() it.
+     */
+    template <typename Fn>
+    void dispatch(Fn&& fn)
+    {
+        if (runningInThisThread()) {
+            fn();
+        } else {
+            post(std::forward<Fn>(fn));
+        }
+    }
+
+    /**
+     * Resume the awaiting coroutine on this loop's thread:
+     *
+     *     co_await other.schedule();
+     *     // Now running on other
+     */
+    [[nodiscard]] ScheduleOp<EventLoop> schedule() { return ScheduleOp<EventLoop> { this }; }
+
+    /**
+     * Perform timer.m_op once when has passed. Scheduling a timer that is
+     * already pending moves it to the new deadline.
+     */
+    void callLater(Duration when, TimerEntry& timer)
+    {
+        if (!timer.linked()) {
+            workStarted();
+        }
+        m_timers.schedule(timer, time() + when);
+    }
+
+    /**
+     * Complete a pending timer early with operation_canceled. Returns false
+     * if the timer was not pending.
+     */
+    bool cancelTimer(TimerEntry& timer)
+    {
+        if (!m_timers.cancel(timer)) {
+            return false;
+        }
+        timer.m_op->ec = std::make_error_code(std::errc::operation_canceled);
+        m_ready.push_back(timer.m_op);
+        return true;
+    }
+
+    /**
+     * Drop a pending timer without performing its operation.
+     */
+    void removeTimer(TimerEntry& timer)
+    {
+        if (m_timers.cancel(timer)) {
+            workFinished();
+        }
+    }
+
+    Duration time()
     {
         auto now = std::chrono::steady_clock::now();
-        return duration_cast<MSDuration>(now.time_since_epoch()) - m_startTime;
+        return duration_cast<Duration>(now.time_since_epoch()) - m_startTime;
     }
 
-    void addOperation(Descriptor* desc, OpType type, Operation* op)
+    /**
+     * Wait for desc to become ready for an operation of the given type, then
+     * perform op. If the backend is completion-based, io describes the I/O
+     * it should carry out on behalf of op. A descriptor has at most one
+     * pending operation per type.
+     */
+    void addOperation(Descriptor* desc, OpType type, Operation* op, const IoRequest& io = {})
     {
-        m_pendingOps[type].emplace_back(desc, op);
+        if (desc->m_ops[type]) {
+            throw std::runtime_error("Operation already pending on descriptor");
+        }
+        desc->m_ops[type] = op;
+        if (!m_reactor->submit(desc, type, io, op)) {
+            desc->m_interest |= opMask(type);
+            m_reactor->update(desc);
+        }
         workStarted();
     }
 
+    /**
+     * Complete the pending operation of the given type on desc, if any, with
+     * operation_canceled.
+     */
     void cancelOperation(Descriptor* desc, OpType type)
     {
-        for (auto it = m_pendingOps[type].begin(); it != m_pendingOps[type].end();) {
-            if (it->first == desc) {
-                it->second->ec = std::make_error_code(std::errc::operation_canceled);
-                m_ready.push(it->second);
-                m_pendingOps[type].erase(it);
-                break;
-            }
+        auto* op = desc->m_ops[type];
+        if (!op || m_reactor->cancel(desc, type, op)) {
+            // Backends that accepted the operation complete it themselves.
+            return;
+        }
+        desc->m_ops[type] = nullptr;
+        desc->m_interest &= ~opMask(type);
+        m_reactor->update(desc);
+        op->ec = std::make_error_code(std::errc::operation_canceled);
+        m_ready.push_back(op);
+    }
+
+    /**
+     * Cancel every pending operation on desc.
+     */
+    void cancelOperations(Descriptor* desc)
+    {
+        for (int i = 0; i < max_op; ++i) {
+            cancelOperation(desc, static_cast<OpType>(i));
+        }
+    }
+
+    /**
+     * Whether an operation may try its I/O right away instead of waiting for
+     * readiness first. Each operation the loop performs may be followed by
+     * a limited number of such attempts before the coroutine has to wait,
+     * so that a connection that always has data cannot keep the loop from
+     * serving the others.
+     */
+    bool speculate()
+    {
+        if (m_speculationBudget == 0) {
+            return false;
         }
+        --m_speculationBudget;
+        return true;
     }
 
+    /**
+     * Buffers shared by the I/O of everything running on this loop.
+     */
+    [[nodiscard]] BufferPool& buffers() { return m_buffers; }
+
+    /**
+     * Forget desc before it is closed.
+     */
+    void deregister(Descriptor* desc) { m_reactor->deregister(desc); }
+
     void spawn(Task<> t);
 
 private:
+    friend struct ScheduleOp<EventLoop>;
+
+    static constexpr unsigned speculation_budget = 16;
+
     [[nodiscard]] bool isStop() const;
     void runOnce();
+    void enqueue(PostedOperation* op);
+    void wakeup();
+    void watchWakeup();
 
     void workStarted() { ++m_outstandingWork; }
 
@@ -98,11 +238,22 @@ private:
     }
 
 private:
-    bool m_stopped;
-    std::chrono::milliseconds m_startTime;
-    std::vector<TimerHandle> m_schedule;
-    std::queue<Operation*> m_ready;
-    std::vector<std::pair<Descriptor*, Operation*>> m_pendingOps[max_op];
+    BufferPool m_buffers; // Outlives everything that may hold one of its buffers
+    std::atomic<bool> m_stopped;
+    std::unique_ptr<Reactor> m_reactor;
+    std::vector<Reactor::Event> m_events;
+    Duration m_startTime;
+    TimerWheel m_timers;
+    std::vector<Operation*> m_ready;
     uint64_t m_outstandingWork;
+    unsigned m_speculationBudget { speculation_budget };
+
+    // Operations posted from other threads. The loop only needs to be woken
+    // through the eventfd while it is blocked in the reactor.
+    MpscQueue<PostedOperation> m_posted;
+    std::atomic<bool> m_sleeping { false };
+    std::atomic<std::thread::id> m_thread {};
+    Descriptor m_wakeup;
+    Operation m_wakeupOp;
 };
 } // namespace aifs
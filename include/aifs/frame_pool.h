@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace aifs {
+namespace detail {
+    struct FrameBlock {
+        FrameBlock* m_next;
+    };
+
+    // Trivially destructible, so it stays usable for frames freed by other
+    // thread-local destructors after FrameCleanup has run.
+    template <std::size_t NumClasses>
+    struct FrameFreeLists {
+        std::array<FrameBlock*, NumClasses> m_heads;
+        std::array<std::uint32_t, NumClasses> m_counts;
+        bool m_registered;
+        bool m_closed;
+    };
+
+    template <typename FreeLists>
+    struct FrameCleanup {
+        FreeLists* m_lists { nullptr };
+
+        ~FrameCleanup()
+        {
+            if (!m_lists) {
+                return;
+            }
+            for (auto& head : m_lists->m_heads) {
+                while (auto* block = head) {
+                    head = block->m_next;
+                    ::operator delete(block);
+                }
+            }
+            m_lists->m_counts = {};
+            m_lists->m_closed = true;
+        }
+    };
+} // namespace detail
+
+/**
+ * Thread-local size-class freelists for coroutine frames.
+ *
+ * Frames are rounded up to a multiple of 64 bytes, and freed frames are kept
+ * on this thread's freelist for their size class, so that a coroutine that
+ * is started over and over (a connection handler, a route) reuses the same
+ * few blocks instead of going through malloc. A frame may be freed on a
+ * different thread than the one that allocated it; the block then moves to
+ * the freeing thread's pool. Frames larger than the largest class, and
+ * blocks beyond what a freelist caches, go to the global operator new.
+ */
+class FramePool {
+public:
+    static constexpr std::size_t granularity = 64;
+    static constexpr std::size_t num_classes = 32;
+    static constexpr std::uint32_t max_cached = 1024;
+
+    static void* allocate(std::size_t size)
+    {
+        auto cls = sizeClass(size);
+        if (cls < num_classes) {
+            auto& lists = t_lists;
+            if (auto* block = lists.m_heads[cls]) {
+                lists.m_heads[cls] = block->m_next;
+                --lists.m_counts[cls];
+                return block;
+            }
+            return ::operator new((cls + 1) * granularity);
+        }
+        return ::operator new(size);
+    }
+
+    static void deallocate(void* ptr, std::size_t size) noexcept
+    {
+        auto cls = sizeClass(size);
+        auto& lists = t_lists;
+        if (cls >= num_classes || lists.m_counts[cls] >= max_cached || lists.m_closed) {
+            ::operator delete(ptr);
+            return;
+        }
+        if (!lists.m_registered) {
+            // Make sure the cached blocks are released when the thread exits.
+            lists.m_registered = true;
+            t_cleanup.m_lists = &lists;
+        }
+        auto* block = static_cast<Block*>(ptr);
+        block->m_next = lists.m_heads[cls];
+        lists.m_heads[cls] = block;
+        ++lists.m_counts[cls];
+    }
+
+private:
+    using Block = detail::FrameBlock;
+    using FreeLists = detail::FrameFreeLists<num_classes>;
+
+    static constexpr std::size_t sizeClass(std::size_t size)
+    {
+        return size == 0 ? 0 : (size - 1) / granularity;
+    }
+
+    static inline thread_local constinit FreeLists t_lists {};
+    static inline thread_local detail::FrameCleanup<FreeLists> t_cleanup {};
+};
+
+/**
+ * Base for coroutine promise types whose frames should come from the
+ * FramePool. Define AIFS_NO_FRAME_POOL to use the global operator new
+ * instead.
+ */
+struct PooledFrame {
+#ifndef AIFS_NO_FRAME_POOL
+    static void* operator new(std::size_t size) { return FramePool::allocate(size); }
+
+    static void operator delete(void* ptr, std::size_t size) noexcept
+    {
+        FramePool::deallocate(ptr, size);
+    }
+#endif
+};
+} // namespace aifs
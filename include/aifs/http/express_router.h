@@ -1,57 +1,88 @@
 #pragma once
 
-#include <functional>
-#include <map>
-#include <string_view>
+#include <http_parser.h>
 
-#include <spdlog/spdlog.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "aifs/http/request.h"
+#include "aifs/http/route_tree.h"
 #include "aifs/http/router.h"
 #include "aifs/task.h"
 
-
-#include <optional>
-
 namespace aifs::http {
-
-using HandlerFn = std::function<Task<HandlerStatus>(const Request&, Response&)>;
-
-namespace detail {
-    struct Route {
-        std::string path;
-        HandlerFn fn;
-    };
-
-    struct Layer {
-        std::optional<Route> route;
-    };
-}
-
+/**
+ * Routes requests by method and path, in the style of Express:
+ *
+ *     router.get("/users/:id", [](const Request& req, Response& resp) -> Task<HandlerStatus> {
+ *         co_await resp.send(fmt::format("User {}", *req.param("id")));
+ *         co_return HandlerStatus::Accepted;
+ *     });
+ *
+ * Every method has a RouteTree of its own; routes added with use() apply to
+ * all methods, after the method's own routes. The query string plays no
+ * part in matching.
+ */
 class ExpressRouter : public Router {
 public:
-    Task<HandlerStatus> handle(const Request& req, Response& resp)
+    Task<HandlerStatus> handle(Request& req, Response& resp) override
     {
-        for (auto& layer : m_layers) {
-            if (layer.route && (*layer.route).path == req.url()) {
-                auto status = co_await (*layer.route).fn(req, resp);
-                if (status == HandlerStatus::Accepted) {
-                    co_return status;
-                }
-            }
+        const HandlerFn* fn = nullptr;
+        if (auto* tree = find(req.method())) {
+            fn = tree->find(req.path(), req.m_params);
+        }
+        if (!fn) {
+            fn = m_any.find(req.path(), req.m_params);
+        }
+        if (!fn) {
+            co_return HandlerStatus::NotAccepted;
         }
-        // TODO: What if we didn't handle the request?
-        co_return HandlerStatus::NotAccepted;
+        co_return co_await (*fn)(req, resp);
     }
 
-    void get(const std::string& path, HandlerFn fn)
+    /**
+     * Handle requests with method (an http_method) for pattern with fn;
+     * see RouteTree for the syntax.
+     */
+    void route(unsigned method, std::string_view pattern, HandlerFn fn)
     {
-        detail::Route route{path, std::move(fn)};
-        detail::Layer layer{std::move(route)};
-        m_layers.emplace_back(std::move(layer));
+        auto* tree = find(method);
+        if (!tree) {
+            tree = m_trees.emplace_back(method, std::make_unique<RouteTree>()).second.get();
+        }
+        tree->insert(pattern, std::move(fn));
+    }
+
+    void get(std::string_view pattern, HandlerFn fn) { route(HTTP_GET, pattern, std::move(fn)); }
+    void post(std::string_view pattern, HandlerFn fn) { route(HTTP_POST, pattern, std::move(fn)); }
+    void put(std::string_view pattern, HandlerFn fn) { route(HTTP_PUT, pattern, std::move(fn)); }
+    void patch(std::string_view pattern, HandlerFn fn) { route(HTTP_PATCH, pattern, std::move(fn)); }
+    void del(std::string_view pattern, HandlerFn fn) { route(HTTP_DELETE, pattern, std::move(fn)); }
+
+    /**
+     * Handle every request for path or anything below it with fn, whatever
+     * the method.
+     */
+    void use(const std::string& path, HandlerFn fn)
+    {
+        m_any.insert(path, fn);
+        m_any.insert(path + (path.ends_with('/') ? "*" : "/*"), std::move(fn));
     }
 
 private:
-    std::vector<detail::Layer> m_layers;
+    RouteTree* find(unsigned method)
+    {
+        for (auto& [m, tree] : m_trees) {
+            if (m == method) {
+                return tree.get();
+            }
+        }
+        return nullptr;
+    }
+
+    std::vector<std::pair<unsigned, std::unique_ptr<RouteTree>>> m_trees;
+    RouteTree m_any;
 };
 }
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "aifs/http/request.h"
+
+namespace aifs::http {
+/**
+ * Built-in request parser with the same interface as RequestParser, for
+ * use instead of http_parser (see HTTPConnection). Rather than feeding
+ * every byte through a state machine, it waits until the header block is
+ * complete and then parses it in one pass, finding delimiters 32 or 16
+ * bytes at a time with AVX2 or SSE4.2, whichever the CPU supports.
+ *
+ * Methods are numbered like http_parser's http_method; only DELETE, GET,
+ * HEAD, POST, PUT, OPTIONS, TRACE and PATCH are accepted. Trailer fields
+ * of chunked bodies are skipped. Field names must be tokens, where
+ * http_parser lets spaces in them through.
+ */
+class FastRequestParser {
+public:
+    enum Error : unsigned {
+        ok,
+        invalid_method,
+        invalid_url,
+        invalid_version,
+        invalid_header,
+        header_overflow,
+        invalid_content_length,
+        invalid_transfer_encoding,
+        invalid_chunk,
+    };
+
+    // Largest header block accepted, like http_parser's HTTP_MAX_HEADER_SIZE.
+    static constexpr std::size_t max_header_size = 80 * 1024;
+
+    /**
+     * Parse chunk up to the end of the next complete request at most, and
+     * return the number of bytes used. The rest of chunk belongs to the
+     * requests after it.
+     */
+    std::size_t consume(std::span<const char> chunk);
+
+    [[nodiscard]] unsigned error() const { return m_error; }
+
+    /**
+     * Whether the client lets the connection stay open after the complete
+     * request, following its HTTP version and Connection header.
+     */
+    [[nodiscard]] bool keepAlive() const
+    {
+        if (m_major > 0 && m_minor > 0) {
+            return !m_connectionClose;
+        }
+        return m_connectionKeepAlive;
+    }
+
+    [[nodiscard]] bool http10() const { return m_major == 1 && m_minor == 0; }
+
+    /**
+     * Forget the complete request and go on parsing the next one.
+     */
+    void next();
+
+public:
+    // Set once the request is complete.
+    bool m_complete { false };
+    unsigned m_method {};
+    std::string_view m_url {};
+    std::string_view m_body {};
+    std::vector<Header> m_headers {};
+
+private:
+    static constexpr std::size_t max_retained = 64 * 1024;
+
+    enum class State {
+        headers,
+        body,
+        chunk_size,
+        chunk_data,
+        chunk_end,
+        trailers,
+    };
+
+    // Position of an element relative to m_base.
+    struct Token {
+        std::size_t offset { 0 };
+        std::size_t length { 0 };
+    };
+
+    struct HeaderToken {
+        Token field;
+        Token value;
+    };
+
+    // Parse the bytes up to end, relative to m_base. Returns true once the
+    // request is complete or an error was found.
+    bool parse(std::size_t end);
+    bool parseHeaders(std::size_t end);
+    void processHeader(std::string_view field, std::string_view value);
+    void appendBody(std::size_t offset, std::size_t n);
+
+    // Record the error; returns true, since parsing is over.
+    bool fail(Error error);
+    void finish();
+
+    [[nodiscard]] std::string_view view(Token token) const { return { m_base + token.offset, token.length }; }
+
+    Error m_error { ok };
+    State m_state { State::headers };
+    std::size_t m_pos { 0 }; // Parsed up to here
+    std::size_t m_scan { 0 }; // End of header block not before here
+    std::uint64_t m_remaining { 0 }; // Of the body or current chunk
+
+    unsigned m_major { 0 };
+    unsigned m_minor { 0 };
+    bool m_connectionClose { false };
+    bool m_connectionKeepAlive { false };
+    bool m_hasContentLength { false };
+    bool m_chunked { false };
+
+    const char* m_base { nullptr };
+    std::string m_spill {}; // The request so far, once it spans reads
+    std::string m_ownedBody {};
+    Token m_urlToken {};
+    Token m_bodyToken {};
+    std::vector<HeaderToken> m_headerTokens {};
+};
+} // namespace aifs::http
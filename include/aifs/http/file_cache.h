@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+#include "aifs/non_copyable.h"
+
+namespace aifs::http {
+/**
+ * A file opened for reading, together with its stat result. The
+ * descriptor is closed when the last reference goes away.
+ */
+struct CachedFile : private NonCopyable {
+    CachedFile(int fd, const struct stat& st)
+        : m_fd { fd }
+        , m_stat { st }
+    {
+    }
+
+    ~CachedFile();
+
+    /**
+     * Open and fstat path. Throws std::system_error on failure.
+     */
+    static std::shared_ptr<const CachedFile> open(const std::string& path);
+
+    [[nodiscard]] std::size_t size() const { return static_cast<std::size_t>(m_stat.st_size); }
+
+    int m_fd;
+    struct stat m_stat;
+};
+
+/**
+ * Keeps recently used files open, so that serving a hot file does not cost
+ * an open() and fstat() per request.
+ *
+ * An entry older than revalidateAfter is checked against a fresh stat() of
+ * its path before it is handed out again, and reopened if the file was
+ * replaced or modified. At most capacity files are kept open; the least
+ * recently used one is closed first. May be used from several threads.
+ */
+class FileCache : private NonCopyable {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FileCache(std::size_t capacity = 1024, Clock::duration revalidateAfter = std::chrono::seconds { 1 })
+        : m_capacity { capacity }
+        , m_revalidateAfter { revalidateAfter }
+    {
+    }
+
+    /**
+     * The open file at path. Throws std::system_error if it cannot be
+     * opened. Failures are not cached.
+     */
+    std::shared_ptr<const CachedFile> open(const std::string& path);
+
+    /**
+     * Drop the entry for path, so that the next open() reopens it.
+     */
+    void invalidate(const std::string& path);
+
+    void clear();
+
+private:
+    struct Entry {
+        std::shared_ptr<const CachedFile> m_file;
+        Clock::time_point m_checked;
+        std::list<std::string>::iterator m_lru;
+    };
+
+    void insert(const std::string& path, std::shared_ptr<const CachedFile> file, Clock::time_point now);
+
+    std::size_t m_capacity;
+    Clock::duration m_revalidateAfter;
+
+    std::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::list<std::string> m_lru; // Most recently used first
+};
+} // namespace aifs::http
@@ -2,18 +2,39 @@
 
 #include <http_parser.h>
 
-#include <map>
+#include <chrono>
+#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fmt/format.h>
 
 #include "aifs/event_loop.h"
+#include "aifs/http/fast_request_parser.h"
+#include "aifs/http/request.h"
 #include "aifs/http/router.h"
 #include "aifs/http/response.h"
 #include "aifs/log.h"
+#include "aifs/output_queue.h"
 #include "aifs/steady_timer.h"
 #include "aifs/task.h"
 #include "aifs/tcp_socket.h"
 
 namespace aifs::http {
+/**
+ * Incremental parser for the requests on one connection. It stops after
+ * every complete request, so that pipelined requests are handled one at a
+ * time; next() moves on to the following request.
+ *
+ * The URL, headers and body of a complete request are views rather than
+ * copies. They point into the data passed to consume() as long as the
+ * request came in one piece, which then has to stay valid until next().
+ * Only a request that spans several reads is copied into the parser's own
+ * buffer as it arrives.
+ */
 class RequestParser {
 public:
     RequestParser()
@@ -21,31 +42,42 @@ public:
         m_parser_settings.on_message_complete = [](http_parser* p) {
             RequestParser* self = reinterpret_cast<RequestParser*>(p->data);
             self->m_method = p->method;
+            self->m_keepAlive = http_should_keep_alive(p);
+            self->m_http10 = p->http_major == 1 && p->http_minor == 0;
             self->m_complete = true;
+            self->finish();
+            http_parser_pause(p, 1);
             return 0;
         };
 
+        // The data callbacks are called once more for every read an element
+        // spans; all but chunked bodies continue where they left off.
         m_parser_settings.on_url = [](http_parser* p, const char* at, std::size_t n) {
             RequestParser* self = reinterpret_cast<RequestParser*>(p->data);
-            self->m_url = std::string(at, n);
+            self->extend(self->m_urlToken, at, n);
             return 0;
         };
 
         m_parser_settings.on_body = [](http_parser* p, const char* at, std::size_t n) {
             RequestParser* self = reinterpret_cast<RequestParser*>(p->data);
-            self->m_body.append(at, n);
+            self->appendBody(at, n);
             return 0;
         };
 
         m_parser_settings.on_header_field = [](http_parser* p, const char* at, std::size_t n) {
             RequestParser* self = reinterpret_cast<RequestParser*>(p->data);
-            self->m_cur_header_field = std::string(at, n);
+            if (self->m_headerTokens.empty() || self->m_inValue) {
+                self->m_headerTokens.emplace_back();
+                self->m_inValue = false;
+            }
+            self->extend(self->m_headerTokens.back().field, at, n);
             return 0;
         };
 
         m_parser_settings.on_header_value = [](http_parser* p, const char* at, std::size_t n) {
             RequestParser* self = reinterpret_cast<RequestParser*>(p->data);
-            self->m_headers.emplace(self->m_cur_header_field, std::string(at, n));
+            self->m_inValue = true;
+            self->extend(self->m_headerTokens.back().value, at, n);
             return 0;
         };
 
@@ -54,70 +86,296 @@ public:
     }
 
 public:
-    unsigned int consume(std::span<const char> chunk)
+    /**
+     * Parse chunk up to the end of the next complete request at most, and
+     * return the number of bytes used. The rest of chunk belongs to the
+     * requests after it.
+     */
+    std::size_t consume(std::span<const char> chunk)
     {
-        http_parser_execute(&m_parser, &m_parser_settings, chunk.data(), chunk.size());
-        return m_parser.http_errno;
+        // Offsets count from the first byte passed since next(), which is
+        // where m_base points.
+        const char* data = chunk.data();
+        std::size_t spilled = m_spill.size();
+        if (spilled > 0) {
+            m_spill.append(chunk.data(), chunk.size());
+            m_base = m_spill.data();
+            data = m_base + spilled;
+        } else {
+            m_base = chunk.data();
+        }
+
+        auto n = http_parser_execute(&m_parser, &m_parser_settings, data, chunk.size());
+
+        if (spilled > 0) {
+            // Drop what belongs to the following requests.
+            m_spill.resize(spilled + n);
+        } else if (!m_complete && n > 0) {
+            // The request goes on in the next read, after which chunk is
+            // gone.
+            m_spill.assign(chunk.data(), n);
+        }
+        return n;
+    }
+
+    [[nodiscard]] unsigned error() const
+    {
+        return m_parser.http_errno == HPE_PAUSED ? static_cast<unsigned>(HPE_OK) : m_parser.http_errno;
+    }
+
+    /**
+     * Whether the client lets the connection stay open after the complete
+     * request, following its HTTP version and Connection header.
+     */
+    [[nodiscard]] bool keepAlive() const { return m_keepAlive; }
+    [[nodiscard]] bool http10() const { return m_http10; }
+
+    /**
+     * Forget the complete request and go on parsing the next one.
+     */
+    void next()
+    {
+        m_complete = false;
+        m_url = {};
+        m_body = {};
+        m_headers.clear();
+        m_urlToken = {};
+        m_bodyToken = {};
+        m_headerTokens.clear();
+        m_inValue = false;
+        m_ownedBody.clear();
+        m_spill.clear();
+        // Keep the buffers for the next request, unless an unusually large
+        // one made them grow.
+        if (m_spill.capacity() > max_retained) {
+            m_spill.shrink_to_fit();
+        }
+        if (m_ownedBody.capacity() > max_retained) {
+            m_ownedBody.shrink_to_fit();
+        }
+        http_parser_pause(&m_parser, 0);
     }
 
 public:
+    // Set once the request is complete.
     bool m_complete { false };
     unsigned m_method {};
-    std::string m_url {};
-    std::string m_body {};
-    std::map<std::string, std::string> m_headers {};
+    std::string_view m_url {};
+    std::string_view m_body {};
+    std::vector<Header> m_headers {};
 
 private:
+    static constexpr std::size_t max_retained = 64 * 1024;
+
+    // Position of an element relative to m_base.
+    struct Token {
+        std::size_t offset { 0 };
+        std::size_t length { 0 };
+    };
+
+    struct HeaderToken {
+        Token field;
+        Token value;
+    };
+
+    void extend(Token& token, const char* at, std::size_t n)
+    {
+        if (token.length == 0) {
+            token.offset = static_cast<std::size_t>(at - m_base);
+        }
+        token.length += n;
+    }
+
+    // The pieces of a chunked body are separated by the chunk sizes, so
+    // all but the first are copied.
+    void appendBody(const char* at, std::size_t n)
+    {
+        auto offset = static_cast<std::size_t>(at - m_base);
+        if (m_ownedBody.empty() && (m_bodyToken.length == 0 || m_bodyToken.offset + m_bodyToken.length == offset)) {
+            extend(m_bodyToken, at, n);
+            return;
+        }
+        if (m_ownedBody.empty()) {
+            m_ownedBody.assign(view(m_bodyToken));
+        }
+        m_ownedBody.append(at, n);
+    }
+
+    [[nodiscard]] std::string_view view(Token token) const { return { m_base + token.offset, token.length }; }
+
+    void finish()
+    {
+        m_url = view(m_urlToken);
+        m_body = m_ownedBody.empty() ? view(m_bodyToken) : std::string_view { m_ownedBody };
+        m_headers.clear();
+        for (const auto& h : m_headerTokens) {
+            m_headers.push_back({ view(h.field), view(h.value) });
+        }
+    }
+
     http_parser_settings m_parser_settings {};
     http_parser m_parser {};
-    std::string m_cur_header_field {};
+    bool m_keepAlive { false };
+    bool m_http10 { false };
+
+    const char* m_base { nullptr };
+    std::string m_spill {}; // The request so far, once it spans reads
+    std::string m_ownedBody {};
+    Token m_urlToken {};
+    Token m_bodyToken {};
+    std::vector<HeaderToken> m_headerTokens {};
+    bool m_inValue { false };
+};
+
+struct ConnectionOptions {
+    // Close the connection after this many requests.
+    std::size_t maxRequests { 1000 };
+
+    // Close the connection when the client sends nothing for this long,
+    // between requests or in the middle of one.
+    EventLoop::Duration idleTimeout { std::chrono::seconds(10) };
 };
 
+/**
+ * Serves the requests of one client. The connection stays open as long as
+ * the client allows (HTTP/1.1 keep-alive), up to the limits in
+ * ConnectionOptions. Pipelined requests are handled in order, and the
+ * responses to the requests from one read go out together.
+ *
+ * Parser is RequestParser, which uses http_parser, or FastRequestParser.
+ */
+template <typename Parser = RequestParser>
 class HTTPConnection {
 public:
-    HTTPConnection(EventLoop&, Router& router, std::unique_ptr<TCPSocket> socket)
+    HTTPConnection(EventLoop& ev, Router& router, std::unique_ptr<BasicStreamSocket> socket,
+        ConnectionOptions options = {})
         : m_log { makeLogger("conn:" + std::to_string(socket->remote_port())) }
+        , m_eventLoop { ev }
         , m_router { router }
+        , m_options { options }
         , m_socket { std::move(socket) }
+        , m_output { ev, *m_socket }
         , m_parser {}
+        , m_idleTimeout { this }
     {
+        m_idleTimer.m_op = &m_idleTimeout;
+    }
+
+    ~HTTPConnection()
+    {
+        m_eventLoop.removeTimer(m_idleTimer);
     }
 
     Task<> handle()
     {
         try {
-            std::array<char, 8 * 1024> buffer {};
-            for (;;) {
-                ssize_t received = co_await m_socket->receive(buffer);
-                auto res = m_parser.consume({ buffer.data(), static_cast<std::size_t>(received) });
-                if (res != HPE_OK && res != HPE_PAUSED) {
-                    m_log->warn("Parsing failed {}", res);
-                    // TODO: What do send if the request is invalid?
-                    break;
-                }
-                if (m_parser.m_complete) {
-                    m_log->info("Got request for {}", m_parser.m_url);
-                    Request req { m_parser.m_method, m_parser.m_url };
-                    Response resp{*m_socket};
-                    auto status = co_await m_router.handle(req, resp);
-                    if (status != HandlerStatus::Accepted) {
-                        co_await m_socket->send("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            std::size_t served = 0;
+            bool keepAlive = true;
+            while (keepAlive) {
+                // The buffer goes back to the loop's pool once all requests
+                // in it are handled; the parser keeps its own copies.
+                m_eventLoop.callLater(m_options.idleTimeout, m_idleTimer);
+                m_idle = true;
+                auto buffer = co_await m_socket->receiveBuffer();
+                m_idle = false;
+                m_eventLoop.removeTimer(m_idleTimer);
+
+                std::span<const char> data = buffer.bytes();
+                while (!data.empty() && keepAlive) {
+                    data = data.subspan(m_parser.consume(data));
+                    if (auto res = m_parser.error(); res != HPE_OK) {
+                        m_log->warn("Parsing failed {}", res);
+                        Response resp { m_output };
+                        resp.setStatus(400);
+                        resp.setHeader("Connection", "close");
+                        co_await resp.send("");
+                        keepAlive = false;
+                        break;
+                    }
+                    if (!m_parser.m_complete) {
+                        break;
                     }
-                    break;
+                    keepAlive = m_parser.keepAlive() && ++served < m_options.maxRequests;
+                    co_await handleRequest(keepAlive);
+                    m_parser.next();
                 }
+                co_await m_output.flush();
+            }
+        } catch (const std::system_error& e) {
+            // The client went away, or was idle for too long.
+            if (e.code() == std::errc::connection_aborted || e.code() == std::errc::operation_canceled) {
+                m_log->debug("Closing: {}", e.what());
+            } else {
+                m_log->error("Exception: {}", e.what());
             }
         } catch (const std::exception& e) {
             m_log->error("Exception: {}", e.what());
-            // TODO: Anything to send here?!
         }
-        // TODO: Always close connection?
+        m_idle = false;
+        m_eventLoop.removeTimer(m_idleTimer);
         m_socket->close();
+        // The timer may have expired together with the last receive; let
+        // it run before the connection goes away.
+        co_await m_eventLoop.schedule();
+    }
+
+private:
+    // Cancels the pending receive when the idle timer expires. An expiry
+    // that comes after the receive completed, or after the timer was
+    // re-armed, is ignored.
+    struct IdleTimeout : Operation {
+        explicit IdleTimeout(HTTPConnection* conn)
+            : m_conn { conn }
+        {
+        }
+
+        void perform(const std::error_code& ec) override
+        {
+            if (!ec && m_conn->m_idle && !m_conn->m_idleTimer.linked()) {
+                m_conn->m_socket->cancel();
+            }
+        }
+
+        HTTPConnection* m_conn;
+    };
+
+    Task<> handleRequest(bool keepAlive)
+    {
+        m_log->info("Got request for {}", m_parser.m_url);
+        Request req { m_parser.m_method, m_parser.m_url, m_parser.m_headers, m_parser.m_body };
+        Response resp { m_output };
+        resp.setHeadRequest(m_parser.m_method == HTTP_HEAD);
+        const char* connection = nullptr;
+        if (!keepAlive) {
+            connection = "close";
+        } else if (m_parser.http10()) {
+            connection = "keep-alive";
+        }
+        if (connection) {
+            resp.setHeader("Connection", connection);
+        }
+
+        auto status = co_await m_router.handle(req, resp);
+        if (status != HandlerStatus::Accepted) {
+            resp.setStatus(404);
+            co_await resp.send("");
+            co_return;
+        }
+        // Finish a response the handler left open, so that the next one
+        // starts at a message boundary.
+        co_await resp.end();
     }
 
 private:
     Logger m_log;
+    EventLoop& m_eventLoop;
     Router& m_router;
-    std::unique_ptr<TCPSocket> m_socket;
-    RequestParser m_parser;
+    ConnectionOptions m_options;
+    std::unique_ptr<BasicStreamSocket> m_socket;
+    OutputQueue m_output;
+    Parser m_parser;
+    IdleTimeout m_idleTimeout;
+    TimerEntry m_idleTimer;
+    bool m_idle { false };
 };
 } // namespace aifs::http
\ No newline at end of file
@@ -9,12 +9,18 @@
 #include "aifs/tcp_acceptor.h"
 
 namespace aifs::http {
+/**
+ * Serves HTTP on the connections of an acceptor, which may be a TCPAcceptor
+ * or a UnixAcceptor. Parser picks the request parser; see HTTPConnection.
+ */
+template <typename Socket = TCPSocket, typename Parser = RequestParser>
 class HTTPServer {
 public:
-    explicit HTTPServer(EventLoop& ev, Acceptor<TCPSocket>& acceptor, Router& router)
+    explicit HTTPServer(EventLoop& ev, Acceptor<Socket>& acceptor, Router& router, ConnectionOptions options = {})
         : m_eventLoop { ev }
         , m_acceptor { acceptor }
         , m_router { router }
+        , m_options { options }
     {
     }
 
@@ -33,10 +39,10 @@ public:
     void stop() { m_acceptor.cancel(); }
 
 private:
-    Task<> handleConnection(Acceptor<TCPSocket>::SocketPtr socket)
+    Task<> handleConnection(typename Acceptor<Socket>::SocketPtr socket)
     {
         try {
-            HTTPConnection conn { m_eventLoop, m_router, std::move(socket) };
+            HTTPConnection<Parser> conn { m_eventLoop, m_router, std::move(socket), m_options };
             co_await conn.handle();
         } catch (const std::exception& e) {
             spdlog::error("Got exception ({}): {}", __func__, e.what());
@@ -45,7 +51,8 @@ private:
 
 private:
     EventLoop& m_eventLoop;
-    Acceptor<TCPSocket>& m_acceptor;
+    Acceptor<Socket>& m_acceptor;
     Router& m_router;
+    ConnectionOptions m_options;
 };
 } // namespace aifs::http
\ No newline at end of file
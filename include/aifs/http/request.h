@@ -1,22 +1,119 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string_view>
+
 namespace aifs::http {
+struct Header {
+    std::string_view field;
+    std::string_view value;
+};
+
+/**
+ * Path parameters captured by the router, such as id for /users/:id. The
+ * names belong to the router and the values to the URL, so nothing is
+ * allocated.
+ */
+class RouteParams {
+public:
+    static constexpr std::size_t max_params = 8;
+
+    struct Param {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    [[nodiscard]] std::size_t size() const { return m_size; }
+    [[nodiscard]] const Param* begin() const { return m_params.data(); }
+    [[nodiscard]] const Param* end() const { return m_params.data() + m_size; }
+
+    void push(std::string_view name, std::string_view value) { m_params[m_size++] = { name, value }; }
+    void pop() { --m_size; }
+
+private:
+    std::array<Param, max_params> m_params {};
+    std::size_t m_size { 0 };
+};
+
+/**
+ * A request as parsed from the connection. The URL, headers and body are
+ * views into the connection's buffers and stay valid while the request is
+ * handled.
+ */
 class Request {
 public:
-    Request(unsigned method, std::string url)
+    Request(unsigned method, std::string_view url, std::span<const Header> headers = {}, std::string_view body = {})
         : m_method{method}
-        , m_url{std::move(url)}
+        , m_url{url}
+        , m_path{url.substr(0, url.find('?'))}
+        , m_headers{headers}
+        , m_body{body}
     {}
 
     unsigned method() const {
         return m_method;
     }
 
-    const std::string& url() const {
+    std::string_view url() const {
         return m_url;
     }
 
+    /**
+     * The URL before and after the '?'.
+     */
+    std::string_view path() const {
+        return m_path;
+    }
+
+    std::string_view query() const {
+        return m_url.size() > m_path.size() ? m_url.substr(m_path.size() + 1) : std::string_view {};
+    }
+
+    /**
+     * Value of the path parameter name of the matched route, such as id
+     * for /users/:id, or of a named wildcard such as *path.
+     */
+    std::optional<std::string_view> param(std::string_view name) const {
+        for (const auto& p : m_params) {
+            if (p.name == name) {
+                return p.value;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::span<const Header> headers() const {
+        return m_headers;
+    }
+
+    /**
+     * Value of the first header with the field name, which is matched
+     * case-insensitively.
+     */
+    std::optional<std::string_view> header(std::string_view field) const {
+        auto equal = [](unsigned char a, unsigned char b) { return std::tolower(a) == std::tolower(b); };
+        for (const auto& h : m_headers) {
+            if (std::ranges::equal(h.field, field, equal)) {
+                return h.value;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::string_view body() const {
+        return m_body;
+    }
+
     unsigned m_method;
-    std::string m_url;
+    std::string_view m_url;
+    std::string_view m_path;
+    std::span<const Header> m_headers;
+    std::string_view m_body;
+    RouteParams m_params;
 };
 }
@@ -1,23 +1,117 @@
 #pragma once
 
+#include <functional>
+#include <optional>
 #include <string>
-#include <map>
+#include <string_view>
+#include <utility>
+#include <vector>
 
+#include "aifs/non_copyable.h"
+#include "aifs/output_queue.h"
 #include "aifs/task.h"
-#include "aifs/tcp_socket.h"
 
 namespace aifs::http {
-class Response {
+/**
+ * A response written to a connection's OutputQueue. send() only queues
+ * the response, and suspends while the queue is above its high-water
+ * mark; the connection flushes the queue after handling the request.
+ * Handlers take it by reference, since the connection finishes whatever
+ * body they leave open.
+ *
+ * The header block is written straight into a buffer recycled by the
+ * OutputQueue, and gets a Date header unless the handler sets one.
+ */
+class Response : private NonCopyable {
 public:
-    Response(StreamSocket& socket);
+    /**
+     * A response as sent with send(), kept by ResponseCache to send again:
+     * the status, the header fields that do not depend on the connection,
+     * serialized, and the body.
+     */
+    struct Snapshot {
+        unsigned status { 0 };
+        std::string fields;
+        std::string body;
+        std::string etag;
+    };
+
+    using CaptureFn = std::function<void(Snapshot)>;
+
+    Response(OutputQueue& output);
+
+    /**
+     * Set the status code, 200 by default. Throws std::invalid_argument if
+     * it is not between 100 and 599.
+     */
     void setStatus(unsigned statusCode);
-    void setHeader(const std::string& field, const std::string& value);
+
+    /**
+     * Set the header field, replacing any value set before; field is
+     * matched case-insensitively.
+     */
+    void setHeader(std::string_view field, std::string_view value);
+
+    /**
+     * Answer a HEAD request: the header block goes out as it would for GET,
+     * Content-Length included, but the body does not.
+     */
+    void setHeadRequest(bool head) { m_head = head; }
+
     Task<> send(std::string body);
 
+    /**
+     * Send a snapshot taken by capture(), after the header fields set on
+     * this response.
+     */
+    Task<> send(const Snapshot& snapshot);
+
+    /**
+     * Pass a snapshot of the response to fn once it is sent with send(),
+     * before it is written to the connection. It gets a strong ETag
+     * computed from the body, unless the handler sets one. Responses sent
+     * any other way are not passed on.
+     */
+    void capture(CaptureFn fn) { m_capture = std::move(fn); }
+
+    /**
+     * Send length bytes of the file fd, starting at offset, as the body.
+     * The data is not copied through user space when the socket supports
+     * sendfile.
+     */
+    Task<> sendFile(int fd, off_t offset, std::size_t length);
+
+    /**
+     * Send the whole file at path as the body.
+     */
+    Task<> sendFile(const std::string& path);
+
+    /**
+     * Stream the body in pieces with chunked transfer encoding, instead of
+     * send(). The first write() queues the header block. Like send(),
+     * write() only suspends when the connection's output queue is full;
+     * flush() pushes out what was written so far. end() finishes the body.
+     */
+    Task<> write(std::string chunk);
+    Task<> flush();
+    Task<> end();
+
 private:
-    StreamSocket& m_socket;
+    // Without a content length the body is chunked. fields are serialized
+    // header fields to add.
+    std::string header(std::optional<std::size_t> contentLength, std::string_view fields = {}) const;
+    const std::string* findHeader(std::string_view field) const;
+
+    // Whether only the header block goes out, as for HEAD requests and 1xx,
+    // 204 and 304, whatever body the handler gives.
+    bool omitsBody() const;
+
+    OutputQueue& m_output;
     bool m_sent;
+    bool m_streaming { false };
+    bool m_head { false };
     unsigned m_status;
-    std::map<std::string, std::string> m_headers;
+    std::vector<std::pair<std::string, std::string>> m_headers;
+    CaptureFn m_capture;
 };
 }
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "aifs/event_loop.h"
+#include "aifs/http/request.h"
+#include "aifs/http/response.h"
+#include "aifs/http/router.h"
+#include "aifs/non_copyable.h"
+#include "aifs/task.h"
+
+namespace aifs::http {
+struct ResponseCacheOptions {
+    // Total size of the cached keys and responses.
+    std::size_t maxBytes { 16 * 1024 * 1024 };
+
+    // How long a response is served from the cache.
+    EventLoop::Duration ttl { std::chrono::seconds(1) };
+
+    // Request headers whose values become part of the key, such as
+    // Accept-Encoding.
+    std::vector<std::string> keyHeaders {};
+};
+
+/**
+ * Caches the responses of another router, placed in front of it:
+ *
+ *     ResponseCache cache { ev, router };
+ *     HTTPServer server { ev, acceptor, cache };
+ *
+ * Only GET requests are cached. A request carrying Authorization or Cookie
+ * bypasses the cache, unless that header is one of the key headers. Of the
+ * responses, those with status 200 sent with Response::send() are kept,
+ * unless they set a cookie or their Cache-Control has a no-store, private,
+ * no-cache or max-age=0 directive. Each gets an ETag,
+ * and a request whose If-None-Match lists it is answered with 304.
+ *
+ * Requests that miss on a key already being fetched wait for that fetch
+ * rather than running the handler again. Responses are evicted least
+ * recently used first once maxBytes is reached, and expire after ttl.
+ *
+ * Like the connections it serves, the cache belongs to one event loop.
+ */
+class ResponseCache : public Router {
+public:
+    struct Stats {
+        std::uint64_t hits { 0 };
+        std::uint64_t misses { 0 };
+        std::uint64_t coalesced { 0 }; // Misses that waited for another fetch
+        std::uint64_t notModified { 0 };
+        std::uint64_t evictions { 0 };
+        std::uint64_t expirations { 0 };
+    };
+
+    ResponseCache(EventLoop& loop, Router& router, ResponseCacheOptions options = {})
+        : m_eventLoop { loop }
+        , m_router { router }
+        , m_options { std::move(options) }
+    {
+    }
+
+    Task<HandlerStatus> handle(Request& req, Response& resp) override;
+
+    [[nodiscard]] const Stats& stats() const { return m_stats; }
+
+    /**
+     * Bytes of keys and responses cached.
+     */
+    [[nodiscard]] std::size_t size() const { return m_size; }
+
+    void clear();
+
+private:
+    // The snapshot is shared with the replies still sending it, which may
+    // outlive the entry.
+    struct Entry {
+        std::shared_ptr<const Response::Snapshot> m_response;
+        std::size_t m_size;
+        EventLoop::Duration m_expires;
+        std::list<std::string>::iterator m_lru;
+    };
+
+    // Requests waiting for the fetch of a key.
+    struct Fetch {
+        std::vector<std::coroutine_handle<>> m_waiters;
+    };
+
+    struct FetchWaiter {
+        Fetch* m_fetch;
+
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { m_fetch->m_waiters.push_back(h); }
+        void await_resume() const noexcept { }
+    };
+
+    [[nodiscard]] bool cacheable(const Request& req) const;
+    [[nodiscard]] std::string key(const Request& req) const;
+
+    // The fresh entry for key, or nullptr.
+    const Entry* find(const std::string& key);
+    void insert(const std::string& key, Response::Snapshot response);
+    void erase(std::unordered_map<std::string, Entry>::iterator it);
+    void finish(const std::string& key);
+
+    Task<HandlerStatus> reply(const Request& req, Response& resp, std::shared_ptr<const Response::Snapshot> response);
+
+    EventLoop& m_eventLoop;
+    Router& m_router;
+    ResponseCacheOptions m_options;
+    Stats m_stats;
+
+    std::unordered_map<std::string, Entry> m_entries;
+    std::list<std::string> m_lru; // Most recently used first
+    std::size_t m_size { 0 };
+    std::unordered_map<std::string, Fetch> m_fetches;
+};
+} // namespace aifs::http
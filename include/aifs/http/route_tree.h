@@ -0,0 +1,49 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "aifs/http/request.h"
+#include "aifs/http/response.h"
+#include "aifs/http/router.h"
+#include "aifs/non_copyable.h"
+#include "aifs/task.h"
+
+namespace aifs::http {
+using HandlerFn = std::function<Task<HandlerStatus>(const Request&, Response&)>;
+
+/**
+ * Compressed radix tree of route patterns. A pattern is a path in which a
+ * segment starting with ':' matches any one non-empty segment, such as
+ * /users/:id/posts, and a final '*', optionally followed by a name,
+ * matches the rest of the path. Static text takes precedence over a
+ * parameter, and a parameter over a wildcard; lookup backtracks when a
+ * more specific branch leads nowhere.
+ */
+class RouteTree : private NonCopyable {
+public:
+    RouteTree();
+    ~RouteTree();
+
+    /**
+     * Route pattern to fn. Throws std::invalid_argument if the pattern is
+     * already routed, conflicts with the name of a parameter at the same
+     * position, or has more than RouteParams::max_params parameters.
+     */
+    void insert(std::string_view pattern, HandlerFn fn);
+
+    /**
+     * The handler for path, with its parameters added to params, or
+     * nullptr.
+     */
+    [[nodiscard]] const HandlerFn* find(std::string_view path, RouteParams& params) const;
+
+private:
+    struct Node;
+
+    std::unique_ptr<Node> m_root;
+};
+} // namespace aifs::http
@@ -6,7 +6,8 @@
 
 namespace aifs::http {
 /**
- * Generic router interface.
+ * Generic router interface. handle() may add the route parameters it
+ * matched to the request.
  */
 
 enum class HandlerStatus {
@@ -17,6 +18,6 @@ enum class HandlerStatus {
 class Router {
 public:
     virtual ~Router() = default;
-    virtual Task<HandlerStatus> handle(const Request&, Response&) = 0;
+    virtual Task<HandlerStatus> handle(Request&, Response&) = 0;
 };
 }
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include "aifs/http/express_router.h"
+#include "aifs/http/file_cache.h"
+#include "aifs/http/request.h"
+#include "aifs/http/response.h"
+#include "aifs/http/router.h"
+#include "aifs/non_copyable.h"
+#include "aifs/task.h"
+
+namespace aifs::http {
+/**
+ * Serves the files below a directory, with sendfile and single byte-range
+ * requests. Open files are kept in a FileCache. A directory is served by
+ * its index.html.
+ *
+ *     StaticFiles assets { "./public" };
+ *     assets.mount(router, "/static");
+ *
+ * The StaticFiles must outlive the routers it is mounted on.
+ */
+class StaticFiles : private NonCopyable {
+public:
+    explicit StaticFiles(std::filesystem::path root, std::size_t cacheCapacity = 1024)
+        : m_root { std::move(root) }
+        , m_cache { cacheCapacity }
+    {
+    }
+
+    /**
+     * Serve the files for every request below prefix on router.
+     */
+    void mount(ExpressRouter& router, std::string prefix);
+
+    /**
+     * Serve the file at path, relative to the root. Requests for files that
+     * do not exist, or for paths leaving the root, are not accepted.
+     */
+    Task<HandlerStatus> serve(std::string_view path, const Request& req, Response& resp);
+
+    [[nodiscard]] FileCache& cache() { return m_cache; }
+
+private:
+    std::filesystem::path m_root;
+    FileCache m_cache;
+};
+
+namespace detail {
+    struct ByteRange {
+        enum Kind { whole, partial, unsatisfiable };
+
+        Kind kind { whole };
+        std::size_t first { 0 };
+        std::size_t last { 0 }; // Inclusive
+    };
+
+    /**
+     * Interpret a Range header for a body of size bytes. Anything but a
+     * single range of bytes selects the whole body.
+     */
+    ByteRange parseRange(std::string_view header, std::size_t size);
+}
+} // namespace aifs::http
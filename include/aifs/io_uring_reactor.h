@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "reactor.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace aifs {
+/**
+ * io_uring backend. Receive, send and accept operations are submitted as
+ * SQEs and performed by the kernel; every other operation waits for
+ * readiness with a poll request. Submissions are batched and flushed with a
+ * single io_uring_enter() per loop iteration, which also waits for
+ * completions.
+ *
+ * Accepts use one multishot request per listening descriptor, with accepted
+ * connections queued until the next accept() asks for them.
+ *
+ * Requests refer to their descriptor through a registration owned by the
+ * reactor, which counts the requests still in flight. A descriptor that is
+ * deregistered with requests in flight has them canceled, and its
+ * registration is kept until their completions have been reaped, so that
+ * a late completion never touches the destroyed descriptor.
+ */
+class IoUringReactor final : public Reactor {
+public:
+    explicit IoUringReactor(unsigned entries = 256);
+    ~IoUringReactor() override;
+
+    /**
+     * Whether the running kernel provides everything this backend needs.
+     */
+    static bool supported();
+
+    void update(Descriptor*) override { }
+    void wait(Timeout timeout, std::vector<Event>& events) override;
+    bool submit(Descriptor* desc, OpType type, const IoRequest& io, Operation* op) override;
+    bool cancel(Descriptor* desc, OpType type, Operation* op) override;
+    void deregister(Descriptor* desc) override;
+
+private:
+    struct Registration {
+        Descriptor* desc; // nullptr once deregistered
+        unsigned inFlight { 0 }; // Requests whose completion is not reaped
+        // Operations pending when desc was deregistered, by OpType. Each is
+        // completed once the kernel reports its request done.
+        Operation* orphans[max_op] {};
+    };
+
+    struct AcceptQueue {
+        Descriptor* desc;
+        Operation* waiter { nullptr };
+        std::deque<int> backlog {};
+        bool armed { false };
+        bool closed { false };
+    };
+
+    void release();
+    io_uring_sqe* nextSqe();
+    void armAccept(AcceptQueue& queue);
+    Registration& registration(Descriptor* desc);
+    void cancelRequest(std::uint64_t userData, Registration* reg = nullptr);
+    void complete(const io_uring_cqe& cqe, std::vector<Event>& events);
+    void completeAccept(AcceptQueue& queue, const io_uring_cqe& cqe, std::vector<Event>& events);
+
+    int m_fd;
+    unsigned m_features;
+
+    void* m_sqRing;
+    std::size_t m_sqRingSize;
+    void* m_cqRing;
+    std::size_t m_cqRingSize;
+    io_uring_sqe* m_sqes;
+    std::size_t m_sqesSize;
+
+    unsigned* m_sqHead;
+    unsigned* m_sqTail;
+    unsigned m_sqMask;
+    unsigned m_sqEntries;
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    unsigned m_cqMask;
+    io_uring_cqe* m_cqes;
+
+    unsigned m_toSubmit;
+    bool m_multishotAccept;
+    std::vector<Event> m_immediate;
+    std::unordered_map<Descriptor*, std::unique_ptr<AcceptQueue>> m_acceptQueues;
+    std::vector<std::unique_ptr<AcceptQueue>> m_closedQueues;
+    std::unordered_map<Registration*, std::unique_ptr<Registration>> m_registrations;
+};
+} // namespace aifs
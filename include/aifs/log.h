@@ -1,14 +1,23 @@
 #pragma once
 
-#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 
 #include <memory>
+#include <string>
 
 namespace aifs {
 using Logger = std::shared_ptr<spdlog::logger>;
-Logger makeLogger(const std::string& name)
+
+/**
+ * A logger writing to the sinks of the default logger, at its level. It
+ * is not registered with spdlog, so any number of loggers may have the
+ * same name, such as those of connections from the same port.
+ */
+inline Logger makeLogger(const std::string& name)
 {
-    return spdlog::stdout_color_mt(name);
+    const auto& sinks = spdlog::default_logger_raw()->sinks();
+    auto logger = std::make_shared<spdlog::logger>(name, sinks.begin(), sinks.end());
+    logger->set_level(spdlog::get_level());
+    return logger;
 }
 } // namespace aifs
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <latch>
+#include <optional>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "event_loop.h"
+#include "non_copyable.h"
+#include "tcp_acceptor.h"
+#include "tcp_socket.h"
+
+namespace aifs {
+/**
+ * Acceptor for connections accepted on another thread and handed over with
+ * deliver(). Everything but deliver() must be called on the acceptor's loop.
+ */
+class HandoffAcceptor : public Acceptor<TCPSocket> {
+private:
+    struct AcceptOp;
+
+public:
+    explicit HandoffAcceptor(EventLoop& ctx)
+        : m_eventLoop { ctx }
+    {
+    }
+
+    ~HandoffAcceptor() override
+    {
+        for (auto& [fd, addr] : m_backlog) {
+            ::close(fd);
+        }
+    }
+
+    /**
+     * Queue the connection fd for the next accept(). May be called from any
+     * thread.
+     */
+    void deliver(int fd, const sockaddr_storage& addr)
+    {
+        m_eventLoop.post([this, fd, addr] {
+            m_backlog.emplace_back(fd, addr);
+            if (m_waiter) {
+                std::exchange(m_waiter, nullptr)->complete({});
+            }
+        });
+    }
+
+    /**
+     * Fail the pending and all future accepts. May be called from any thread.
+     */
+    void shutdown()
+    {
+        m_eventLoop.post([this] {
+            m_closed = true;
+            cancel();
+        });
+    }
+
+    void cancel() override
+    {
+        if (auto* waiter = std::exchange(m_waiter, nullptr)) {
+            m_eventLoop.post([waiter] { waiter->complete(std::make_error_code(std::errc::operation_canceled)); });
+        }
+    }
+
+    [[nodiscard]] AcceptOp accept() { return AcceptOp { this }; }
+
+protected:
+    Awaitable<SocketPtr> doAccept() override { return Awaitable<SocketPtr> { accept() }; }
+
+private:
+    struct AcceptOp {
+        explicit AcceptOp(HandoffAcceptor* acceptor)
+            : m_acceptor { acceptor }
+        {
+        }
+
+        [[nodiscard]] bool await_ready() const noexcept
+        {
+            return !m_acceptor->m_closed && !m_acceptor->m_backlog.empty();
+        }
+
+        SocketPtr await_resume()
+        {
+            if (m_ec) {
+                throw std::system_error(m_ec);
+            }
+            auto [fd, addr] = m_acceptor->m_backlog.front();
+            m_acceptor->m_backlog.pop_front();
+            return std::make_unique<TCPSocket>(m_acceptor->m_eventLoop, fd, addr);
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            m_handle = h;
+            if (m_acceptor->m_closed) {
+                m_acceptor->m_eventLoop.post([this] { complete(std::make_error_code(std::errc::operation_canceled)); });
+            } else {
+                m_acceptor->m_waiter = this;
+            }
+        }
+
+        void complete(const std::error_code& ec)
+        {
+            m_ec = ec;
+            m_handle.resume();
+        }
+
+        HandoffAcceptor* m_acceptor;
+        std::error_code m_ec;
+        std::coroutine_handle<> m_handle;
+    };
+
+    EventLoop& m_eventLoop;
+    std::deque<std::pair<int, sockaddr_storage>> m_backlog;
+    AcceptOp* m_waiter { nullptr };
+    bool m_closed { false };
+};
+
+enum class AcceptMode {
+    // Every loop has its own SO_REUSEPORT acceptor on the port.
+    reuse_port,
+    // The first loop accepts all connections and hands them out round-robin.
+    round_robin
+};
+
+struct LoopGroupOptions {
+    std::size_t threads { 0 }; // 0 means one per CPU the process may run on
+    bool pinThreads { true };
+    Backend backend { Backend::epoll };
+    AcceptMode acceptMode { AcceptMode::reuse_port };
+};
+
+/**
+ * A group of EventLoops, each running on its own thread and optionally
+ * pinned to its own core. Nothing is shared between the loops: whatever a
+ * loop needs (routers, servers, ...) is created on that loop's thread.
+ */
+class LoopGroup : private NonCopyable {
+public:
+    using MainFn = std::function<Task<>(EventLoop&, std::size_t)>;
+    using ServeFn = std::function<Task<>(EventLoop&, Acceptor<TCPSocket>&)>;
+
+public:
+    explicit LoopGroup(LoopGroupOptions options = {})
+        : m_options { options }
+        , m_cpus { allowedCpus() }
+    {
+        if (m_options.threads == 0) {
+            m_options.threads = m_cpus.empty() ? std::max(1u, std::thread::hardware_concurrency()) : m_cpus.size();
+        }
+    }
+
+    [[nodiscard]] std::size_t size() const { return m_options.threads; }
+
+    /**
+     * Spawn main(loop, index) on every loop and run the loops until they all
+     * run out of work.
+     */
+    void run(MainFn main)
+    {
+        start([&](EventLoop& loop, std::size_t index) {
+            loop.spawn(main(loop, index));
+            loop.run();
+        });
+    }
+
+    /**
+     * Accept connections on port and spawn serve(loop, acceptor) on every
+     * loop with an acceptor that yields that loop's share of the
+     * connections. Blocks until all loops run out of work.
+     */
+    void listen(int port, ServeFn serve, ListenOptions listenOptions = {})
+    {
+        if (m_options.acceptMode == AcceptMode::reuse_port) {
+            listenOptions.reusePort = true;
+            start([&](EventLoop& loop, std::size_t) {
+                TCPAcceptor acceptor { loop, port, listenOptions };
+                loop.spawn(serve(loop, acceptor));
+                loop.run();
+            });
+            return;
+        }
+
+        // The first loop hands connections to the others' acceptors, so
+        // every loop must have its acceptor before the first loop starts,
+        // and keep it until the first loop is done.
+        std::vector<HandoffAcceptor*> handoffs(size());
+        std::latch ready { static_cast<std::ptrdiff_t>(size()) };
+        std::latch done { static_cast<std::ptrdiff_t>(size()) };
+        start([&](EventLoop& loop, std::size_t index) {
+            HandoffAcceptor handoff { loop };
+            handoffs[index] = &handoff;
+            ready.arrive_and_wait();
+            struct Done {
+                std::latch& latch;
+                ~Done() { latch.arrive_and_wait(); }
+            } guard { done };
+
+            std::optional<TCPAcceptor> acceptor;
+            if (index == 0) {
+                try {
+                    acceptor.emplace(loop, port, listenOptions);
+                } catch (...) {
+                    // Nothing will be handed out, so let the other loops finish.
+                    for (auto* other : handoffs) {
+                        other->shutdown();
+                    }
+                    throw;
+                }
+                loop.spawn(dispatch(*acceptor, handoffs));
+            }
+            loop.spawn(serveAndClose(serve, loop, handoff, acceptor ? &*acceptor : nullptr));
+            loop.run();
+        });
+    }
+
+private:
+    void start(const std::function<void(EventLoop&, std::size_t)>& body)
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(size());
+        for (std::size_t i = 0; i < size(); ++i) {
+            threads.emplace_back([this, &body, i] {
+                if (m_options.pinThreads) {
+                    pin(i);
+                }
+                try {
+                    EventLoop loop { m_options.backend };
+                    body(loop, i);
+                } catch (const std::exception& e) {
+                    spdlog::error("Loop {} failed: {}", i, e.what());
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // The CPUs the process may run on, which under taskset or a cpuset
+    // need not be the first ones of the machine. Empty if unknown.
+    static std::vector<int> allowedCpus()
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        std::vector<int> cpus;
+        if (::sched_getaffinity(0, sizeof(set), &set) < 0) {
+            spdlog::warn("Could not get CPU affinity: {}", std::strerror(errno));
+            return cpus;
+        }
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    void pin(std::size_t index) const
+    {
+        if (m_cpus.empty()) {
+            return;
+        }
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(m_cpus[index % m_cpus.size()], &cpus);
+        if (int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(cpus), &cpus)) {
+            spdlog::warn("Could not pin loop {}: {}", index, std::strerror(err));
+        }
+    }
+
+    static Task<> serveAndClose(ServeFn& serve, EventLoop& loop, Acceptor<TCPSocket>& handoff, TCPAcceptor* acceptor)
+    {
+        co_await serve(loop, handoff);
+        // Stop dispatching once the accepting loop no longer serves.
+        if (acceptor) {
+            acceptor->cancel();
+        }
+    }
+
+    static Task<> dispatch(TCPAcceptor& acceptor, std::vector<HandoffAcceptor*> handoffs)
+    {
+        try {
+            for (std::size_t next = 0;;) {
+                for (auto& socket : co_await acceptor.acceptBatch()) {
+                    // The receiving loop takes over the descriptor.
+                    handoffs[next]->deliver(socket->release(), socket->remote_endpoint());
+                    next = (next + 1) % handoffs.size();
+                }
+            }
+        } catch (const std::system_error& e) {
+            if (e.code() != std::errc::operation_canceled) {
+                spdlog::error("Got system error: {}", e.what());
+            }
+        }
+    }
+
+    LoopGroupOptions m_options;
+    std::vector<int> m_cpus;
+};
+} // namespace aifs
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+
+#include "non_copyable.h"
+
+namespace aifs {
+/**
+ * Intrusive, unbounded, lock-free multi-producer single-consumer queue.
+ *
+ * Node must be default constructible and have a std::atomic<Node*> m_next
+ * member. push() is wait-free and may be called from any thread; pop() and
+ * empty() must only be called by the consumer. A node that is still being
+ * linked in by a producer makes pop() return nullptr until the producer is
+ * done, while empty() already reports it.
+ */
+template <typename Node>
+class MpscQueue : private NonCopyable {
+public:
+    MpscQueue()
+        : m_head { &m_stub }
+        , m_tail { &m_stub }
+    {
+    }
+
+    void push(Node* node)
+    {
+        node->m_next.store(nullptr, std::memory_order_relaxed);
+        auto* prev = m_head.exchange(node);
+        prev->m_next.store(node, std::memory_order_release);
+    }
+
+    Node* pop()
+    {
+        auto* tail = m_tail;
+        auto* next = tail->m_next.load(std::memory_order_acquire);
+        if (tail == &m_stub) {
+            if (!next) {
+                return nullptr;
+            }
+            m_tail = tail = next;
+            next = next->m_next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+        if (tail != m_head.load()) {
+            return nullptr;
+        }
+        // tail is the last node: put the stub behind it so that it can be
+        // handed out without leaving the queue without a tail.
+        push(&m_stub);
+        next = tail->m_next.load(std::memory_order_acquire);
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return m_tail == &m_stub && m_head.load() == &m_stub;
+    }
+
+private:
+    std::atomic<Node*> m_head;
+    Node* m_tail;
+    Node m_stub;
+};
+} // namespace aifs
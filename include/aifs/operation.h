@@ -1,10 +1,54 @@
 #pragma once
 
+#include <sys/types.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <optional>
 #include <system_error>
 
 namespace aifs {
+/**
+ * Describes the I/O an Operation carries out once its descriptor is ready,
+ * so that completion-based backends can perform it on the operation's behalf.
+ * A poll request only waits for readiness. For the _msg kinds data points to
+ * a msghdr.
+ */
+struct IoRequest {
+    enum Kind { poll,
+        receive,
+        send,
+        receive_msg,
+        send_msg,
+        accept };
+
+    Kind kind { poll };
+    void* data { nullptr };
+    std::size_t size { 0 };
+};
+
 struct Operation {
     virtual void perform(const std::error_code&) { }
+
+    /**
+     * Result of the I/O if a completion-based backend already carried it
+     * out, otherwise the result of calling fn now. Either way errors follow
+     * the syscall convention of returning -1 and setting errno.
+     */
+    template <typename Fn>
+    ssize_t io(Fn&& fn)
+    {
+        if (!completion) {
+            return fn();
+        }
+        if (*completion < 0) {
+            errno = static_cast<int>(-*completion);
+            return -1;
+        }
+        return *completion;
+    }
+
     std::error_code ec {};
+    std::optional<ssize_t> completion {};
 };
 } // namespace aifs
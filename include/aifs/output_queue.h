@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "event_loop.h"
+#include "non_copyable.h"
+#include "task.h"
+#include "tcp_socket.h"
+
+namespace aifs {
+/**
+ * Output buffer of a connection. Data written to the queue is kept until
+ * flush(), which sends everything queued so far with as few sendv() calls
+ * as the socket allows, so that several small writes, such as pipelined
+ * responses, cost one syscall together.
+ *
+ * write() only suspends once more than highWaterMark bytes are queued, and
+ * then waits until the socket has taken all of it, so that a slow client
+ * holds back its producers instead of piling up memory. If sending fails,
+ * the queued data is dropped and every later write() and flush() throws
+ * the same error.
+ */
+class OutputQueue : private NonCopyable {
+public:
+    static constexpr std::size_t default_high_water_mark = 64 * 1024;
+
+    OutputQueue(EventLoop& loop, StreamSocket& socket, std::size_t highWaterMark = default_high_water_mark)
+        : m_eventLoop { loop }
+        , m_socket { socket }
+        , m_highWaterMark { highWaterMark }
+    {
+    }
+
+    [[nodiscard]] StreamSocket& socket() { return m_socket; }
+
+    /**
+     * Bytes queued but not sent yet.
+     */
+    [[nodiscard]] std::size_t queued() const { return m_queued; }
+
+    /**
+     * An empty string to build the next chunk in. It reuses the memory of
+     * a chunk already sent where possible, so that writing small chunks
+     * such as header blocks does not allocate once the connection is warm.
+     */
+    [[nodiscard]] std::string buffer()
+    {
+        auto buffer = std::move(m_spare);
+        m_spare = {};
+        buffer.clear();
+        return buffer;
+    }
+
+    /**
+     * Queue data without sending it.
+     */
+    void push(std::string data)
+    {
+        if (!data.empty()) {
+            m_queued += data.size();
+            if (m_free.empty()) {
+                m_chunks.push_back(std::move(data));
+            } else {
+                m_chunks.splice(m_chunks.end(), m_free, m_free.begin());
+                m_chunks.back() = std::move(data);
+            }
+        }
+    }
+
+    Task<> write(std::string data)
+    {
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+        push(std::move(data));
+        if (m_queued > m_highWaterMark) {
+            co_await flush();
+        }
+    }
+
+    /**
+     * Send everything queued. Only one flush sends at a time; the others
+     * wait for it and then send what was queued in the meantime.
+     */
+    Task<> flush()
+    {
+        while (m_flushing) {
+            co_await FlushWaiter { this };
+        }
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+
+        m_flushing = true;
+        try {
+            while (!m_chunks.empty()) {
+                iovec buffers[max_buffers];
+                std::size_t count = 0;
+                std::size_t offset = m_offset;
+                for (auto it = m_chunks.begin(); it != m_chunks.end() && count < max_buffers; ++it) {
+                    buffers[count++] = { it->data() + offset, it->size() - offset };
+                    offset = 0;
+                }
+                consume(static_cast<std::size_t>(co_await m_socket.sendv({ buffers, count })));
+            }
+        } catch (...) {
+            m_error = std::current_exception();
+            m_chunks.clear();
+            m_offset = 0;
+            m_queued = 0;
+        }
+        m_flushing = false;
+        for (auto h : std::exchange(m_waiters, {})) {
+            m_eventLoop.post([h] { h.resume(); });
+        }
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+private:
+    static constexpr std::size_t max_buffers = 64;
+
+    // Largest chunk whose memory is kept for buffer(); bigger ones, mostly
+    // bodies, are freed.
+    static constexpr std::size_t max_spare = 4096;
+
+    struct FlushWaiter {
+        OutputQueue* m_queue;
+
+        [[nodiscard]] bool await_ready() const noexcept { return !m_queue->m_flushing; }
+        void await_suspend(std::coroutine_handle<> h) { m_queue->m_waiters.push_back(h); }
+        void await_resume() const noexcept { }
+    };
+
+    void consume(std::size_t n)
+    {
+        m_queued -= n;
+        while (n > 0) {
+            auto left = m_chunks.front().size() - m_offset;
+            if (n < left) {
+                m_offset += n;
+                return;
+            }
+            n -= left;
+            recycle(std::move(m_chunks.front()));
+            m_free.splice(m_free.end(), m_chunks, m_chunks.begin());
+            m_offset = 0;
+        }
+    }
+
+    void recycle(std::string chunk)
+    {
+        if (chunk.capacity() <= max_spare && chunk.capacity() > m_spare.capacity()) {
+            m_spare = std::move(chunk);
+        }
+    }
+
+    EventLoop& m_eventLoop;
+    StreamSocket& m_socket;
+    std::size_t m_highWaterMark;
+
+    // Chunks stay where they are while a sendv() refers to them, and the
+    // nodes of sent ones are kept in m_free for the next.
+    std::list<std::string> m_chunks;
+    std::list<std::string> m_free;
+    std::size_t m_offset { 0 }; // Bytes of the first chunk already sent
+    std::size_t m_queued { 0 };
+    std::string m_spare;
+
+    bool m_flushing { false };
+    std::vector<std::coroutine_handle<>> m_waiters;
+    std::exception_ptr m_error;
+};
+} // namespace aifs
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "operation.h"
+
+namespace aifs {
+/**
+ * An Operation that can be handed to an EventLoop or executor from any
+ * thread.
+ */
+struct PostedOperation : Operation {
+    std::atomic<PostedOperation*> m_next { nullptr };
+};
+
+/**
+ * Calls fn once performed and frees itself. A callback that is dropped,
+ * i.e. performed with an error, is freed without calling fn.
+ */
+template <typename Fn>
+struct PostedCallback : PostedOperation {
+    explicit PostedCallback(Fn&& fn)
+        : m_fn { std::forward<Fn>(fn) }
+    {
+    }
+
+    void perform(const std::error_code& ec) override
+    {
+        std::unique_ptr<PostedCallback> self { this };
+        if (!ec) {
+            m_fn();
+        }
+    }
+
+    std::decay_t<Fn> m_fn;
+};
+
+/**
+ * Awaitable that resumes the awaiting coroutine wherever Target performs
+ * its posted operations.
+ */
+template <typename Target>
+struct ScheduleOp : PostedOperation {
+    explicit ScheduleOp(Target* target)
+        : m_target { target }
+    {
+    }
+
+    [[nodiscard]] constexpr bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        m_waiter = h;
+        m_target->enqueue(this);
+    }
+
+    constexpr void await_resume() const noexcept { }
+
+    void perform(const std::error_code& ec) override
+    {
+        if (!ec) {
+            m_waiter.resume();
+        }
+    }
+
+    Target* m_target;
+    std::coroutine_handle<> m_waiter;
+};
+} // namespace aifs
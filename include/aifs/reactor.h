@@ -0,0 +1,114 @@
+#pragma once
+
+#include <sys/epoll.h>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+#include "descriptor.h"
+#include "non_copyable.h"
+#include "operation.h"
+
+namespace aifs {
+enum class Backend { select,
+    epoll,
+    io_uring };
+
+/**
+ * Readiness notification backend used by the EventLoop.
+ *
+ * The loop keeps Descriptor::m_interest up to date and calls update() after
+ * every change. wait() blocks until at least one descriptor is ready or the
+ * timeout expires, and reports readiness as a bitmask of OpTypes limited to
+ * what the descriptor is currently interested in.
+ *
+ * Completion-based backends instead accept operations through submit() and
+ * report a finished operation as a ready event for its descriptor and
+ * OpType, with Operation::completion already filled in.
+ */
+class Reactor : private NonCopyable {
+public:
+    using Timeout = std::optional<std::chrono::microseconds>;
+
+    struct Event {
+        Descriptor* desc;
+        unsigned ready;
+        // Instead of desc, an operation to complete whose descriptor was
+        // deregistered while the backend still performed it.
+        Operation* orphan { nullptr };
+    };
+
+public:
+    virtual ~Reactor() = default;
+    virtual void update(Descriptor* desc) = 0;
+    virtual void wait(Timeout timeout, std::vector<Event>& events) = 0;
+
+    /**
+     * Hand an operation to the backend. Returns false if the backend only
+     * reports readiness, in which case the loop tracks the operation itself.
+     */
+    virtual bool submit(Descriptor*, OpType, const IoRequest&, Operation*) { return false; }
+
+    /**
+     * Cancel a submitted operation. Returns false if the operation was not
+     * submitted to this backend. The canceled operation is still reported by
+     * a later wait().
+     */
+    virtual bool cancel(Descriptor*, OpType, Operation*) { return false; }
+
+    /**
+     * Drop everything the backend knows about a descriptor that is about to
+     * be closed.
+     */
+    virtual void deregister(Descriptor* desc) = 0;
+};
+
+/**
+ * Portable select() backend. Rebuilds the fd_sets on every wait and is
+ * limited to descriptors below FD_SETSIZE.
+ */
+class SelectReactor final : public Reactor {
+public:
+    void update(Descriptor* desc) override;
+    void wait(Timeout timeout, std::vector<Event>& events) override;
+    void deregister(Descriptor* desc) override;
+
+private:
+    std::unordered_set<Descriptor*> m_descriptors;
+};
+
+/**
+ * epoll backend. Descriptors are registered once, on the first operation
+ * waiting on them, and the registration is widened on demand. Interest that
+ * is no longer needed is dropped lazily, when the kernel reports an event
+ * nobody waits for, so a connection that keeps reading never touches
+ * epoll_ctl after the first read.
+ */
+class EpollReactor final : public Reactor {
+public:
+    EpollReactor();
+    ~EpollReactor() override;
+
+    void update(Descriptor* desc) override;
+    void wait(Timeout timeout, std::vector<Event>& events) override;
+    void deregister(Descriptor* desc) override;
+
+private:
+    void control(Descriptor* desc, unsigned armed);
+
+    static constexpr int max_events = 256;
+
+    int m_epfd;
+    bool m_pwait2;
+    epoll_event m_events[max_events];
+};
+
+/**
+ * Create the backend for an EventLoop. Backend::io_uring falls back to epoll
+ * when the running kernel does not support it.
+ */
+std::unique_ptr<Reactor> makeReactor(Backend backend);
+} // namespace aifs
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+namespace aifs {
+/**
+ * Fill addr with an IPv4 or IPv6 address literal and port, and return the
+ * length of the address. Throws std::system_error if address is neither.
+ */
+inline socklen_t makeSocketAddress(const std::string& address, int port, sockaddr_storage& addr)
+{
+    addr = {};
+    if (auto* in = reinterpret_cast<sockaddr_in*>(&addr); ::inet_pton(AF_INET, address.c_str(), &in->sin_addr) == 1) {
+        in->sin_family = AF_INET;
+        in->sin_port = htons(port);
+        return sizeof(sockaddr_in);
+    }
+    if (auto* in6 = reinterpret_cast<sockaddr_in6*>(&addr); ::inet_pton(AF_INET6, address.c_str(), &in6->sin6_addr) == 1) {
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        return sizeof(sockaddr_in6);
+    }
+    throw std::system_error(std::make_error_code(std::errc::invalid_argument), "Invalid address " + address);
+}
+
+/**
+ * Length of the address stored in addr, according to its family.
+ */
+inline socklen_t socketAddressLength(const sockaddr_storage& addr)
+{
+    return addr.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+}
+/**
+ * Fill addr with the Unix domain socket path, and return the length of the
+ * address. A path starting with '@' names a socket in the abstract
+ * namespace, which does not exist in the file system. Throws
+ * std::system_error if the path is too long.
+ */
+inline socklen_t makeUnixAddress(const std::string& path, sockaddr_un& addr)
+{
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "Invalid socket path " + path);
+    }
+    std::memcpy(addr.sun_path, path.data(), path.size());
+    if (path.front() == '@') {
+        // Abstract names are not terminated; every byte of the length counts.
+        addr.sun_path[0] = '\0';
+        return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size());
+    }
+    return sizeof(addr);
+}
+} // namespace aifs
@@ -8,7 +8,10 @@ namespace aifs {
 class Timer {
 public:
     virtual ~Timer() = default;
-    [[nodiscard]] virtual Awaitable<> wait() = 0;
+    [[nodiscard]] Awaitable<> wait() { return doWait(); }
+
+protected:
+    virtual Awaitable<> doWait() = 0;
 };
 
 class SteadyTimer : public Timer {
@@ -16,18 +19,41 @@ private:
     struct TimerOp;
 
 public:
-    SteadyTimer(EventLoop& ctx, std::chrono::milliseconds when)
+    using Duration = EventLoop::Duration;
+
+public:
+    SteadyTimer(EventLoop& ctx, Duration when)
         : m_eventLoop { ctx }
-        , m_when { std::move(when) }
+        , m_when { when }
     {
     }
 
-    [[nodiscard]] Awaitable<> wait()
+    ~SteadyTimer() override { m_eventLoop.removeTimer(m_entry); }
+
+    [[nodiscard]] TimerOp wait() { return TimerOp { this }; }
+
+    TimerOp operator co_await() noexcept { return wait(); }
+
+    /**
+     * Change how long the next wait() lasts. A wait that is already pending
+     * is re-armed to expire when from now.
+     */
+    void expiresAfter(Duration when)
     {
-        return Awaitable<> { TimerOp { this } };
+        m_when = when;
+        if (m_entry.linked()) {
+            m_eventLoop.callLater(m_when, m_entry);
+        }
     }
 
-    auto operator co_await() noexcept { return wait(); }
+    /**
+     * Complete a pending wait with operation_canceled. Returns false if no
+     * wait was pending.
+     */
+    bool cancel() { return m_eventLoop.cancelTimer(m_entry); }
+
+protected:
+    Awaitable<> doWait() override { return Awaitable<> { wait() }; }
 
 private:
     struct TimerOp : Operation {
@@ -37,12 +63,20 @@ private:
         {
         }
 
-        void await_resume() const noexcept { }
+        [[nodiscard]] constexpr bool await_ready() const noexcept { return false; }
+
+        void await_resume() const
+        {
+            if (ec) {
+                throw std::system_error(ec);
+            }
+        }
 
         void await_suspend(std::coroutine_handle<> h) noexcept
         {
             m_continuation = h;
-            m_self->m_eventLoop.callLater(m_self->m_when, this);
+            m_self->m_entry.m_op = this;
+            m_self->m_eventLoop.callLater(m_self->m_when, m_self->m_entry);
         }
 
         void perform(const std::error_code&)
@@ -58,6 +92,7 @@ private:
 
 private:
     EventLoop& m_eventLoop;
-    std::chrono::milliseconds m_when;
+    Duration m_when;
+    TimerEntry m_entry;
 };
 } // namespace aifs
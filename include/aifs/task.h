@@ -1,11 +1,13 @@
 #pragma once
 
+#include <atomic>
 #include <coroutine>
 #include <utility>
 #include <variant>
 #include <exception>
 #include <stdexcept>
 
+#include "frame_pool.h"
 #include "non_copyable.h"
 
 namespace aifs {
@@ -17,13 +19,18 @@ struct Result {
         m_result.template emplace<T>(std::forward<R>(value));
     }
 
+    void unhandled_exception() noexcept { m_result = std::current_exception(); }
+
+    /**
+     * The value the coroutine returned, moved out, or the exception it threw.
+     */
     constexpr T result()
     {
         if (auto exception = std::get_if<std::exception_ptr>(&m_result)) {
             std::rethrow_exception(*exception);
         }
         if (auto res = std::get_if<T>(&m_result)) {
-            return *res;
+            return std::move(*res);
         }
         throw std::runtime_error("no result error");
     }
@@ -34,7 +41,17 @@ struct Result {
 template <>
 struct Result<void> {
     void return_void() noexcept { }
-    void result() { }
+
+    void unhandled_exception() noexcept { m_exception = std::current_exception(); }
+
+    void result()
+    {
+        if (m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+    std::exception_ptr m_exception;
 };
 
 template <typename ReturnType = void>
@@ -77,10 +94,18 @@ struct Task : private NonCopyable {
             return true;
         }
 
-        auto await_suspend(std::coroutine_handle<> h) const noexcept
+        // Start the task here, and only suspend if it does not complete
+        // right away. Whichever of this and the task's final suspension
+        // comes second goes on with the awaiting coroutine. Unlike handing
+        // over to the task, this keeps a loop of tasks that complete at
+        // once from growing the stack where the compiler does not turn the
+        // transfer into a tail call, as GCC does not without optimization.
+        bool await_suspend(std::coroutine_handle<> h) const noexcept
         {
-            m_self.promise().m_continuation = h;
-            return m_self;
+            auto& promise = m_self.promise();
+            m_self.resume();
+            promise.m_continuation = h;
+            return !promise.m_ready.exchange(true, std::memory_order_acq_rel);
         }
 
         CoroHandle m_self;
@@ -97,7 +122,7 @@ struct Task : private NonCopyable {
         return Awaiter { m_handle };
     }
 
-    struct Promise : Result<ReturnType> {
+    struct Promise : Result<ReturnType>, PooledFrame {
         Task get_return_object()
         {
             return Task { CoroHandle::from_promise(*this) };
@@ -105,26 +130,33 @@ struct Task : private NonCopyable {
 
         auto initial_suspend() noexcept { return std::suspend_always {}; }
 
+        // Transfer to the awaiting coroutine instead of resuming it from
+        // here, unless it has not suspended yet, in which case it goes on
+        // by itself (see AwaitableBase).
         struct FinalAwaiter {
             constexpr bool await_ready() const noexcept { return false; }
             template <typename Promise>
-            constexpr void await_suspend(
+            std::coroutine_handle<> await_suspend(
                 std::coroutine_handle<Promise> h) const noexcept
             {
-                if (auto cont = h.promise().m_continuation) {
-                    cont.resume();
+                auto& promise = h.promise();
+                if (promise.m_ready.exchange(true, std::memory_order_acq_rel) && promise.m_continuation) {
+                    return promise.m_continuation;
                 }
+                return std::noop_coroutine();
             }
             constexpr void await_resume() const noexcept { }
         };
 
         auto final_suspend() noexcept { return FinalAwaiter {}; }
 
-        void unhandled_exception() { }
-
         void perform() { CoroHandle::from_promise(*this).resume(); }
 
         std::coroutine_handle<> m_continuation;
+
+        // Set by the first of the awaiting coroutine suspending and this
+        // task completing.
+        std::atomic<bool> m_ready { false };
     };
 
 public:
@@ -1,17 +1,25 @@
 #pragma once
 
 #include <arpa/inet.h>
-#include <fcntl.h>
 #include <fmt/core.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 
+#include <algorithm>
 #include <coroutine>
+#include <cstddef>
+#include <iterator>
+#include <string>
 #include <system_error>
+#include <type_traits>
+#include <vector>
 
 #include "awaitable.h"
 #include "descriptor.h"
 #include "event_loop.h"
 #include "operation.h"
+#include "socket_address.h"
 #include "tcp_socket.h"
 
 namespace aifs {
@@ -23,53 +31,95 @@ public:
 public:
     virtual ~Acceptor() = default;
     virtual void cancel() = 0;
-    virtual Awaitable<SocketPtr> accept() = 0;
+    [[nodiscard]] Awaitable<SocketPtr> accept() { return doAccept(); }
+
+protected:
+    virtual Awaitable<SocketPtr> doAccept() = 0;
+};
+
+/**
+ * How a TCPAcceptor listens. The defaults listen on all IPv4 addresses.
+ */
+struct ListenOptions {
+    // IPv4 or IPv6 address to bind. "::" accepts IPv6 and, unless v6Only is
+    // set, IPv4 connections as well.
+    std::string address { "0.0.0.0" };
+    bool v6Only { false };
+    int backlog { SOMAXCONN };
+
+    // Let several acceptors (typically one per EventLoop) bind the same
+    // port; the kernel spreads incoming connections between them.
+    bool reusePort { false };
+
+    // Only wake up the acceptor once a connection has sent data, or after
+    // this many seconds (TCP_DEFER_ACCEPT). 0 disables it.
+    int deferAcceptSeconds { 0 };
+
+    // Length of the TCP Fast Open queue. 0 disables TCP_FASTOPEN.
+    int fastOpenQueue { 0 };
+
+    // Set TCP_NODELAY on accepted sockets.
+    bool noDelay { false };
+
+    // Connections taken from the backlog per readiness notification.
+    std::size_t acceptBatch { 16 };
 };
 
 class TCPAcceptor : public Acceptor<TCPSocket> {
 private:
-    struct AcceptOp;
+    template <bool Batch>
+    struct BasicAcceptOp;
+    using AcceptOp = BasicAcceptOp<false>;
+    using AcceptBatchOp = BasicAcceptOp<true>;
 
 public:
-    TCPAcceptor(EventLoop& ctx, int port)
+    TCPAcceptor(EventLoop& ctx, int port, ListenOptions options = {})
         : m_eventLoop { ctx }
         , m_desc { -1 }
+        , m_options { std::move(options) }
     {
-        m_desc.m_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_storage addr;
+        auto len = makeSocketAddress(m_options.address, port, addr);
+
+        m_desc.m_fd = ::socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
         if (m_desc.m_fd < 0) {
             throw std::system_error(errno, std::generic_category(), "socket");
         }
 
-        int ret = ::fcntl(m_desc.m_fd, F_SETFL, O_NONBLOCK);
-        if (ret < 0) {
-            throw std::system_error(errno, std::generic_category(), "fcntl");
-        }
-
-        int val = 1;
-        ret = ::setsockopt(m_desc.m_fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
-        if (ret < 0) {
-            throw std::system_error(errno, std::generic_category(),
-                "setsockopt");
-        }
-
-        sockaddr_in addr {};
-        addr.sin_family = AF_INET;
-        addr.sin_addr.s_addr = INADDR_ANY;
-        addr.sin_port = htons(port);
-        ret = ::bind(m_desc.m_fd, (sockaddr*)&addr, sizeof(addr));
-        if (ret < 0) {
-            throw std::system_error(errno, std::generic_category(), "bind");
-        }
+        try {
+            setOption(SOL_SOCKET, SO_REUSEADDR, 1);
+            if (m_options.reusePort) {
+                setOption(SOL_SOCKET, SO_REUSEPORT, 1);
+            }
+            if (addr.ss_family == AF_INET6) {
+                setOption(IPPROTO_IPV6, IPV6_V6ONLY, m_options.v6Only);
+            }
+            if (m_options.deferAcceptSeconds > 0) {
+                setOption(IPPROTO_TCP, TCP_DEFER_ACCEPT, m_options.deferAcceptSeconds);
+            }
+            if (m_options.fastOpenQueue > 0) {
+                setOption(IPPROTO_TCP, TCP_FASTOPEN, m_options.fastOpenQueue);
+            }
 
-        ret = ::listen(m_desc.m_fd, SOMAXCONN);
-        if (ret < 0) {
-            throw std::system_error(errno, std::generic_category(), "listen");
+            if (::bind(m_desc.m_fd, reinterpret_cast<sockaddr*>(&addr), len) < 0) {
+                throw std::system_error(errno, std::generic_category(), "bind");
+            }
+            if (::listen(m_desc.m_fd, m_options.backlog) < 0) {
+                throw std::system_error(errno, std::generic_category(), "listen");
+            }
+        } catch (...) {
+            ::close(m_desc.m_fd);
+            throw;
         }
     }
 
     ~TCPAcceptor() override
     {
+        for (auto i = m_next; i < m_pending.size(); ++i) {
+            m_pending[i]->close();
+        }
         if (m_desc.m_fd != -1) {
+            m_eventLoop.deregister(&m_desc);
             ::close(m_desc.m_fd);
         }
     }
@@ -79,66 +129,157 @@ public:
         m_eventLoop.cancelOperation(&m_desc, EventLoop::OpType::read_op);
     }
 
-    [[nodiscard]] Awaitable<SocketPtr> accept() override
+    [[nodiscard]] AcceptOp accept()
+    {
+        if (m_desc.m_fd == -1) {
+            throw std::runtime_error("Not ready to accept");
+        }
+        return AcceptOp { this };
+    }
+
+    /**
+     * Accept every connection that is ready, at least one, as a
+     * std::vector<SocketPtr>.
+     */
+    [[nodiscard]] AcceptBatchOp acceptBatch()
     {
         if (m_desc.m_fd == -1) {
             throw std::runtime_error("Not ready to accept");
         }
-        return Awaitable<SocketPtr> { AcceptOp { this } };
+        return AcceptBatchOp { this };
     }
 
+protected:
+    Awaitable<SocketPtr> doAccept() override { return Awaitable<SocketPtr> { accept() }; }
+
 private:
-    struct AcceptOp : Operation {
-        explicit AcceptOp(TCPAcceptor* acceptor)
+    template <bool Batch>
+    struct BasicAcceptOp : Operation {
+        using Result = std::conditional_t<Batch, std::vector<SocketPtr>, SocketPtr>;
+
+        explicit BasicAcceptOp(TCPAcceptor* acceptor)
             : m_acceptor { acceptor }
         {
         }
 
-        SocketPtr await_resume()
+        // Connections left over from the last batch are handed out without
+        // a syscall. Otherwise accept right away if the loop allows it, and
+        // only wait for readiness if no connection is pending.
+        [[nodiscard]] bool await_ready()
         {
-            if (auto ec = std::get_if<std::error_code>(&m_result)) {
-                throw std::system_error(*ec);
+            return !m_acceptor->m_pending.empty() || (m_acceptor->m_eventLoop.speculate() && tryAccept());
+        }
+
+        Result await_resume()
+        {
+            if (m_error) {
+                throw std::system_error(m_error);
+            }
+            auto& pending = m_acceptor->m_pending;
+            auto& next = m_acceptor->m_next;
+            if constexpr (Batch) {
+                Result sockets { std::make_move_iterator(pending.begin() + static_cast<std::ptrdiff_t>(next)), std::make_move_iterator(pending.end()) };
+                pending.clear();
+                next = 0;
+                return sockets;
+            } else {
+                auto socket = std::move(pending[next++]);
+                if (next == pending.size()) {
+                    pending.clear();
+                    next = 0;
+                }
+                return socket;
             }
-            return std::move(std::get<SocketPtr>(m_result));
         }
 
         void await_suspend(std::coroutine_handle<> h)
         {
             m_waiter = h;
-            m_acceptor->m_eventLoop.addOperation(&m_acceptor->m_desc,
-                EventLoop::OpType::read_op, this);
+            wait();
         }
 
         void perform(const std::error_code& ec) override
         {
             if (ec) {
-                m_result = ec;
-                m_waiter.resume();
+                m_error = ec;
+            } else if (!tryAccept()) {
+                // Spurious readiness, or another acceptor was faster.
+                completion.reset();
+                wait();
                 return;
             }
+            m_waiter.resume();
+        }
 
-            struct sockaddr_in client_addr {
-                0
-            };
-            auto len = sizeof(client_addr);
-            auto fd = ::accept(m_acceptor->m_desc.m_fd,
-                reinterpret_cast<sockaddr*>(&client_addr),
-                reinterpret_cast<socklen_t*>(&len));
-            if (fd < 0) {
-                m_result = std::make_error_code(static_cast<std::errc>(errno));
-            } else {
-                m_result.emplace<SocketPtr>(std::make_unique<TCPSocket>(
-                    m_acceptor->m_eventLoop, fd, client_addr));
+        void wait()
+        {
+            m_acceptor->m_eventLoop.addOperation(&m_acceptor->m_desc,
+                EventLoop::OpType::read_op, this, IoRequest { IoRequest::accept });
+        }
+
+        // Take up to a batch of connections from the backlog. Returns false
+        // if none was pending.
+        bool tryAccept()
+        {
+            auto& acceptor = *m_acceptor;
+            // A completion-based backend already accepted one connection,
+            // and keeps accepting the next ones by itself.
+            auto limit = completion ? 1 : std::max<std::size_t>(acceptor.m_options.acceptBatch, 1);
+            while (acceptor.m_pending.size() - acceptor.m_next < limit) {
+                sockaddr_storage addr {};
+                socklen_t len = sizeof(addr);
+                auto fd = io([&] {
+                    return ::accept4(acceptor.m_desc.m_fd, reinterpret_cast<sockaddr*>(&addr), &len,
+                        SOCK_NONBLOCK | SOCK_CLOEXEC);
+                });
+                if (fd < 0) {
+                    if (errno == ECONNABORTED) {
+                        // The peer gave up while queued; try the next one.
+                        if (completion) {
+                            break;
+                        }
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK && acceptor.m_pending.empty()) {
+                        m_error = std::make_error_code(static_cast<std::errc>(errno));
+                        return true;
+                    }
+                    break;
+                }
+                if (completion) {
+                    // Completed accepts don't report the peer address.
+                    ::getpeername(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+                }
+                if (acceptor.m_options.noDelay) {
+                    int one = 1;
+                    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                }
+                acceptor.m_pending.push_back(std::make_unique<TCPSocket>(acceptor.m_eventLoop, fd, addr));
             }
-            m_waiter.resume();
+            return !acceptor.m_pending.empty();
         }
 
         TCPAcceptor* m_acceptor;
-        std::variant<std::monostate, std::error_code, SocketPtr> m_result;
+        std::error_code m_error;
         std::coroutine_handle<> m_waiter;
     };
 
+    void setOption(int level, int name, int value)
+    {
+        if (::setsockopt(m_desc.m_fd, level, name, &value, sizeof(value)) < 0) {
+            throw std::system_error(errno, std::generic_category(), "setsockopt");
+        }
+    }
+
     EventLoop& m_eventLoop;
     Descriptor m_desc;
+    ListenOptions m_options;
+
+    // Connections accepted in the last batch but not handed out yet.
+    // Accepted connections not handed out yet start at m_next. The vector is
+    // cleared once all are, and keeps its capacity, so that a steady stream
+    // of connections does not allocate for it.
+    std::vector<SocketPtr> m_pending;
+    std::size_t m_next { 0 };
 };
 } // namespace aifs
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <span>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <arpa/inet.h>
-#include <fcntl.h>
 #include <netinet/in.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <spdlog/spdlog.h>
@@ -14,6 +19,7 @@
 #include "non_copyable.h"
 #include "aifs/descriptor.h"
 #include "aifs/event_loop.h"
+#include "aifs/task.h"
 
 namespace aifs {
 class StreamSocket {
@@ -21,57 +27,225 @@ public:
     virtual ~StreamSocket() = default;
     // virtual std::string remote_address() const = 0;
     virtual unsigned short remote_port() const = 0;
-    virtual Awaitable<ssize_t> receive(std::span<char> buffer) = 0;
-    virtual Awaitable<ssize_t> send(std::span<const char> buffer) = 0;
-    virtual void close() const = 0;
+    [[nodiscard]] Awaitable<ssize_t> receive(std::span<char> buffer) { return doReceive(buffer); }
+    [[nodiscard]] Awaitable<ssize_t> send(std::span<const char> buffer) { return doSend(buffer); }
+
+    /**
+     * Scatter/gather versions of receive() and send(). Like those they may
+     * transfer less than the buffers hold.
+     */
+    [[nodiscard]] Awaitable<ssize_t> receivev(std::span<const iovec> buffers) { return doReceivev(buffers); }
+    [[nodiscard]] Awaitable<ssize_t> sendv(std::span<const iovec> buffers) { return doSendv(buffers); }
+
+    /**
+     * Send everything in buffers, continuing after partial writes.
+     */
+    Task<> sendAll(std::span<const iovec> buffers)
+    {
+        constexpr std::size_t inline_count = 8;
+        iovec inlineStorage[inline_count];
+        std::vector<iovec> heapStorage;
+        std::span<iovec> pending;
+        if (buffers.size() <= inline_count) {
+            std::copy(buffers.begin(), buffers.end(), inlineStorage);
+            pending = { inlineStorage, buffers.size() };
+        } else {
+            heapStorage.assign(buffers.begin(), buffers.end());
+            pending = heapStorage;
+        }
+
+        while (!pending.empty()) {
+            if (pending.front().iov_len == 0) {
+                pending = pending.subspan(1);
+                continue;
+            }
+            auto n = static_cast<std::size_t>(co_await sendv(pending));
+            for (; !pending.empty() && n >= pending.front().iov_len; pending = pending.subspan(1)) {
+                n -= pending.front().iov_len;
+            }
+            if (n > 0) {
+                pending.front().iov_base = static_cast<char*>(pending.front().iov_base) + n;
+                pending.front().iov_len -= n;
+            }
+        }
+    }
+
+    /**
+     * Send count bytes of the file fd, starting at offset. The file offset
+     * of fd is left alone.
+     */
+    Task<> sendFile(int fd, off_t offset, std::size_t count) { return doSendFile(fd, offset, count); }
+
+    virtual void cancel() = 0;
+    virtual void close() = 0;
+
+protected:
+    virtual Awaitable<ssize_t> doReceive(std::span<char> buffer) = 0;
+    virtual Awaitable<ssize_t> doSend(std::span<const char> buffer) = 0;
+
+    // Sockets without native scatter/gather I/O transfer one buffer at a
+    // time.
+    virtual Awaitable<ssize_t> doReceivev(std::span<const iovec> buffers)
+    {
+        auto it = std::find_if(buffers.begin(), buffers.end(), [](const iovec& b) { return b.iov_len > 0; });
+        if (it == buffers.end()) {
+            return doReceive({});
+        }
+        return doReceive({ static_cast<char*>(it->iov_base), it->iov_len });
+    }
+
+    virtual Awaitable<ssize_t> doSendv(std::span<const iovec> buffers)
+    {
+        auto it = std::find_if(buffers.begin(), buffers.end(), [](const iovec& b) { return b.iov_len > 0; });
+        if (it == buffers.end()) {
+            return doSend({});
+        }
+        return doSend({ static_cast<const char*>(it->iov_base), it->iov_len });
+    }
+
+    // Copies through a buffer, for sockets that cannot hand the file to
+    // the kernel.
+    virtual Task<> doSendFile(int fd, off_t offset, std::size_t count)
+    {
+        std::vector<char> buffer(std::min<std::size_t>(count, 64 * 1024));
+        while (count > 0) {
+            auto n = ::pread(fd, buffer.data(), std::min(count, buffer.size()), offset);
+            if (n < 0) {
+                throw std::system_error(errno, std::generic_category(), "pread");
+            }
+            if (n == 0) {
+                throw std::system_error(std::make_error_code(std::errc::io_error), "File ended early");
+            }
+            iovec chunk { buffer.data(), static_cast<std::size_t>(n) };
+            co_await sendAll({ &chunk, 1 });
+            offset += n;
+            count -= static_cast<std::size_t>(n);
+        }
+    }
 };
 
-class TCPSocket : NonCopyable, public StreamSocket {
-private:
+/**
+ * StreamSocket on a connected, non-blocking socket descriptor. TCPSocket
+ * and UnixSocket add what is particular to their address family.
+ */
+class BasicStreamSocket : NonCopyable, public StreamSocket {
+protected:
     struct ReceiveOp;
     struct SendOp;
+    struct ReceivevOp;
+    struct SendvOp;
+    struct SendFileOp;
+    struct ReceiveBufferOp;
 
 public:
-    TCPSocket(EventLoop& ev, int fd, struct sockaddr_in addr)
+    /**
+     * Take over the connected socket fd, which must already be in
+     * non-blocking mode, for example from accept4() with SOCK_NONBLOCK.
+     */
+    BasicStreamSocket(EventLoop& ev, int fd)
         : m_eventLoop { ev }
         , m_desc { fd }
-        , m_addr { addr }
     {
-        ::fcntl(m_desc.m_fd, F_SETFL, O_NONBLOCK);
     }
 
-    [[nodiscard]] std::string remote_address() const
+    ~BasicStreamSocket() override { close(); }
+
+    [[nodiscard]] int native_handle() const { return m_desc.m_fd; }
+
+    // These hide the type-erased StreamSocket versions, so that awaiting
+    // them through a concrete socket does not go through an Awaitable.
+    [[nodiscard]] ReceiveOp receive(std::span<char> buffer) { return ReceiveOp { *this, buffer }; }
+
+    [[nodiscard]] SendOp send(std::span<const char> buffer) { return SendOp { *this, buffer }; }
+
+    [[nodiscard]] ReceivevOp receivev(std::span<const iovec> buffers) { return ReceivevOp { *this, buffers }; }
+
+    [[nodiscard]] SendvOp sendv(std::span<const iovec> buffers) { return SendvOp { *this, buffers }; }
+
+    /**
+     * Wait until data arrives, then read it into a buffer borrowed from the
+     * loop's BufferPool. The buffer is only taken once there is something
+     * to read, so a connection waiting for data holds no buffer.
+     */
+    [[nodiscard]] ReceiveBufferOp receiveBuffer() { return ReceiveBufferOp { *this }; }
+
+    /**
+     * Complete all outstanding operations on this socket with
+     * operation_canceled.
+     */
+    void cancel() { m_eventLoop.cancelOperations(&m_desc); }
+
+    /**
+     * Give up the descriptor without closing it, for example to hand it to
+     * another loop, and return it. The socket is closed afterwards.
+     */
+    [[nodiscard]] int release()
     {
-        constexpr int max_len = 16;
-        char buf[max_len];
-        if (const char* p = inet_ntop(AF_INET, &m_addr.sin_addr, buf, max_len)) {
-            return { p, ::strlen(p) };
+        if (m_desc.m_fd != -1) {
+            m_eventLoop.deregister(&m_desc);
         }
-        return "";
+        return std::exchange(m_desc.m_fd, -1);
     }
 
-    [[nodiscard]] unsigned short remote_port() const { return ntohs(m_addr.sin_port); }
+    /**
+     * Close the socket, if it is not closed yet. Pending operations complete
+     * with operation_canceled. The destructor closes the socket as well.
+     */
+    void close() override
+    {
+        if (m_desc.m_fd != -1) {
+            m_eventLoop.cancelOperations(&m_desc);
+            m_eventLoop.deregister(&m_desc);
+            ::close(std::exchange(m_desc.m_fd, -1));
+        }
+    }
 
-    [[nodiscard]] Awaitable<ssize_t> receive(std::span<char> buffer)
+protected:
+    Awaitable<ssize_t> doReceive(std::span<char> buffer) override
     {
-        return Awaitable<int> { ReceiveOp { *this, buffer } };
+        return Awaitable<ssize_t> { ReceiveOp { *this, buffer } };
     }
 
-    [[nodiscard]] Awaitable<ssize_t> send(std::span<const char> buffer)
+    Awaitable<ssize_t> doSend(std::span<const char> buffer) override
     {
-        return Awaitable<int> { SendOp { *this, buffer } };
+        return Awaitable<ssize_t> { SendOp { *this, buffer } };
     }
 
-    void close() const { ::close(m_desc.m_fd); }
+    Awaitable<ssize_t> doReceivev(std::span<const iovec> buffers) override
+    {
+        return Awaitable<ssize_t> { ReceivevOp { *this, buffers } };
+    }
+
+    Awaitable<ssize_t> doSendv(std::span<const iovec> buffers) override
+    {
+        return Awaitable<ssize_t> { SendvOp { *this, buffers } };
+    }
+
+    // The file goes from the page cache to the socket with sendfile(2),
+    // without passing through user space.
+    Task<> doSendFile(int fd, off_t offset, std::size_t count) override
+    {
+        while (count > 0) {
+            auto n = co_await SendFileOp { *this, fd, offset, count };
+            if (n == 0) {
+                throw std::system_error(std::make_error_code(std::errc::io_error), "File ended early");
+            }
+            offset += n;
+            count -= static_cast<std::size_t>(n);
+        }
+    }
 
-private:
     struct ReceiveOp : Operation {
-        ReceiveOp(TCPSocket& socket, std::span<char> buffer)
+        ReceiveOp(BasicStreamSocket& socket, std::span<char> buffer)
             : socket_ { socket }
             , buffer_ { buffer }
         {
         }
 
+        // Read right away if the loop allows it, and only wait for
+        // readiness if there is nothing to read yet.
+        [[nodiscard]] bool await_ready() { return socket_.m_eventLoop.speculate() && tryReceive(); }
+
         ssize_t await_resume()
         {
             if (auto ec = std::get_if<std::error_code>(&result_)) {
@@ -83,41 +257,61 @@ private:
         void await_suspend(std::coroutine_handle<> h)
         {
             waiter_ = h;
-            socket_.m_eventLoop.addOperation(&socket_.m_desc, EventLoop::OpType::read_op, this);
+            wait();
         }
 
         void perform(const std::error_code& ec) override
         {
             if (ec) {
                 result_ = ec;
-                waiter_.resume();
+            } else if (!tryReceive()) {
+                // Spurious readiness, wait again.
+                completion.reset();
+                wait();
                 return;
             }
+            waiter_.resume();
+        }
 
-            ssize_t n = ::read(socket_.m_desc.m_fd, buffer_.data(), buffer_.size());
+        void wait()
+        {
+            socket_.m_eventLoop.addOperation(&socket_.m_desc, EventLoop::OpType::read_op, this,
+                IoRequest { IoRequest::receive, buffer_.data(), buffer_.size() });
+        }
+
+        // Returns false if the read would block.
+        bool tryReceive()
+        {
+            ssize_t n = io([&] { return ::read(socket_.m_desc.m_fd, buffer_.data(), buffer_.size()); });
             if (n > 0) {
                 result_ = n;
             } else if (n == 0) {
                 result_ = std::make_error_code(std::errc::connection_aborted);
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
             } else {
                 result_ = std::make_error_code(static_cast<std::errc>(errno));
             }
-            waiter_.resume();
+            return true;
         }
 
-        TCPSocket& socket_;
+        BasicStreamSocket& socket_;
         std::span<char> buffer_;
         std::variant<std::monostate, std::error_code, ssize_t> result_;
         std::coroutine_handle<> waiter_;
     };
 
     struct SendOp : Operation {
-        SendOp(TCPSocket& socket, std::span<const char> buffer)
+        SendOp(BasicStreamSocket& socket, std::span<const char> buffer)
             : m_socket { socket }
             , m_buffer { buffer }
         {
         }
 
+        // Write right away if the loop allows it, and only wait for
+        // readiness if the socket buffer is full.
+        [[nodiscard]] bool await_ready() { return m_socket.m_eventLoop.speculate() && trySend(); }
+
         ssize_t await_resume()
         {
             if (auto ec = std::get_if<std::error_code>(&m_result)) {
@@ -129,34 +323,332 @@ private:
         void await_suspend(std::coroutine_handle<> h)
         {
             m_waiter = h;
-            m_socket.m_eventLoop.addOperation(&m_socket.m_desc, EventLoop::OpType::write_op, this);
+            wait();
         }
 
         void perform(const std::error_code& ec) override
         {
             if (ec) {
                 m_result = ec;
-                m_waiter.resume();
+            } else if (!trySend()) {
+                // Spurious readiness, wait again.
+                completion.reset();
+                wait();
                 return;
             }
+            m_waiter.resume();
+        }
+
+        void wait()
+        {
+            m_socket.m_eventLoop.addOperation(&m_socket.m_desc, EventLoop::OpType::write_op, this,
+                IoRequest { IoRequest::send, const_cast<char*>(m_buffer.data()), m_buffer.size() });
+        }
+
+        // Returns false if the write would block.
+        bool trySend()
+        {
+            ssize_t n = io([&] { return ::send(m_socket.m_desc.m_fd, m_buffer.data(), m_buffer.size(), MSG_NOSIGNAL); });
+            if (n >= 0) {
+                m_result = n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return false;
+            } else {
+                m_result = std::make_error_code(static_cast<std::errc>(errno));
+            }
+            return true;
+        }
 
-            ssize_t n = ::write(m_socket.m_desc.m_fd, m_buffer.data(), m_buffer.size());
+        BasicStreamSocket& m_socket;
+        std::span<const char> m_buffer;
+        std::variant<std::monostate, std::error_code, ssize_t> m_result;
+        std::coroutine_handle<> m_waiter;
+    };
+
+    struct ReceivevOp : Operation {
+        ReceivevOp(BasicStreamSocket& socket, std::span<const iovec> buffers)
+            : m_socket { socket }
+        {
+            m_msg.msg_iov = const_cast<iovec*>(buffers.data());
+            m_msg.msg_iovlen = buffers.size();
+        }
+
+        [[nodiscard]] bool await_ready() { return m_socket.m_eventLoop.speculate() && tryReceive(); }
+
+        ssize_t await_resume()
+        {
+            if (auto ec = std::get_if<std::error_code>(&m_result)) {
+                throw std::system_error(*ec);
+            }
+            return std::get<ssize_t>(m_result);
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            m_waiter = h;
+            wait();
+        }
+
+        void perform(const std::error_code& ec) override
+        {
+            if (ec) {
+                m_result = ec;
+            } else if (!tryReceive()) {
+                completion.reset();
+                wait();
+                return;
+            }
+            m_waiter.resume();
+        }
+
+        void wait()
+        {
+            m_socket.m_eventLoop.addOperation(&m_socket.m_desc, EventLoop::OpType::read_op, this,
+                IoRequest { IoRequest::receive_msg, &m_msg });
+        }
+
+        bool tryReceive()
+        {
+            ssize_t n = io([&] { return ::recvmsg(m_socket.m_desc.m_fd, &m_msg, 0); });
             if (n > 0) {
                 m_result = n;
+            } else if (n == 0) {
+                m_result = std::make_error_code(std::errc::connection_aborted);
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            } else {
+                m_result = std::make_error_code(static_cast<std::errc>(errno));
+            }
+            return true;
+        }
+
+        BasicStreamSocket& m_socket;
+        msghdr m_msg {};
+        std::variant<std::monostate, std::error_code, ssize_t> m_result;
+        std::coroutine_handle<> m_waiter;
+    };
+
+    struct SendvOp : Operation {
+        SendvOp(BasicStreamSocket& socket, std::span<const iovec> buffers)
+            : m_socket { socket }
+        {
+            m_msg.msg_iov = const_cast<iovec*>(buffers.data());
+            m_msg.msg_iovlen = buffers.size();
+        }
+
+        [[nodiscard]] bool await_ready() { return m_socket.m_eventLoop.speculate() && trySend(); }
+
+        ssize_t await_resume()
+        {
+            if (auto ec = std::get_if<std::error_code>(&m_result)) {
+                throw std::system_error(*ec);
+            }
+            return std::get<ssize_t>(m_result);
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            m_waiter = h;
+            wait();
+        }
+
+        void perform(const std::error_code& ec) override
+        {
+            if (ec) {
+                m_result = ec;
+            } else if (!trySend()) {
+                completion.reset();
+                wait();
+                return;
+            }
+            m_waiter.resume();
+        }
+
+        void wait()
+        {
+            m_socket.m_eventLoop.addOperation(&m_socket.m_desc, EventLoop::OpType::write_op, this,
+                IoRequest { IoRequest::send_msg, &m_msg });
+        }
+
+        bool trySend()
+        {
+            ssize_t n = io([&] { return ::sendmsg(m_socket.m_desc.m_fd, &m_msg, MSG_NOSIGNAL); });
+            if (n >= 0) {
+                m_result = n;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
             } else {
                 m_result = std::make_error_code(static_cast<std::errc>(errno));
             }
+            return true;
+        }
+
+        BasicStreamSocket& m_socket;
+        msghdr m_msg {};
+        std::variant<std::monostate, std::error_code, ssize_t> m_result;
+        std::coroutine_handle<> m_waiter;
+    };
+
+    struct SendFileOp : Operation {
+        SendFileOp(BasicStreamSocket& socket, int fd, off_t offset, std::size_t count)
+            : m_socket { socket }
+            , m_fd { fd }
+            , m_offset { offset }
+            , m_count { count }
+        {
+        }
+
+        [[nodiscard]] bool await_ready() { return m_socket.m_eventLoop.speculate() && trySend(); }
+
+        ssize_t await_resume()
+        {
+            if (auto ec = std::get_if<std::error_code>(&m_result)) {
+                throw std::system_error(*ec);
+            }
+            return std::get<ssize_t>(m_result);
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            m_waiter = h;
+            wait();
+        }
+
+        void perform(const std::error_code& ec) override
+        {
+            if (ec) {
+                m_result = ec;
+            } else if (!trySend()) {
+                wait();
+                return;
+            }
             m_waiter.resume();
         }
 
-        TCPSocket& m_socket;
-        std::span<const char> m_buffer;
+        // There is no sendfile request for completion-based backends, so
+        // this only waits for the socket to become writable.
+        void wait() { m_socket.m_eventLoop.addOperation(&m_socket.m_desc, EventLoop::OpType::write_op, this); }
+
+        bool trySend()
+        {
+            ssize_t n = ::sendfile(m_socket.m_desc.m_fd, m_fd, &m_offset, m_count);
+            if (n >= 0) {
+                m_result = n;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            } else {
+                m_result = std::make_error_code(static_cast<std::errc>(errno));
+            }
+            return true;
+        }
+
+        BasicStreamSocket& m_socket;
+        int m_fd;
+        off_t m_offset;
+        std::size_t m_count;
         std::variant<std::monostate, std::error_code, ssize_t> m_result;
         std::coroutine_handle<> m_waiter;
     };
 
+    struct ReceiveBufferOp : Operation {
+        explicit ReceiveBufferOp(BasicStreamSocket& socket)
+            : m_socket { socket }
+        {
+        }
+
+        [[nodiscard]] bool await_ready() { return m_socket.m_eventLoop.speculate() && tryReceive(); }
+
+        BufferPool::Buffer await_resume()
+        {
+            if (m_error) {
+                throw std::system_error(m_error);
+            }
+            return std::move(m_buffer);
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            m_waiter = h;
+            wait();
+        }
+
+        void perform(const std::error_code& ec) override
+        {
+            if (ec) {
+                m_error = ec;
+            } else if (!tryReceive()) {
+                wait();
+                return;
+            }
+            m_waiter.resume();
+        }
+
+        // Completion-based backends would need a buffer up front, so they
+        // only poll for readiness here as well.
+        void wait() { m_socket.m_eventLoop.addOperation(&m_socket.m_desc, EventLoop::OpType::read_op, this); }
+
+        bool tryReceive()
+        {
+            auto buffer = m_socket.m_eventLoop.buffers().acquire();
+            auto space = buffer.space();
+            ssize_t n = ::recv(m_socket.m_desc.m_fd, space.data(), space.size(), 0);
+            if (n > 0) {
+                buffer.resize(static_cast<std::size_t>(n));
+                m_buffer = std::move(buffer);
+            } else if (n == 0) {
+                m_error = std::make_error_code(std::errc::connection_aborted);
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            } else {
+                m_error = std::make_error_code(static_cast<std::errc>(errno));
+            }
+            return true;
+        }
+
+        BasicStreamSocket& m_socket;
+        BufferPool::Buffer m_buffer;
+        std::error_code m_error;
+        std::coroutine_handle<> m_waiter;
+    };
+
     EventLoop& m_eventLoop;
     Descriptor m_desc;
-    struct sockaddr_in m_addr;
+};
+
+class TCPSocket : public BasicStreamSocket {
+public:
+    /**
+     * Take over the non-blocking socket fd connected to addr.
+     */
+    TCPSocket(EventLoop& ev, int fd, const sockaddr_storage& addr)
+        : BasicStreamSocket { ev, fd }
+        , m_addr { addr }
+    {
+    }
+
+    [[nodiscard]] std::string remote_address() const
+    {
+        char buf[INET6_ADDRSTRLEN];
+        const void* addr = m_addr.ss_family == AF_INET6
+            ? static_cast<const void*>(&reinterpret_cast<const sockaddr_in6&>(m_addr).sin6_addr)
+            : static_cast<const void*>(&reinterpret_cast<const sockaddr_in&>(m_addr).sin_addr);
+        if (const char* p = inet_ntop(m_addr.ss_family, addr, buf, sizeof(buf))) {
+            return { p, ::strlen(p) };
+        }
+        return "";
+    }
+
+    [[nodiscard]] unsigned short remote_port() const
+    {
+        if (m_addr.ss_family == AF_INET6) {
+            return ntohs(reinterpret_cast<const sockaddr_in6&>(m_addr).sin6_port);
+        }
+        return ntohs(reinterpret_cast<const sockaddr_in&>(m_addr).sin_port);
+    }
+
+    [[nodiscard]] const sockaddr_storage& remote_endpoint() const { return m_addr; }
+
+private:
+    sockaddr_storage m_addr;
 };
 } // namespace aifs
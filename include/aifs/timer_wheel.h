@@ -0,0 +1,235 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "operation.h"
+
+namespace aifs {
+struct TimerLink {
+    TimerLink* m_prev { this };
+    TimerLink* m_next { this };
+
+    TimerLink() = default;
+    TimerLink(const TimerLink&) = delete;
+    TimerLink& operator=(const TimerLink&) = delete;
+
+    [[nodiscard]] bool linked() const { return m_next != this; }
+
+    void unlink()
+    {
+        m_prev->m_next = m_next;
+        m_next->m_prev = m_prev;
+        m_prev = m_next = this;
+    }
+
+    void pushBack(TimerLink& link)
+    {
+        link.m_prev = m_prev;
+        link.m_next = this;
+        m_prev->m_next = &link;
+        m_prev = &link;
+    }
+};
+
+/**
+ * A timer owned by the user of the TimerWheel, typically embedded in the
+ * object that waits for it. m_op is performed when the timer expires.
+ */
+struct TimerEntry : TimerLink {
+    Operation* m_op { nullptr };
+    std::uint64_t m_tick { 0 };
+    int m_bucket { -1 };
+};
+
+/**
+ * Hierarchical timing wheel with O(1) schedule, re-arm and cancel.
+ *
+ * Time is divided into ticks, and a timer expires on the first tick that
+ * starts at or after its deadline, so it never fires early and all timers
+ * that fall in the same tick are expired together. Each level has 64 slots
+ * covering 64 times the range of the level below it. Timers far in the
+ * future wait in a coarse slot and are cascaded to a finer level only when
+ * their slot comes up, so timers that keep being re-armed or are cancelled
+ * before they are due never cost more than a list insert and unlink.
+ */
+class TimerWheel {
+public:
+    using Duration = std::chrono::microseconds;
+
+    explicit TimerWheel(Duration tick = Duration { 100 })
+        : m_tick { tick }
+    {
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    [[nodiscard]] bool empty() const { return m_size == 0; }
+    [[nodiscard]] std::size_t size() const { return m_size; }
+
+    /**
+     * Schedule entry to expire at deadline, measured on the same clock as
+     * the now passed to expire(). An entry that is already scheduled is
+     * moved to the new deadline.
+     */
+    void schedule(TimerEntry& entry, Duration deadline)
+    {
+        if (entry.linked()) {
+            remove(entry);
+        }
+        auto ticks = (deadline.count() + m_tick.count() - 1) / m_tick.count();
+        entry.m_tick = static_cast<std::uint64_t>(std::max<Duration::rep>(ticks, 0));
+        insert(entry);
+        ++m_size;
+    }
+
+    /**
+     * Remove entry from the wheel. Returns false if it was not scheduled.
+     */
+    bool cancel(TimerEntry& entry)
+    {
+        if (!entry.linked()) {
+            return false;
+        }
+        remove(entry);
+        --m_size;
+        return true;
+    }
+
+    /**
+     * The earliest time expire() may have work to do. This is a lower bound
+     * when the next timer still sits in a coarse slot.
+     */
+    [[nodiscard]] std::optional<Duration> nextExpiry() const
+    {
+        if (auto tick = nextTick()) {
+            return m_tick * static_cast<Duration::rep>(*tick);
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * Advance the wheel to now and call fn with every entry that expired.
+     * Entries are unlinked before fn is called.
+     */
+    template <typename Fn>
+    void expire(Duration now, Fn&& fn)
+    {
+        auto target = static_cast<std::uint64_t>(std::max<Duration::rep>(now / m_tick, 0));
+        while (auto tick = nextTick()) {
+            if (*tick > target) {
+                break;
+            }
+            m_current = *tick;
+            cascade();
+
+            auto& head = m_buckets[m_current & slot_mask];
+            m_occupied[0] &= ~(std::uint64_t { 1 } << (m_current & slot_mask));
+            while (head.linked()) {
+                auto& entry = static_cast<TimerEntry&>(*head.m_next);
+                entry.unlink();
+                entry.m_bucket = -1;
+                --m_size;
+                fn(entry);
+            }
+            ++m_current;
+        }
+        m_current = std::max(m_current, target + 1);
+    }
+
+private:
+    static constexpr int slot_bits = 6;
+    static constexpr int num_slots = 1 << slot_bits;
+    static constexpr std::uint64_t slot_mask = num_slots - 1;
+    static constexpr int num_levels = 6;
+    static constexpr int overflow = num_levels * num_slots;
+
+    static constexpr std::uint64_t digit(std::uint64_t tick, int level)
+    {
+        return (tick >> (level * slot_bits)) & slot_mask;
+    }
+
+    void insert(TimerEntry& entry)
+    {
+        auto tick = std::max(entry.m_tick, m_current);
+        // The level is given by the most significant digit in which the
+        // deadline differs from the current tick.
+        auto diff = tick ^ m_current;
+        int level = diff == 0 ? 0 : (std::bit_width(diff) - 1) / slot_bits;
+        if (level >= num_levels) {
+            entry.m_bucket = overflow;
+        } else {
+            auto slot = digit(tick, level);
+            entry.m_bucket = level * num_slots + static_cast<int>(slot);
+            m_occupied[level] |= std::uint64_t { 1 } << slot;
+        }
+        m_buckets[entry.m_bucket].pushBack(entry);
+    }
+
+    void remove(TimerEntry& entry)
+    {
+        auto bucket = entry.m_bucket;
+        entry.unlink();
+        entry.m_bucket = -1;
+        if (bucket != overflow && !m_buckets[bucket].linked()) {
+            m_occupied[bucket / num_slots] &= ~(std::uint64_t { 1 } << (bucket % num_slots));
+        }
+    }
+
+    // Move the entries of every coarse slot that starts at the current tick
+    // down to finer levels.
+    void cascade()
+    {
+        for (int level = 1; level <= num_levels; ++level) {
+            if (m_current & ((std::uint64_t { 1 } << (level * slot_bits)) - 1)) {
+                break;
+            }
+            int bucket = level == num_levels
+                ? overflow
+                : level * num_slots + static_cast<int>(digit(m_current, level));
+            if (level < num_levels) {
+                m_occupied[level] &= ~(std::uint64_t { 1 } << digit(m_current, level));
+            }
+            TimerLink pending;
+            while (m_buckets[bucket].linked()) {
+                auto& link = *m_buckets[bucket].m_next;
+                link.unlink();
+                pending.pushBack(link);
+            }
+            while (pending.linked()) {
+                auto& entry = static_cast<TimerEntry&>(*pending.m_next);
+                entry.unlink();
+                insert(entry);
+            }
+        }
+    }
+
+    [[nodiscard]] std::optional<std::uint64_t> nextTick() const
+    {
+        // Every occupied slot lies at or after the current digit of its level,
+        // and all of a level's slots come before those of the levels above.
+        for (int level = 0; level < num_levels; ++level) {
+            if (m_occupied[level]) {
+                auto shift = (level + 1) * slot_bits;
+                auto slot = static_cast<std::uint64_t>(std::countr_zero(m_occupied[level]));
+                return ((m_current >> shift) << shift) | (slot << (level * slot_bits));
+            }
+        }
+        if (m_buckets[overflow].linked()) {
+            auto shift = num_levels * slot_bits;
+            return ((m_current >> shift) + 1) << shift;
+        }
+        return std::nullopt;
+    }
+
+    Duration m_tick;
+    std::uint64_t m_current { 0 };
+    std::size_t m_size { 0 };
+    std::array<std::uint64_t, num_levels> m_occupied {};
+    std::array<TimerLink, overflow + 1> m_buckets {};
+};
+} // namespace aifs
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <system_error>
+#include <variant>
+#include <vector>
+
+#include "descriptor.h"
+#include "event_loop.h"
+#include "non_copyable.h"
+#include "operation.h"
+#include "socket_address.h"
+
+namespace aifs {
+struct UDPOptions {
+    // IPv4 or IPv6 address to bind. "::" receives IPv4 datagrams as well,
+    // unless v6Only is set.
+    std::string address { "0.0.0.0" };
+    bool v6Only { false };
+    bool reusePort { false };
+
+    // SO_RCVBUF in bytes, or 0 for the system default. Ingestion at high
+    // packet rates usually wants a larger one.
+    int receiveBufferSize { 0 };
+
+    // Let the kernel merge consecutive datagrams from one peer into one
+    // receive (UDP_GRO); DatagramBatch::segmentSize() tells how to split
+    // them again.
+    bool gro { false };
+
+    // Let the kernel split every send into datagrams of this size
+    // (UDP_SEGMENT), or 0 to send every buffer as one datagram.
+    std::uint16_t gsoSegmentSize { 0 };
+};
+
+/**
+ * Storage for receiving up to size() datagrams of at most bufferSize bytes
+ * with one UDPSocket::receiveBatch().
+ */
+class DatagramBatch : private NonCopyable {
+public:
+    DatagramBatch(std::size_t count, std::size_t bufferSize)
+        : m_bufferSize { bufferSize }
+        , m_data(count * bufferSize)
+        , m_control(count * control_size)
+        , m_iovecs(count)
+        , m_peers(count)
+        , m_headers(count)
+    {
+        for (std::size_t i = 0; i < count; ++i) {
+            m_iovecs[i] = { m_data.data() + i * bufferSize, bufferSize };
+            auto& msg = m_headers[i].msg_hdr;
+            msg.msg_iov = &m_iovecs[i];
+            msg.msg_iovlen = 1;
+            msg.msg_name = &m_peers[i];
+        }
+    }
+
+    [[nodiscard]] std::size_t size() const { return m_headers.size(); }
+
+    /**
+     * Payload and sender of datagram i of the last receive.
+     */
+    [[nodiscard]] std::span<const char> data(std::size_t i) const
+    {
+        return { m_data.data() + i * m_bufferSize, m_headers[i].msg_len };
+    }
+
+    [[nodiscard]] const sockaddr_storage& peer(std::size_t i) const { return m_peers[i]; }
+
+    /**
+     * Size of the datagrams that GRO merged into datagram i, or 0 if it is
+     * a single datagram.
+     */
+    [[nodiscard]] std::size_t segmentSize(std::size_t i) const
+    {
+        auto& msg = m_headers[i].msg_hdr;
+        for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&msg), cmsg)) {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                int size = 0;
+                std::memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+                return static_cast<std::size_t>(size);
+            }
+        }
+        return 0;
+    }
+
+private:
+    friend class UDPSocket;
+
+    static constexpr std::size_t control_size = CMSG_SPACE(sizeof(int));
+
+    // The kernel overwrites the lengths on every receive.
+    std::span<mmsghdr> prepare()
+    {
+        for (std::size_t i = 0; i < size(); ++i) {
+            auto& msg = m_headers[i].msg_hdr;
+            msg.msg_namelen = sizeof(sockaddr_storage);
+            msg.msg_control = m_control.data() + i * control_size;
+            msg.msg_controllen = control_size;
+            msg.msg_flags = 0;
+        }
+        return m_headers;
+    }
+
+    std::size_t m_bufferSize;
+    std::vector<char> m_data;
+    std::vector<char> m_control;
+    std::vector<iovec> m_iovecs;
+    std::vector<sockaddr_storage> m_peers;
+    std::vector<mmsghdr> m_headers;
+};
+
+/**
+ * Datagram socket bound to a local address. Besides one datagram per
+ * operation, receiveBatch() and sendBatch() move many datagrams per
+ * syscall with recvmmsg() and sendmmsg().
+ */
+class UDPSocket : private NonCopyable {
+private:
+    template <OpType Type, typename Fn>
+    struct DatagramOp;
+
+public:
+    /**
+     * Bind to port, or to an ephemeral port if port is 0.
+     */
+    explicit UDPSocket(EventLoop& ev, int port = 0, UDPOptions options = {})
+        : m_eventLoop { ev }
+        , m_desc { -1 }
+    {
+        sockaddr_storage addr;
+        auto len = makeSocketAddress(options.address, port, addr);
+
+        m_desc.m_fd = ::socket(addr.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_desc.m_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "socket");
+        }
+
+        try {
+            if (options.reusePort) {
+                setOption(SOL_SOCKET, SO_REUSEPORT, 1);
+            }
+            if (addr.ss_family == AF_INET6) {
+                setOption(IPPROTO_IPV6, IPV6_V6ONLY, options.v6Only);
+            }
+            if (options.receiveBufferSize > 0) {
+                setOption(SOL_SOCKET, SO_RCVBUF, options.receiveBufferSize);
+            }
+            if (options.gro) {
+                setOption(SOL_UDP, UDP_GRO, 1);
+            }
+            if (options.gsoSegmentSize > 0) {
+                setOption(SOL_UDP, UDP_SEGMENT, options.gsoSegmentSize);
+            }
+            if (::bind(m_desc.m_fd, reinterpret_cast<sockaddr*>(&addr), len) < 0) {
+                throw std::system_error(errno, std::generic_category(), "bind");
+            }
+        } catch (...) {
+            ::close(m_desc.m_fd);
+            throw;
+        }
+    }
+
+    ~UDPSocket()
+    {
+        m_eventLoop.deregister(&m_desc);
+        ::close(m_desc.m_fd);
+    }
+
+    [[nodiscard]] int native_handle() const { return m_desc.m_fd; }
+
+    /**
+     * The bound address, with the port the system picked if port was 0.
+     */
+    [[nodiscard]] sockaddr_storage local_endpoint() const
+    {
+        sockaddr_storage addr {};
+        socklen_t len = sizeof(addr);
+        if (::getsockname(m_desc.m_fd, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+            throw std::system_error(errno, std::generic_category(), "getsockname");
+        }
+        return addr;
+    }
+
+    /**
+     * Send to address and port by default, and only receive from there.
+     */
+    void connect(const std::string& address, int port)
+    {
+        sockaddr_storage addr;
+        auto len = makeSocketAddress(address, port, addr);
+        if (::connect(m_desc.m_fd, reinterpret_cast<sockaddr*>(&addr), len) < 0) {
+            throw std::system_error(errno, std::generic_category(), "connect");
+        }
+    }
+
+    /**
+     * Receive one datagram into buffer and store its sender in from. The
+     * result is the size of the datagram; whatever does not fit into
+     * buffer is dropped.
+     */
+    [[nodiscard]] auto receiveFrom(std::span<char> buffer, sockaddr_storage& from)
+    {
+        return makeOp<read_op>([buffer, &from](int fd) {
+            socklen_t len = sizeof(from);
+            return ::recvfrom(fd, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr*>(&from), &len);
+        });
+    }
+
+    /**
+     * Receive one datagram on a connected socket.
+     */
+    [[nodiscard]] auto receive(std::span<char> buffer)
+    {
+        return makeOp<read_op>([buffer](int fd) { return ::recv(fd, buffer.data(), buffer.size(), 0); });
+    }
+
+    [[nodiscard]] auto sendTo(std::span<const char> buffer, const sockaddr_storage& to)
+    {
+        return makeOp<write_op>([buffer, &to](int fd) {
+            return ::sendto(fd, buffer.data(), buffer.size(), 0, reinterpret_cast<const sockaddr*>(&to),
+                socketAddressLength(to));
+        });
+    }
+
+    /**
+     * Send one datagram on a connected socket.
+     */
+    [[nodiscard]] auto send(std::span<const char> buffer)
+    {
+        return makeOp<write_op>([buffer](int fd) { return ::send(fd, buffer.data(), buffer.size(), 0); });
+    }
+
+    /**
+     * Receive as many datagrams as are queued, up to batch.size(), with one
+     * syscall. The result is the number received.
+     */
+    [[nodiscard]] auto receiveBatch(DatagramBatch& batch)
+    {
+        return makeOp<read_op>([&batch](int fd) {
+            auto headers = batch.prepare();
+            return static_cast<ssize_t>(::recvmmsg(fd, headers.data(), headers.size(), 0, nullptr));
+        });
+    }
+
+    /**
+     * Send the datagrams described by messages with one syscall. The result
+     * is the number sent, which may be less than messages.size().
+     */
+    [[nodiscard]] auto sendBatch(std::span<mmsghdr> messages)
+    {
+        return makeOp<write_op>([messages](int fd) {
+            return static_cast<ssize_t>(::sendmmsg(fd, messages.data(), messages.size(), 0));
+        });
+    }
+
+    /**
+     * Complete all outstanding operations on this socket with
+     * operation_canceled.
+     */
+    void cancel() { m_eventLoop.cancelOperations(&m_desc); }
+
+private:
+    // Tries fn right away if the loop allows it, otherwise and on EAGAIN
+    // waits for readiness. fn makes the syscall on the descriptor it is
+    // given and returns its result. Completion-based backends only poll for
+    // readiness, since fn may be any of several syscalls.
+    template <OpType Type, typename Fn>
+    struct DatagramOp : Operation {
+        DatagramOp(UDPSocket& socket, Fn fn)
+            : m_socket { socket }
+            , m_fn { std::move(fn) }
+        {
+        }
+
+        [[nodiscard]] bool await_ready() { return m_socket.m_eventLoop.speculate() && tryIo(); }
+
+        std::size_t await_resume()
+        {
+            if (auto ec = std::get_if<std::error_code>(&m_result)) {
+                throw std::system_error(*ec);
+            }
+            return std::get<std::size_t>(m_result);
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            m_waiter = h;
+            wait();
+        }
+
+        void perform(const std::error_code& ec) override
+        {
+            if (ec) {
+                m_result = ec;
+            } else if (!tryIo()) {
+                wait();
+                return;
+            }
+            m_waiter.resume();
+        }
+
+        void wait() { m_socket.m_eventLoop.addOperation(&m_socket.m_desc, Type, this); }
+
+        bool tryIo()
+        {
+            ssize_t n = m_fn(m_socket.m_desc.m_fd);
+            if (n >= 0) {
+                m_result = static_cast<std::size_t>(n);
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            } else {
+                m_result = std::make_error_code(static_cast<std::errc>(errno));
+            }
+            return true;
+        }
+
+        UDPSocket& m_socket;
+        Fn m_fn;
+        std::variant<std::monostate, std::error_code, std::size_t> m_result;
+        std::coroutine_handle<> m_waiter;
+    };
+
+    template <OpType Type, typename Fn>
+    DatagramOp<Type, Fn> makeOp(Fn fn)
+    {
+        return DatagramOp<Type, Fn> { *this, std::move(fn) };
+    }
+
+    void setOption(int level, int name, int value)
+    {
+        if (::setsockopt(m_desc.m_fd, level, name, &value, sizeof(value)) < 0) {
+            throw std::system_error(errno, std::generic_category(), "setsockopt");
+        }
+    }
+
+    EventLoop& m_eventLoop;
+    Descriptor m_desc;
+};
+} // namespace aifs
@@ -0,0 +1,402 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "awaitable.h"
+#include "descriptor.h"
+#include "event_loop.h"
+#include "operation.h"
+#include "socket_address.h"
+#include "steady_timer.h"
+#include "task.h"
+#include "tcp_acceptor.h"
+#include "tcp_socket.h"
+
+namespace aifs {
+/**
+ * Connected Unix domain stream socket. Besides data it can pass file
+ * descriptors to the peer (SCM_RIGHTS).
+ */
+class UnixSocket : public BasicStreamSocket {
+private:
+    struct SendFdsOp;
+    struct ReceiveFdsOp;
+
+public:
+    // Most descriptors sent or received along with one message.
+    static constexpr std::size_t max_fds = 16;
+
+    /**
+     * Take over the non-blocking socket fd.
+     */
+    UnixSocket(EventLoop& ev, int fd)
+        : BasicStreamSocket { ev, fd }
+    {
+    }
+
+    /**
+     * Connect to the socket at path; see makeUnixAddress(). While the
+     * listener's backlog is full the connect is retried, as a blocking
+     * connect would wait, but without blocking the loop.
+     */
+    static Task<std::unique_ptr<UnixSocket>> connect(EventLoop& ev, std::string path)
+    {
+        sockaddr_un addr;
+        auto len = makeUnixAddress(path, addr);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "socket");
+        }
+        auto socket = std::make_unique<UnixSocket>(ev, fd);
+        SteadyTimer retry { ev, connect_retry_delay };
+        while (::connect(fd, reinterpret_cast<sockaddr*>(&addr), len) < 0) {
+            if (errno == EINPROGRESS) {
+                co_await ConnectOp { *socket };
+                break;
+            }
+            // A full backlog fails with EAGAIN, and there is no readiness
+            // to wait for until the listener accepts.
+            if (errno != EAGAIN) {
+                throw std::system_error(errno, std::generic_category(), "connect");
+            }
+            co_await retry.wait();
+        }
+        co_return socket;
+    }
+
+    /**
+     * A pair of sockets connected to each other.
+     */
+    static std::pair<std::unique_ptr<UnixSocket>, std::unique_ptr<UnixSocket>> pair(EventLoop& ev)
+    {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) < 0) {
+            throw std::system_error(errno, std::generic_category(), "socketpair");
+        }
+        return { std::make_unique<UnixSocket>(ev, fds[0]), std::make_unique<UnixSocket>(ev, fds[1]) };
+    }
+
+    // Unix domain peers have no port.
+    [[nodiscard]] unsigned short remote_port() const { return 0; }
+
+    /**
+     * Send data together with up to max_fds descriptors, which the peer
+     * receives as new descriptors for the same files. data must not be
+     * empty. The result is the number of bytes sent; the descriptors go
+     * with the first of them.
+     */
+    [[nodiscard]] SendFdsOp sendFds(std::span<const char> data, std::span<const int> fds)
+    {
+        return SendFdsOp { *this, data, fds };
+    }
+
+    /**
+     * Receive data into buffer, and append any descriptors that came with
+     * it to fds. The received descriptors are close-on-exec and owned by
+     * the caller.
+     */
+    [[nodiscard]] ReceiveFdsOp receiveFds(std::span<char> buffer, std::vector<int>& fds)
+    {
+        return ReceiveFdsOp { *this, buffer, fds };
+    }
+
+private:
+    static constexpr std::size_t control_size = CMSG_SPACE(sizeof(int) * max_fds);
+    static constexpr auto connect_retry_delay = std::chrono::milliseconds(1);
+
+    // Waits for a connect in progress to finish.
+    struct ConnectOp : Operation {
+        explicit ConnectOp(UnixSocket& socket)
+            : m_socket { socket }
+        {
+        }
+
+        [[nodiscard]] constexpr bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            m_waiter = h;
+            m_socket.m_eventLoop.addOperation(&m_socket.m_desc, EventLoop::OpType::write_op, this);
+        }
+
+        void await_resume() const
+        {
+            if (m_error) {
+                throw std::system_error(m_error, "connect");
+            }
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (::getsockopt(m_socket.m_desc.m_fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+                err = errno;
+            }
+            if (err) {
+                throw std::system_error(err, std::generic_category(), "connect");
+            }
+        }
+
+        void perform(const std::error_code& ec) override
+        {
+            m_error = ec;
+            m_waiter.resume();
+        }
+
+        UnixSocket& m_socket;
+        std::error_code m_error;
+        std::coroutine_handle<> m_waiter;
+    };
+
+    // The message header points into the operation itself, so it is only
+    // set up once the operation has its final address.
+    struct SendFdsOp : SendvOp {
+        SendFdsOp(UnixSocket& socket, std::span<const char> data, std::span<const int> fds)
+            : SendvOp { socket, {} }
+            , m_buffer { const_cast<char*>(data.data()), data.size() }
+            , m_count { std::min(fds.size(), max_fds) }
+        {
+            if (fds.size() > max_fds) {
+                throw std::system_error(std::make_error_code(std::errc::invalid_argument), "Too many descriptors");
+            }
+            std::copy_n(fds.begin(), m_count, m_fds);
+        }
+
+        [[nodiscard]] bool await_ready()
+        {
+            prepare();
+            return SendvOp::await_ready();
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            prepare();
+            SendvOp::await_suspend(h);
+        }
+
+        void prepare()
+        {
+            m_msg.msg_iov = &m_buffer;
+            m_msg.msg_iovlen = 1;
+            if (m_count == 0) {
+                return;
+            }
+            m_msg.msg_control = m_control;
+            m_msg.msg_controllen = CMSG_SPACE(sizeof(int) * m_count);
+            auto* cmsg = CMSG_FIRSTHDR(&m_msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int) * m_count);
+            std::memcpy(CMSG_DATA(cmsg), m_fds, sizeof(int) * m_count);
+        }
+
+        iovec m_buffer;
+        int m_fds[max_fds];
+        std::size_t m_count;
+        alignas(cmsghdr) char m_control[control_size] {};
+    };
+
+    struct ReceiveFdsOp : ReceivevOp {
+        ReceiveFdsOp(UnixSocket& socket, std::span<char> buffer, std::vector<int>& fds)
+            : ReceivevOp { socket, {} }
+            , m_buffer { buffer.data(), buffer.size() }
+            , m_fds { fds }
+        {
+        }
+
+        [[nodiscard]] bool await_ready()
+        {
+            prepare();
+            return ReceivevOp::await_ready();
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            prepare();
+            ReceivevOp::await_suspend(h);
+        }
+
+        ssize_t await_resume()
+        {
+            auto n = ReceivevOp::await_resume();
+            for (auto* cmsg = CMSG_FIRSTHDR(&m_msg); cmsg; cmsg = CMSG_NXTHDR(&m_msg, cmsg)) {
+                if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                    continue;
+                }
+                auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (std::size_t i = 0; i < count; ++i) {
+                    int fd;
+                    std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                    // Completion-based backends receive without
+                    // MSG_CMSG_CLOEXEC.
+                    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+                    m_fds.push_back(fd);
+                }
+            }
+            return n;
+        }
+
+        void prepare()
+        {
+            m_msg.msg_iov = &m_buffer;
+            m_msg.msg_iovlen = 1;
+            m_msg.msg_control = m_control;
+            m_msg.msg_controllen = sizeof(m_control);
+        }
+
+        iovec m_buffer;
+        std::vector<int>& m_fds;
+        alignas(cmsghdr) char m_control[control_size] {};
+    };
+};
+
+/**
+ * Acceptor listening on a Unix domain socket. A path starting with '@'
+ * names a socket in the abstract namespace; any other path is a file,
+ * which replaces a stale socket file left at path and is removed again
+ * when the acceptor is destroyed.
+ */
+class UnixAcceptor : public Acceptor<UnixSocket> {
+private:
+    struct AcceptOp;
+
+public:
+    UnixAcceptor(EventLoop& ctx, std::string path, int backlog = SOMAXCONN)
+        : m_eventLoop { ctx }
+        , m_desc { -1 }
+        , m_path { std::move(path) }
+    {
+        sockaddr_un addr;
+        auto len = makeUnixAddress(m_path, addr);
+
+        m_desc.m_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_desc.m_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "socket");
+        }
+
+        struct stat st {};
+        if (!abstract() && ::lstat(m_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            ::unlink(m_path.c_str());
+        }
+        if (::bind(m_desc.m_fd, reinterpret_cast<sockaddr*>(&addr), len) < 0) {
+            auto err = errno;
+            ::close(m_desc.m_fd);
+            throw std::system_error(err, std::generic_category(), "bind");
+        }
+        if (::listen(m_desc.m_fd, backlog) < 0) {
+            auto err = errno;
+            ::close(m_desc.m_fd);
+            unlinkPath();
+            throw std::system_error(err, std::generic_category(), "listen");
+        }
+    }
+
+    ~UnixAcceptor() override
+    {
+        m_eventLoop.deregister(&m_desc);
+        ::close(m_desc.m_fd);
+        unlinkPath();
+    }
+
+    void cancel() override
+    {
+        m_eventLoop.cancelOperation(&m_desc, EventLoop::OpType::read_op);
+    }
+
+    [[nodiscard]] AcceptOp accept() { return AcceptOp { this }; }
+
+protected:
+    Awaitable<SocketPtr> doAccept() override { return Awaitable<SocketPtr> { accept() }; }
+
+private:
+    struct AcceptOp : Operation {
+        explicit AcceptOp(UnixAcceptor* acceptor)
+            : m_acceptor { acceptor }
+        {
+        }
+
+        [[nodiscard]] bool await_ready() { return m_acceptor->m_eventLoop.speculate() && tryAccept(); }
+
+        SocketPtr await_resume()
+        {
+            if (auto ec = std::get_if<std::error_code>(&m_result)) {
+                throw std::system_error(*ec);
+            }
+            return std::move(std::get<SocketPtr>(m_result));
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            m_waiter = h;
+            wait();
+        }
+
+        void perform(const std::error_code& ec) override
+        {
+            if (ec) {
+                m_result = ec;
+            } else if (!tryAccept()) {
+                completion.reset();
+                wait();
+                return;
+            }
+            m_waiter.resume();
+        }
+
+        void wait()
+        {
+            m_acceptor->m_eventLoop.addOperation(&m_acceptor->m_desc,
+                EventLoop::OpType::read_op, this, IoRequest { IoRequest::accept });
+        }
+
+        // Returns false if no connection is pending.
+        bool tryAccept()
+        {
+            auto fd = io([&] {
+                return ::accept4(m_acceptor->m_desc.m_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            });
+            if (fd < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED)) {
+                return false;
+            }
+            if (fd < 0) {
+                m_result = std::make_error_code(static_cast<std::errc>(errno));
+            } else {
+                m_result.emplace<SocketPtr>(std::make_unique<UnixSocket>(m_acceptor->m_eventLoop, fd));
+            }
+            return true;
+        }
+
+        UnixAcceptor* m_acceptor;
+        std::variant<std::monostate, std::error_code, SocketPtr> m_result;
+        std::coroutine_handle<> m_waiter;
+    };
+
+    [[nodiscard]] bool abstract() const { return m_path.front() == '@'; }
+
+    void unlinkPath()
+    {
+        if (!abstract()) {
+            ::unlink(m_path.c_str());
+        }
+    }
+
+    EventLoop& m_eventLoop;
+    Descriptor m_desc;
+    std::string m_path;
+};
+} // namespace aifs
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "chase_lev_deque.h"
+#include "mpsc_queue.h"
+#include "non_copyable.h"
+#include "posted_operation.h"
+
+namespace aifs {
+/**
+ * Thread pool for CPU-bound work, so that it does not hold up an
+ * EventLoop. Every worker keeps its own deque of runnable operations and
+ * idle workers steal from the others. A coroutine moves onto the pool and
+ * back to its loop with:
+ *
+ *     co_await executor.schedule();
+ *     // CPU-bound work
+ *     co_await loop.schedule();
+ *
+ * A coroutine spawned on an EventLoop must be back on that loop when it
+ * finishes.
+ */
+class WorkStealingExecutor : private NonCopyable {
+public:
+    /**
+     * Start threads workers, or one per core if threads is 0.
+     */
+    explicit WorkStealingExecutor(std::size_t threads = 0);
+
+    /**
+     * Finish the queued work and join the workers.
+     */
+    ~WorkStealingExecutor();
+
+    [[nodiscard]] std::size_t size() const { return m_workers.size(); }
+
+    /**
+     * Call fn on one of the workers. May be called from any thread.
+     */
+    template <typename Fn>
+    void post(Fn&& fn)
+    {
+        enqueue(new PostedCallback<Fn> { std::forward<Fn>(fn) });
+    }
+
+    /**
+     * Resume the awaiting coroutine on one of the workers.
+     */
+    [[nodiscard]] ScheduleOp<WorkStealingExecutor> schedule()
+    {
+        return ScheduleOp<WorkStealingExecutor> { this };
+    }
+
+private:
+    friend struct ScheduleOp<WorkStealingExecutor>;
+
+    struct Worker {
+        ChaseLevDeque<PostedOperation> m_deque;
+        std::thread m_thread;
+    };
+
+    void enqueue(PostedOperation* op);
+    void run(std::size_t index);
+    PostedOperation* findWork(std::size_t index);
+    PostedOperation* takeInjected(Worker& worker);
+    void notify();
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    // Work posted from outside the pool. Producers never block, the
+    // consumer side is taken by one worker at a time.
+    MpscQueue<PostedOperation> m_injected;
+    std::atomic_flag m_injectedBusy;
+
+    // Idle workers sleep on m_epoch, which is bumped whenever work is added
+    // while any worker is idle.
+    std::atomic<std::uint32_t> m_epoch { 0 };
+    std::atomic<std::size_t> m_idle { 0 };
+    std::atomic<bool> m_stopping { false };
+};
+} // namespace aifs
@@ -1,20 +1,16 @@
 
 #include "aifs/event_loop.h"
 
-#include <sys/select.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <utility>
 
 namespace aifs {
 namespace detail {
-    template <typename Duration>
-    void to_timeval(Duration&& d, struct timeval& tv)
-    {
-        std::chrono::seconds const sec = std::chrono::duration_cast<std::chrono::seconds>(d);
-        tv.tv_sec = sec.count();
-        tv.tv_usec = std::chrono::duration_cast<std::chrono::microseconds>(d - sec).count();
-    }
-
     struct oneway_task {
-        struct promise_type {
+        struct promise_type : PooledFrame {
             std::suspend_never initial_suspend() const noexcept { return {}; }
             std::suspend_never final_suspend() const noexcept { return {}; }
             void unhandled_exception() { std::terminate(); }
@@ -24,16 +20,31 @@ namespace detail {
     };
 } // namespace detail
 
-EventLoop::EventLoop()
+EventLoop::EventLoop(Backend backend)
     : m_stopped { false }
+    , m_reactor { makeReactor(backend) }
     , m_startTime {}
     , m_outstandingWork { 0 }
+    , m_wakeup { ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) }
 {
+    if (m_wakeup.m_fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "eventfd");
+    }
     auto now = std::chrono::steady_clock::now();
-    m_startTime = duration_cast<MSDuration>(now.time_since_epoch());
+    m_startTime = duration_cast<Duration>(now.time_since_epoch());
+    watchWakeup();
 }
 
-EventLoop::~EventLoop() = default;
+EventLoop::~EventLoop()
+{
+    while (!m_posted.empty()) {
+        if (auto* op = m_posted.pop()) {
+            op->perform(std::make_error_code(std::errc::operation_canceled));
+        }
+    }
+    m_reactor->deregister(&m_wakeup);
+    ::close(m_wakeup.m_fd);
+}
 
 bool EventLoop::isStop() const { return m_stopped; }
 
@@ -41,76 +52,111 @@ void EventLoop::spawn(Task<> t)
 {
     [](Task<> t, EventLoop* self) -> detail::oneway_task {
         self->workStarted();
-        co_await std::move(t);
+        try {
+            co_await std::move(t);
+        } catch (const std::exception& e) {
+            spdlog::error("Spawned task failed: {}", e.what());
+        } catch (...) {
+            spdlog::error("Spawned task failed");
+        }
         self->workFinished();
     }(std::move(t), this);
 }
 
+void EventLoop::enqueue(PostedOperation* op)
+{
+    m_posted.push(op);
+    wakeup();
+}
+
+void EventLoop::wakeup()
+{
+    // Only the first producer to find the loop asleep pays for the syscall.
+    if (m_sleeping.exchange(false)) {
+        std::uint64_t one = 1;
+        [[maybe_unused]] auto n = ::write(m_wakeup.m_fd, &one, sizeof(one));
+    }
+}
+
+void EventLoop::watchWakeup()
+{
+    // The wakeup descriptor is not counted as work, so that a loop with
+    // nothing else to do still stops.
+    m_wakeup.m_ops[read_op] = &m_wakeupOp;
+    if (!m_reactor->submit(&m_wakeup, read_op, {}, &m_wakeupOp)) {
+        m_wakeup.m_interest |= opMask(read_op);
+        m_reactor->update(&m_wakeup);
+    }
+}
+
 void EventLoop::runOnce()
 {
-    // If we have any waiting timers, the max timeout of the select Operation
+    // If we have any waiting timers, the max timeout of the reactor wait
     // should be the time until the first Timer expires.
-    std::optional<MSDuration> timeout;
-    if (!m_schedule.empty()) {
-        auto&& [when, _] = m_schedule[0];
-        timeout = std::max(when - time(), std::chrono::milliseconds { 0 });
+    Reactor::Timeout timeout;
+    if (auto when = m_timers.nextExpiry()) {
+        timeout = std::max(*when - time(), Duration { 0 });
     }
 
-    // Build the fd_sets based on pending operations.
-    int max_fd = -1;
-    fd_set fd_sets[max_op];
-    for (int i = 0; i < max_op; ++i) {
-        FD_ZERO(&fd_sets[i]);
-        for (const auto& [desc, op] : m_pendingOps[i]) {
-            FD_SET(desc->m_fd, &fd_sets[i]);
-            if (desc->m_fd > max_fd) {
-                max_fd = desc->m_fd;
-            }
+    // Announce that the loop is about to block before checking for posted
+    // work one last time, so that a producer either sees the announcement
+    // and signals the eventfd or its work is seen here.
+    if (timeout != Duration { 0 }) {
+        m_sleeping = true;
+        if (!m_posted.empty() || isStop()) {
+            timeout = Duration { 0 };
         }
     }
 
-    struct timeval to = { 0, 0 };
-    struct timeval* tv = nullptr;
-    if (timeout) {
-        detail::to_timeval(*timeout, to);
-        tv = &to;
-    }
-
-    int num_events = ::select(max_fd + 1, &fd_sets[0], &fd_sets[1], &fd_sets[2], tv);
-    if (num_events > 0) {
-        // Add all ready operations to the ready queue and remove from queue of
-        // pending operations
+    // Wait for readiness, then move the operations waiting for it from their
+    // descriptors to the ready queue.
+    m_events.clear();
+    m_reactor->wait(timeout, m_events);
+    m_sleeping.store(false, std::memory_order_relaxed);
+    for (const auto& [desc, ready, orphan] : m_events) {
+        if (orphan) {
+            m_ready.push_back(orphan);
+            continue;
+        }
+        if (desc == &m_wakeup) {
+            std::uint64_t count;
+            while (::read(m_wakeup.m_fd, &count, sizeof(count)) > 0) { }
+            m_wakeup.m_ops[read_op] = nullptr;
+            watchWakeup();
+            continue;
+        }
         for (int i = 0; i < max_op; ++i) {
-            auto it = m_pendingOps[i].begin();
-            while (it != m_pendingOps[i].end()) {
-                if (FD_ISSET(it->first->m_fd, &fd_sets[i]) != 0) {
-                    m_ready.push(it->second);
-                    it = m_pendingOps[i].erase(it);
-                } else {
-                    it++;
-                }
+            auto type = static_cast<OpType>(i);
+            if ((ready & opMask(type)) == 0) {
+                continue;
             }
+            if (auto* op = std::exchange(desc->m_ops[i], nullptr)) {
+                m_ready.push_back(op);
+            }
+            desc->m_interest &= ~opMask(type);
         }
+        m_reactor->update(desc);
     }
 
     // Add all expired timers to the m_ready queue
-    auto now = time();
-    while (!m_schedule.empty()) {
-        auto&& [when, op] = m_schedule[0];
-        if (when > now) {
-            break;
-        }
-        m_ready.push(op);
-        std::ranges::pop_heap(m_schedule, std::ranges::greater {}, &TimerHandle::first);
-        m_schedule.pop_back();
+    m_timers.expire(time(), [this](TimerEntry& timer) { m_ready.push_back(timer.m_op); });
+
+    // Add the operations posted from other threads, which count as work
+    // from here on.
+    while (auto* op = m_posted.pop()) {
+        workStarted();
+        m_ready.push_back(op);
     }
 
-    // Run all m_ready handles
-    while (!m_ready.empty()) {
-        auto op = m_ready.front();
-        m_ready.pop();
+    // Run all m_ready handles, including those that become ready while they
+    // run. Clearing keeps the capacity, so once the vector has grown to the
+    // largest batch this does not allocate.
+    for (std::size_t i = 0; i < m_ready.size(); ++i) {
+        auto* op = m_ready[i];
+        m_speculationBudget = speculation_budget;
         op->perform(op->ec);
         workFinished();
     }
+    m_ready.clear();
 }
 } // namespace aifs
@@ -0,0 +1,589 @@
+#include "aifs/http/fast_request_parser.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <utility>
+
+#include <http_parser.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AIFS_HAVE_X86_SIMD 1
+#endif
+
+namespace aifs::http {
+namespace {
+    // A set of bytes given as ascending inclusive ranges: { lo0, hi0, lo1,
+    // hi1, ... }. One SSE4.2 operand holds eight ranges; beyond that the
+    // closest ranges are merged there, so it may match bytes outside the
+    // set, which the table tells apart.
+    struct CharRanges {
+        constexpr CharRanges(std::string_view pairs)
+        {
+            for (std::size_t i = 0; i < pairs.size(); i += 2) {
+                for (unsigned c = static_cast<unsigned char>(pairs[i]); c <= static_cast<unsigned char>(pairs[i + 1]); ++c) {
+                    table[c] = true;
+                }
+            }
+
+            unsigned char merged[32] {};
+            std::size_t count = pairs.size() / 2;
+            for (std::size_t i = 0; i < pairs.size(); ++i) {
+                merged[i] = static_cast<unsigned char>(pairs[i]);
+            }
+            while (count > 8) {
+                std::size_t closest = 0;
+                for (std::size_t i = 1; i + 1 < count; ++i) {
+                    if (merged[2 * i + 2] - merged[2 * i + 1] < merged[2 * closest + 2] - merged[2 * closest + 1]) {
+                        closest = i;
+                    }
+                }
+                merged[2 * closest + 1] = merged[2 * closest + 3];
+                for (std::size_t i = 2 * closest + 2; i + 2 < 2 * count; ++i) {
+                    merged[i] = merged[i + 2];
+                }
+                --count;
+            }
+            size = 2 * count;
+            for (std::size_t i = 0; i < size; ++i) {
+                ranges[i] = static_cast<char>(merged[i]);
+            }
+
+            // Nibble tables for AVX2: every distinct set of low nibbles that
+            // occurs in the set for some high nibble gets a bit, and a byte
+            // belongs to the set if its high and low nibble share a bit.
+            unsigned rows[16] {};
+            unsigned bits = 0;
+            for (unsigned high = 0; high < 16; ++high) {
+                unsigned row = 0;
+                for (unsigned low = 0; low < 16; ++low) {
+                    row |= table[high << 4 | low] ? 1u << low : 0;
+                }
+                if (row == 0) {
+                    continue;
+                }
+                unsigned bit = 0;
+                while (bit < bits && rows[bit] != row) {
+                    ++bit;
+                }
+                if (bit == bits) {
+                    if (bits == 8) {
+                        throw "More than eight distinct nibble rows";
+                    }
+                    rows[bits++] = row;
+                }
+                highNibbles[high] = static_cast<char>(1u << bit);
+            }
+            for (unsigned bit = 0; bit < bits; ++bit) {
+                for (unsigned low = 0; low < 16; ++low) {
+                    if (rows[bit] & (1u << low)) {
+                        lowNibbles[low] = static_cast<char>(lowNibbles[low] | (1u << bit));
+                    }
+                }
+            }
+        }
+
+        alignas(16) char ranges[16] {};
+        std::size_t size { 0 };
+        std::array<bool, 256> table {};
+        alignas(16) char lowNibbles[16] {};
+        alignas(16) char highNibbles[16] {};
+    };
+
+    using namespace std::string_view_literals;
+
+    // Bytes that end a token (RFC 9110 tchar), such as a method or field name.
+    constexpr CharRanges token_end { "\x00\x20\"\"(),,//:@[]{{}}\x7f\xff"sv };
+
+    // Bytes that end a request target: controls, space and DEL.
+    constexpr CharRanges url_end { "\x00\x20\x7f\x7f"sv };
+
+    // Bytes that end a field value: controls other than HTAB, and DEL.
+    constexpr CharRanges value_end { "\x00\x08\x0a\x1f\x7f\x7f"sv };
+
+    using FindFn = const char* (*)(const char* p, const char* end, const CharRanges& set);
+
+    const char* findScalar(const char* p, const char* end, const CharRanges& set)
+    {
+        while (p != end && !set.table[static_cast<unsigned char>(*p)]) {
+            ++p;
+        }
+        return p;
+    }
+
+#ifdef AIFS_HAVE_X86_SIMD
+    __attribute__((target("sse4.2"))) const char* findSse42(const char* p, const char* end, const CharRanges& set)
+    {
+        auto ranges = _mm_load_si128(reinterpret_cast<const __m128i*>(set.ranges));
+        auto rangesSize = static_cast<int>(set.size);
+        while (end - p >= 16) {
+            auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            int i = _mm_cmpestri(ranges, rangesSize, block, 16, _SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES | _SIDD_UBYTE_OPS);
+            if (i == 16) {
+                p += 16;
+            } else if (set.table[static_cast<unsigned char>(p[i])]) {
+                return p + i;
+            } else {
+                // Only in a merged range; go on after it.
+                p += i + 1;
+            }
+        }
+        return findScalar(p, end, set);
+    }
+
+    __attribute__((target("avx2"))) const char* findAvx2(const char* p, const char* end, const CharRanges& set)
+    {
+        auto lowNibbles = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(set.lowNibbles)));
+        auto highNibbles = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(set.highNibbles)));
+        auto nibble = _mm256_set1_epi8(0x0f);
+        for (; end - p >= 32; p += 32) {
+            auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            auto low = _mm256_shuffle_epi8(lowNibbles, _mm256_and_si256(block, nibble));
+            auto high = _mm256_shuffle_epi8(highNibbles, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+            auto outside = _mm256_cmpeq_epi8(_mm256_and_si256(low, high), _mm256_setzero_si256());
+            if (auto mask = ~static_cast<unsigned>(_mm256_movemask_epi8(outside))) {
+                return p + __builtin_ctz(mask);
+            }
+        }
+        return findSse42(p, end, set);
+    }
+#endif
+
+    FindFn selectFind()
+    {
+#ifdef AIFS_HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return findAvx2;
+        }
+        if (__builtin_cpu_supports("sse4.2")) {
+            return findSse42;
+        }
+#endif
+        return findScalar;
+    }
+
+    // First byte in [p, end) that belongs to set, or end.
+    const char* find(const char* p, const char* end, const CharRanges& set)
+    {
+        static const FindFn fn = selectFind();
+        return fn(p, end, set);
+    }
+
+    bool equalsIgnoreCase(std::string_view a, std::string_view b)
+    {
+        auto equal = [](unsigned char x, unsigned char y) { return std::tolower(x) == std::tolower(y); };
+        return std::ranges::equal(a, b, equal);
+    }
+
+    std::string_view trim(std::string_view s)
+    {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+            s.remove_prefix(1);
+        }
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+            s.remove_suffix(1);
+        }
+        return s;
+    }
+
+    // Calls fn with every element of a comma-separated list.
+    template <typename Fn>
+    void forEachListItem(std::string_view list, Fn fn)
+    {
+        while (!list.empty()) {
+            auto comma = list.find(',');
+            fn(trim(list.substr(0, comma)));
+            list = comma == std::string_view::npos ? std::string_view {} : list.substr(comma + 1);
+        }
+    }
+
+    int method(std::string_view name)
+    {
+        static constexpr std::pair<std::string_view, http_method> methods[] {
+            { "GET", HTTP_GET },
+            { "POST", HTTP_POST },
+            { "PUT", HTTP_PUT },
+            { "DELETE", HTTP_DELETE },
+            { "HEAD", HTTP_HEAD },
+            { "OPTIONS", HTTP_OPTIONS },
+            { "PATCH", HTTP_PATCH },
+            { "TRACE", HTTP_TRACE },
+        };
+        for (const auto& [n, m] : methods) {
+            if (n == name) {
+                return m;
+            }
+        }
+        return -1;
+    }
+
+    // The end of the line starting at p, after its CRLF or LF, or nullptr
+    // if p does not start a line ending; used after a scan stopped at p.
+    const char* lineEnd(const char* p, const char* end)
+    {
+        if (p != end && *p == '\n') {
+            return p + 1;
+        }
+        if (end - p >= 2 && p[0] == '\r' && p[1] == '\n') {
+            return p + 2;
+        }
+        return nullptr;
+    }
+} // namespace
+
+std::size_t FastRequestParser::consume(std::span<const char> chunk)
+{
+    if (m_error != ok || m_complete) {
+        return 0;
+    }
+
+    // Offsets count from the first byte passed since next(), which is where
+    // m_base points.
+    std::size_t spilled = m_spill.size();
+    if (spilled > 0) {
+        m_spill.append(chunk.data(), chunk.size());
+        m_base = m_spill.data();
+    } else {
+        m_base = chunk.data();
+    }
+
+    if (parse(spilled + chunk.size())) {
+        if (m_error != ok) {
+            return chunk.size();
+        }
+        finish();
+        // Drop what belongs to the following requests.
+        auto used = m_pos - spilled;
+        if (spilled > 0) {
+            m_spill.resize(m_pos);
+        }
+        return used;
+    }
+
+    // The request goes on in the next read, after which chunk is gone; all
+    // of it is kept, whether parsed yet or not.
+    if (spilled == 0) {
+        m_spill.assign(chunk.data(), chunk.size());
+    }
+    return chunk.size();
+}
+
+void FastRequestParser::next()
+{
+    m_complete = false;
+    m_url = {};
+    m_body = {};
+    m_headers.clear();
+    m_error = ok;
+    m_state = State::headers;
+    m_pos = 0;
+    m_scan = 0;
+    m_remaining = 0;
+    m_major = 0;
+    m_minor = 0;
+    m_connectionClose = false;
+    m_connectionKeepAlive = false;
+    m_hasContentLength = false;
+    m_chunked = false;
+    m_urlToken = {};
+    m_bodyToken = {};
+    m_headerTokens.clear();
+    m_ownedBody.clear();
+    m_spill.clear();
+    // Keep the buffers for the next request, unless an unusually large one
+    // made them grow.
+    if (m_spill.capacity() > max_retained) {
+        m_spill.shrink_to_fit();
+    }
+    if (m_ownedBody.capacity() > max_retained) {
+        m_ownedBody.shrink_to_fit();
+    }
+}
+
+bool FastRequestParser::parse(std::size_t end)
+{
+    for (;;) {
+        const char* p = m_base + m_pos;
+        const char* last = m_base + end;
+        switch (m_state) {
+        case State::headers:
+            if (!parseHeaders(end)) {
+                return false;
+            }
+            if (m_error != ok) {
+                return true;
+            }
+            if (m_chunked) {
+                m_state = State::chunk_size;
+            } else if (m_remaining > 0) {
+                m_state = State::body;
+            } else {
+                return true;
+            }
+            break;
+
+        case State::body:
+        case State::chunk_data: {
+            auto n = static_cast<std::size_t>(std::min<std::uint64_t>(m_remaining, end - m_pos));
+            appendBody(m_pos, n);
+            m_pos += n;
+            m_remaining -= n;
+            if (m_remaining > 0) {
+                return false;
+            }
+            if (m_state == State::body) {
+                return true;
+            }
+            m_state = State::chunk_end;
+            break;
+        }
+
+        case State::chunk_size: {
+            auto* nl = static_cast<const char*>(std::memchr(p, '\n', last - p));
+            if (!nl) {
+                return false;
+            }
+            std::uint64_t size = 0;
+            const char* q = p;
+            for (; q != nl && std::isxdigit(static_cast<unsigned char>(*q)); ++q) {
+                if (size > (std::numeric_limits<std::uint64_t>::max() >> 4)) {
+                    return fail(invalid_chunk);
+                }
+                auto c = static_cast<unsigned char>(*q);
+                size = size * 16 + static_cast<unsigned>(std::isdigit(c) ? c - '0' : std::tolower(c) - 'a' + 10);
+            }
+            // Chunk extensions are ignored.
+            if (q == p || (q != nl && *q != ';' && *q != ' ' && *q != '\t' && *q != '\r')) {
+                return fail(invalid_chunk);
+            }
+            m_pos = static_cast<std::size_t>(nl + 1 - m_base);
+            m_remaining = size;
+            m_state = size > 0 ? State::chunk_data : State::trailers;
+            break;
+        }
+
+        case State::chunk_end:
+            if (auto* next = lineEnd(p, last)) {
+                m_pos = static_cast<std::size_t>(next - m_base);
+                m_state = State::chunk_size;
+                break;
+            }
+            // Wait for the rest of the CRLF.
+            if (p == last || (last - p == 1 && *p == '\r')) {
+                return false;
+            }
+            return fail(invalid_chunk);
+
+        case State::trailers: {
+            auto* nl = static_cast<const char*>(std::memchr(p, '\n', last - p));
+            if (!nl) {
+                return false;
+            }
+            m_pos = static_cast<std::size_t>(nl + 1 - m_base);
+            if (nl == p || (nl == p + 1 && *p == '\r')) {
+                return true;
+            }
+            break;
+        }
+        }
+    }
+}
+
+bool FastRequestParser::parseHeaders(std::size_t end)
+{
+    const char* last = m_base + end;
+
+    // Empty lines before a request are ignored.
+    const char* p = m_base + m_pos;
+    while (p != last && (*p == '\r' || *p == '\n')) {
+        ++p;
+    }
+    m_pos = static_cast<std::size_t>(p - m_base);
+    m_scan = std::max(m_scan, m_pos);
+
+    // Wait for the end of the header block, an empty line.
+    const char* blockEnd = nullptr;
+    for (const char* s = m_base + m_scan;;) {
+        auto* nl = static_cast<const char*>(std::memchr(s, '\n', last - s));
+        if (!nl) {
+            m_scan = end;
+            break;
+        }
+        if (last - nl < 2 || (nl[1] == '\r' && last - nl < 3)) {
+            m_scan = static_cast<std::size_t>(nl - m_base);
+            break;
+        }
+        if (nl[1] == '\n') {
+            blockEnd = nl + 2;
+            break;
+        }
+        if (nl[1] == '\r' && nl[2] == '\n') {
+            blockEnd = nl + 3;
+            break;
+        }
+        s = nl + 1;
+    }
+    if (!blockEnd) {
+        if (end - m_pos > max_header_size) {
+            return fail(header_overflow);
+        }
+        return false;
+    }
+    if (static_cast<std::size_t>(blockEnd - p) > max_header_size) {
+        return fail(header_overflow);
+    }
+
+    // Request line.
+    auto offset = [this](const char* q) { return static_cast<std::size_t>(q - m_base); };
+    const char* q = find(p, blockEnd, token_end);
+    if (q == p || *q != ' ') {
+        return fail(invalid_method);
+    }
+    auto m = method({ p, static_cast<std::size_t>(q - p) });
+    if (m < 0) {
+        return fail(invalid_method);
+    }
+    m_method = static_cast<unsigned>(m);
+
+    p = q + 1;
+    q = find(p, blockEnd, url_end);
+    if (q == p || *q != ' ') {
+        return fail(invalid_url);
+    }
+    m_urlToken = { offset(p), static_cast<std::size_t>(q - p) };
+
+    p = q + 1;
+    if (blockEnd - p < 9 || std::memcmp(p, "HTTP/", 5) != 0 || !std::isdigit(static_cast<unsigned char>(p[5]))
+        || p[6] != '.' || !std::isdigit(static_cast<unsigned char>(p[7]))) {
+        return fail(invalid_version);
+    }
+    m_major = static_cast<unsigned>(p[5] - '0');
+    m_minor = static_cast<unsigned>(p[7] - '0');
+    p = lineEnd(p + 8, blockEnd);
+    if (!p) {
+        return fail(invalid_version);
+    }
+
+    // Header fields, up to the empty line.
+    for (;;) {
+        if (auto* next = lineEnd(p, blockEnd)) {
+            p = next;
+            break;
+        }
+        q = find(p, blockEnd, token_end);
+        if (q == p || *q != ':') {
+            return fail(invalid_header);
+        }
+        Token field { offset(p), static_cast<std::size_t>(q - p) };
+
+        p = q + 1;
+        while (*p == ' ' || *p == '\t') {
+            ++p;
+        }
+        q = find(p, blockEnd, value_end);
+        auto* next = lineEnd(q, blockEnd);
+        if (!next) {
+            return fail(invalid_header);
+        }
+        while (q != p && (q[-1] == ' ' || q[-1] == '\t')) {
+            --q;
+        }
+        Token value { offset(p), static_cast<std::size_t>(q - p) };
+        m_headerTokens.push_back({ field, value });
+        processHeader(view(field), view(value));
+        if (m_error != ok) {
+            return true;
+        }
+        p = next;
+    }
+
+    m_pos = offset(p);
+    if (m_chunked && m_hasContentLength) {
+        return fail(invalid_content_length);
+    }
+    return true;
+}
+
+void FastRequestParser::processHeader(std::string_view field, std::string_view value)
+{
+    if (equalsIgnoreCase(field, "Content-Length")) {
+        std::uint64_t length = 0;
+        if (value.empty()) {
+            fail(invalid_content_length);
+            return;
+        }
+        for (char c : value) {
+            if (!std::isdigit(static_cast<unsigned char>(c)) || length > (std::numeric_limits<std::uint64_t>::max() - 9) / 10) {
+                fail(invalid_content_length);
+                return;
+            }
+            length = length * 10 + static_cast<unsigned>(c - '0');
+        }
+        if (m_hasContentLength && length != m_remaining) {
+            fail(invalid_content_length);
+            return;
+        }
+        m_hasContentLength = true;
+        m_remaining = length;
+    } else if (equalsIgnoreCase(field, "Transfer-Encoding")) {
+        // Only chunked, as the final coding, says where the body ends.
+        bool chunked = false;
+        forEachListItem(value, [&](std::string_view coding) { chunked = equalsIgnoreCase(coding, "chunked"); });
+        if (!chunked) {
+            fail(invalid_transfer_encoding);
+            return;
+        }
+        m_chunked = true;
+    } else if (equalsIgnoreCase(field, "Connection")) {
+        forEachListItem(value, [this](std::string_view option) {
+            if (equalsIgnoreCase(option, "close")) {
+                m_connectionClose = true;
+            } else if (equalsIgnoreCase(option, "keep-alive")) {
+                m_connectionKeepAlive = true;
+            }
+        });
+    }
+}
+
+// The pieces of a chunked body are separated by the chunk sizes, so all
+// but the first are copied.
+void FastRequestParser::appendBody(std::size_t offset, std::size_t n)
+{
+    if (n == 0) {
+        return;
+    }
+    if (m_ownedBody.empty() && (m_bodyToken.length == 0 || m_bodyToken.offset + m_bodyToken.length == offset)) {
+        if (m_bodyToken.length == 0) {
+            m_bodyToken.offset = offset;
+        }
+        m_bodyToken.length += n;
+        return;
+    }
+    if (m_ownedBody.empty()) {
+        m_ownedBody.assign(view(m_bodyToken));
+    }
+    m_ownedBody.append(m_base + offset, n);
+}
+
+bool FastRequestParser::fail(Error error)
+{
+    m_error = error;
+    return true;
+}
+
+void FastRequestParser::finish()
+{
+    m_complete = true;
+    m_url = view(m_urlToken);
+    m_body = m_ownedBody.empty() ? view(m_bodyToken) : std::string_view { m_ownedBody };
+    m_headers.clear();
+    for (const auto& h : m_headerTokens) {
+        m_headers.push_back({ view(h.field), view(h.value) });
+    }
+}
+} // namespace aifs::http
@@ -0,0 +1,106 @@
+#include "aifs/http/file_cache.h"
+
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace aifs::http {
+namespace {
+    bool sameFile(const struct stat& a, const struct stat& b)
+    {
+        return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size
+            && a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+    }
+} // namespace
+
+CachedFile::~CachedFile()
+{
+    ::close(m_fd);
+}
+
+std::shared_ptr<const CachedFile> CachedFile::open(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "open");
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) < 0) {
+        auto err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "fstat");
+    }
+    return std::make_shared<const CachedFile>(fd, st);
+}
+
+std::shared_ptr<const CachedFile> FileCache::open(const std::string& path)
+{
+    auto now = Clock::now();
+    std::shared_ptr<const CachedFile> stale;
+    {
+        std::lock_guard lock { m_mutex };
+        if (auto it = m_entries.find(path); it != m_entries.end()) {
+            auto& entry = it->second;
+            m_lru.splice(m_lru.begin(), m_lru, entry.m_lru);
+            if (now - entry.m_checked < m_revalidateAfter) {
+                return entry.m_file;
+            }
+            stale = entry.m_file;
+        }
+    }
+
+    // The syscalls are made without holding the lock.
+    if (stale) {
+        struct stat st {};
+        if (::stat(path.c_str(), &st) == 0 && sameFile(st, stale->m_stat)) {
+            std::lock_guard lock { m_mutex };
+            if (auto it = m_entries.find(path); it != m_entries.end() && it->second.m_file == stale) {
+                it->second.m_checked = now;
+            }
+            return stale;
+        }
+    }
+
+    auto file = CachedFile::open(path);
+    std::lock_guard lock { m_mutex };
+    insert(path, file, now);
+    return file;
+}
+
+void FileCache::insert(const std::string& path, std::shared_ptr<const CachedFile> file, Clock::time_point now)
+{
+    if (auto it = m_entries.find(path); it != m_entries.end()) {
+        it->second.m_file = std::move(file);
+        it->second.m_checked = now;
+        return;
+    }
+    if (m_capacity == 0) {
+        return;
+    }
+    if (m_entries.size() >= m_capacity) {
+        // Files still being sent stay open until their senders let go.
+        m_entries.erase(m_lru.back());
+        m_lru.pop_back();
+    }
+    m_lru.push_front(path);
+    m_entries.emplace(path, Entry { std::move(file), now, m_lru.begin() });
+}
+
+void FileCache::invalidate(const std::string& path)
+{
+    std::lock_guard lock { m_mutex };
+    if (auto it = m_entries.find(path); it != m_entries.end()) {
+        m_lru.erase(it->second.m_lru);
+        m_entries.erase(it);
+    }
+}
+
+void FileCache::clear()
+{
+    std::lock_guard lock { m_mutex };
+    m_entries.clear();
+    m_lru.clear();
+}
+} // namespace aifs::http
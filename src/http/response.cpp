@@ -1,36 +1,348 @@
 #include "aifs/http/response.h"
 
-#include <sstream>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <ctime>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#include <fmt/format.h>
+
+#include "aifs/http/file_cache.h"
 
 namespace aifs::http {
-Response::Response(StreamSocket& socket)
-    : m_socket{socket}
+namespace {
+    struct Status {
+        unsigned code;
+        std::string_view reason;
+    };
+
+    constexpr Status statuses[] = {
+        { 100, "Continue" },
+        { 101, "Switching Protocols" },
+        { 200, "OK" },
+        { 201, "Created" },
+        { 202, "Accepted" },
+        { 203, "Non-Authoritative Information" },
+        { 204, "No Content" },
+        { 205, "Reset Content" },
+        { 206, "Partial Content" },
+        { 300, "Multiple Choices" },
+        { 301, "Moved Permanently" },
+        { 302, "Found" },
+        { 303, "See Other" },
+        { 304, "Not Modified" },
+        { 307, "Temporary Redirect" },
+        { 308, "Permanent Redirect" },
+        { 400, "Bad Request" },
+        { 401, "Unauthorized" },
+        { 402, "Payment Required" },
+        { 403, "Forbidden" },
+        { 404, "Not Found" },
+        { 405, "Method Not Allowed" },
+        { 406, "Not Acceptable" },
+        { 407, "Proxy Authentication Required" },
+        { 408, "Request Timeout" },
+        { 409, "Conflict" },
+        { 410, "Gone" },
+        { 411, "Length Required" },
+        { 412, "Precondition Failed" },
+        { 413, "Content Too Large" },
+        { 414, "URI Too Long" },
+        { 415, "Unsupported Media Type" },
+        { 416, "Range Not Satisfiable" },
+        { 417, "Expectation Failed" },
+        { 421, "Misdirected Request" },
+        { 422, "Unprocessable Content" },
+        { 426, "Upgrade Required" },
+        { 428, "Precondition Required" },
+        { 429, "Too Many Requests" },
+        { 431, "Request Header Fields Too Large" },
+        { 500, "Internal Server Error" },
+        { 501, "Not Implemented" },
+        { 502, "Bad Gateway" },
+        { 503, "Service Unavailable" },
+        { 504, "Gateway Timeout" },
+        { 505, "HTTP Version Not Supported" },
+    };
+
+    constexpr unsigned min_status = 100;
+    constexpr unsigned max_status = 599;
+
+    // Longest status line: "HTTP/1.1 " + code + ' ' + reason + CRLF.
+    constexpr std::size_t max_status_line = 64;
+
+    struct StatusLine {
+        std::array<char, max_status_line> text {};
+        std::size_t size { 0 };
+    };
+
+    // Status lines for every code, built at compile time. Codes without a
+    // standard reason phrase get an empty one, which RFC 9112 allows.
+    constexpr auto status_lines = [] {
+        std::array<StatusLine, max_status - min_status + 1> lines {};
+        for (unsigned code = min_status; code <= max_status; ++code) {
+            std::string_view reason;
+            for (const auto& status : statuses) {
+                if (status.code == code) {
+                    reason = status.reason;
+                }
+            }
+            auto& line = lines[code - min_status];
+            auto append = [&line](std::string_view s) {
+                for (char c : s) {
+                    line.text[line.size++] = c;
+                }
+            };
+            append("HTTP/1.1 ");
+            line.text[line.size++] = static_cast<char>('0' + code / 100);
+            line.text[line.size++] = static_cast<char>('0' + code / 10 % 10);
+            line.text[line.size++] = static_cast<char>('0' + code % 10);
+            line.text[line.size++] = ' ';
+            append(reason);
+            append("\r\n");
+        }
+        return lines;
+    }();
+
+    std::string_view statusLine(unsigned code)
+    {
+        const auto& line = status_lines[code - min_status];
+        return { line.text.data(), line.size };
+    }
+
+    // "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+    constexpr std::size_t date_line_size = 37;
+
+    /**
+     * The Date header line for the current second. Each thread, and so each
+     * event loop, formats it at most once a second.
+     */
+    std::string_view dateLine()
+    {
+        static constexpr const char* days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+        static constexpr const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+        thread_local std::time_t second = -1;
+        thread_local char line[date_line_size + 1];
+
+        timespec now {};
+        clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        if (now.tv_sec != second) {
+            std::tm tm {};
+            gmtime_r(&now.tv_sec, &tm);
+            fmt::format_to_n(line, sizeof line, "Date: {}, {:02} {} {} {:02}:{:02}:{:02} GMT\r\n",
+                days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+            second = now.tv_sec;
+        }
+        return { line, date_line_size };
+    }
+
+    bool equalFields(std::string_view a, std::string_view b)
+    {
+        return std::ranges::equal(a, b, [](unsigned char x, unsigned char y) { return std::tolower(x) == std::tolower(y); });
+    }
+
+    void append(std::string& buf, std::string_view s)
+    {
+        buf.append(s.data(), s.size());
+    }
+
+    void appendField(std::string& buf, std::string_view field, std::string_view value)
+    {
+        append(buf, field);
+        append(buf, ": ");
+        append(buf, value);
+        append(buf, "\r\n");
+    }
+
+    // FNV-1a, for ETags.
+    std::uint64_t hash(std::string_view data)
+    {
+        std::uint64_t h = 0xcbf29ce484222325;
+        for (unsigned char c : data) {
+            h = (h ^ c) * 0x100000001b3;
+        }
+        return h;
+    }
+
+    // Responses to these have no body, and so no length either.
+    bool bodyless(unsigned status)
+    {
+        return status < 200 || status == 204 || status == 304;
+    }
+} // namespace
+
+Response::Response(OutputQueue& output)
+    : m_output{output}
     , m_sent{false}
+    , m_status{200}
 {}
 
 void Response::setStatus(unsigned statusCode)
 {
+    if (statusCode < min_status || statusCode > max_status) {
+        throw std::invalid_argument(fmt::format("Invalid status code {}", statusCode));
+    }
     m_status = statusCode;
 }
 
-void Response::setHeader(const std::string& field, const std::string& value)
+void Response::setHeader(std::string_view field, std::string_view value)
 {
-    m_headers.emplace(field, value);
+    for (auto& [f, v] : m_headers) {
+        if (equalFields(f, field)) {
+            v = value;
+            return;
+        }
+    }
+    if (m_headers.empty()) {
+        m_headers.reserve(8);
+    }
+    m_headers.emplace_back(field, value);
 }
 
-Task<> Response::send(std::string body)
+std::string Response::header(std::optional<std::size_t> contentLength, std::string_view fields) const
+{
+    if (m_sent || m_streaming) {
+        throw std::runtime_error("Response already sent");
+    }
+
+    auto buf = m_output.buffer();
+    append(buf, statusLine(m_status));
+    for (const auto& [f, v] : m_headers) {
+        appendField(buf, f, v);
+    }
+    append(buf, fields);
+    if (!findHeader("Date")) {
+        append(buf, dateLine());
+    }
+    if (bodyless(m_status)) {
+        append(buf, "\r\n");
+    } else if (contentLength) {
+        fmt::format_to(std::back_inserter(buf), "Content-Length: {}\r\n\r\n", *contentLength);
+    } else {
+        append(buf, "Transfer-Encoding: chunked\r\n\r\n");
+    }
+    return buf;
+}
+
+bool Response::omitsBody() const
 {
-    std::stringstream buf;
-    buf << "HTTP/1.1 " << m_status << " OK\r\n";
+    return m_head || bodyless(m_status);
+}
 
+const std::string* Response::findHeader(std::string_view field) const
+{
     for (const auto& [f, v] : m_headers) {
-        buf << f << ": " << v << "\r\n";
+        if (equalFields(f, field)) {
+            return &v;
+        }
+    }
+    return nullptr;
+}
+
+Task<> Response::send(std::string body)
+{
+    if (m_capture && !findHeader("ETag")) {
+        setHeader("ETag", fmt::format("\"{:016x}\"", hash(body)));
+    }
+    auto head = header(body.size());
+    if (m_capture) {
+        // Connection and Date are set anew for every response sent.
+        Snapshot snapshot { m_status, {}, body, *findHeader("ETag") };
+        for (const auto& [f, v] : m_headers) {
+            if (!equalFields(f, "Connection") && !equalFields(f, "Date")) {
+                appendField(snapshot.fields, f, v);
+            }
+        }
+        std::exchange(m_capture, {})(std::move(snapshot));
+    }
+
+    // The header block and the body go out together, without copying the
+    // body behind the headers first.
+    if (omitsBody()) {
+        co_await m_output.write(std::move(head));
+    } else {
+        m_output.push(std::move(head));
+        co_await m_output.write(std::move(body));
+    }
+    m_sent = true;
+}
+
+Task<> Response::send(const Snapshot& snapshot)
+{
+    m_status = snapshot.status;
+    auto head = header(snapshot.body.size(), snapshot.fields);
+    if (omitsBody()) {
+        co_await m_output.write(std::move(head));
+    } else {
+        m_output.push(std::move(head));
+        co_await m_output.write(snapshot.body);
+    }
+    m_sent = true;
+}
+
+Task<> Response::sendFile(int fd, off_t offset, std::size_t length)
+{
+    auto head = header(length);
+    if (omitsBody()) {
+        co_await m_output.write(std::move(head));
+        m_sent = true;
+        co_return;
     }
-    buf << "Content-Length: " << body.size() << "\r\n";
-    buf << "\r\n";
+    // Whatever is queued has to go out before the file.
+    m_output.push(std::move(head));
+    co_await m_output.flush();
+    co_await m_output.socket().sendFile(fd, offset, length);
+    m_sent = true;
+}
+
+Task<> Response::sendFile(const std::string& path)
+{
+    auto file = CachedFile::open(path);
+    co_await sendFile(file->m_fd, 0, file->size());
+}
 
-    buf << body;
-    co_await m_socket.send(buf.str());
+Task<> Response::write(std::string chunk)
+{
+    if (!m_streaming) {
+        m_output.push(header(std::nullopt));
+        m_streaming = true;
+    }
+    if (m_sent) {
+        throw std::runtime_error("Response already ended");
+    }
+    // An empty chunk would end the body.
+    if (chunk.empty() || omitsBody()) {
+        co_return;
+    }
+    auto size = m_output.buffer();
+    fmt::format_to(std::back_inserter(size), "{:x}\r\n", chunk.size());
+    m_output.push(std::move(size));
+    m_output.push(std::move(chunk));
+    co_await m_output.write("\r\n");
+}
+
+Task<> Response::flush()
+{
+    co_await m_output.flush();
+}
+
+Task<> Response::end()
+{
+    if (m_sent) {
+        co_return;
+    }
+    if (!m_streaming) {
+        m_output.push(header(std::nullopt));
+        m_streaming = true;
+    }
     m_sent = true;
+    if (!omitsBody()) {
+        co_await m_output.write("0\r\n\r\n");
+    }
 }
 }
@@ -0,0 +1,256 @@
+#include "aifs/http/response_cache.h"
+
+#include <http_parser.h>
+
+#include <algorithm>
+#include <cctype>
+#include <exception>
+#include <utility>
+
+namespace aifs::http {
+namespace {
+    bool equalFields(std::string_view a, std::string_view b)
+    {
+        return std::ranges::equal(a, b, [](unsigned char x, unsigned char y) { return std::tolower(x) == std::tolower(y); });
+    }
+
+    std::string_view trim(std::string_view s)
+    {
+        auto first = s.find_first_not_of(" \t");
+        if (first == std::string_view::npos) {
+            return {};
+        }
+        return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+    }
+
+    // Whether pred holds for the value of any field of that name in
+    // serialized header fields.
+    template <typename Pred>
+    bool anyFieldValue(std::string_view fields, std::string_view field, Pred pred)
+    {
+        while (!fields.empty()) {
+            auto end = fields.find("\r\n");
+            auto line = fields.substr(0, end);
+            auto colon = line.find(':');
+            if (colon != std::string_view::npos && equalFields(line.substr(0, colon), field) && pred(trim(line.substr(colon + 1)))) {
+                return true;
+            }
+            fields.remove_prefix(std::min(end + 2, fields.size()));
+        }
+        return false;
+    }
+
+    // Whether an If-None-Match header lists etag, using the weak
+    // comparison of RFC 9110.
+    bool matches(std::string_view tags, std::string_view etag)
+    {
+        auto opaque = [](std::string_view tag) { return tag.starts_with("W/") ? tag.substr(2) : tag; };
+        while (!tags.empty()) {
+            auto comma = tags.find(',');
+            auto tag = trim(tags.substr(0, comma));
+            if (tag == "*" || opaque(tag) == opaque(etag)) {
+                return true;
+            }
+            tags.remove_prefix(std::min(comma, tags.size() - 1) + 1);
+        }
+        return false;
+    }
+
+    // Whether a Cache-Control header keeps a response from being shared,
+    // going by its directives rather than by substrings of them.
+    bool forbidsSharing(std::string_view control)
+    {
+        while (!control.empty()) {
+            auto comma = control.find(',');
+            auto directive = trim(control.substr(0, comma));
+            auto eq = directive.find('=');
+            auto name = trim(directive.substr(0, eq));
+            auto value = eq == std::string_view::npos ? std::string_view {} : trim(directive.substr(eq + 1));
+            if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+                value = value.substr(1, value.size() - 2);
+            }
+            if (equalFields(name, "no-store") || equalFields(name, "private") || equalFields(name, "no-cache")) {
+                return true;
+            }
+            if ((equalFields(name, "max-age") || equalFields(name, "s-maxage")) && value == "0") {
+                return true;
+            }
+            control.remove_prefix(std::min(comma, control.size() - 1) + 1);
+        }
+        return false;
+    }
+
+    bool storable(const Response::Snapshot& response)
+    {
+        if (response.status != 200) {
+            return false;
+        }
+        // A cookie set for one client must not reach another.
+        if (anyFieldValue(response.fields, "Set-Cookie", [](std::string_view) { return true; })) {
+            return false;
+        }
+        return !anyFieldValue(response.fields, "Cache-Control", forbidsSharing);
+    }
+} // namespace
+
+Task<HandlerStatus> ResponseCache::handle(Request& req, Response& resp)
+{
+    if (!cacheable(req)) {
+        co_return co_await m_router.handle(req, resp);
+    }
+
+    auto k = key(req);
+    if (const auto* entry = find(k)) {
+        ++m_stats.hits;
+        co_return co_await reply(req, resp, entry->m_response);
+    }
+
+    if (auto it = m_fetches.find(k); it != m_fetches.end()) {
+        ++m_stats.coalesced;
+        co_await FetchWaiter { &it->second };
+        if (const auto* entry = find(k)) {
+            co_return co_await reply(req, resp, entry->m_response);
+        }
+        // Not cacheable after all.
+        co_return co_await m_router.handle(req, resp);
+    }
+
+    ++m_stats.misses;
+    m_fetches.try_emplace(k);
+    // The waiters go on as soon as the response is known, rather than once
+    // this client, which may be slow, has taken all of it.
+    struct Fetching {
+        const std::string& key;
+        bool finished { false };
+    } fetching { k };
+    resp.capture([this, &fetching](Response::Snapshot response) {
+        if (storable(response)) {
+            insert(fetching.key, std::move(response));
+        }
+        finish(fetching.key);
+        fetching.finished = true;
+    });
+    auto status = HandlerStatus::NotAccepted;
+    std::exception_ptr error;
+    try {
+        status = co_await m_router.handle(req, resp);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    resp.capture(nullptr);
+
+    if (!fetching.finished) {
+        finish(k);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    co_return status;
+}
+
+void ResponseCache::clear()
+{
+    m_entries.clear();
+    m_lru.clear();
+    m_size = 0;
+}
+
+bool ResponseCache::cacheable(const Request& req) const
+{
+    if (req.method() != HTTP_GET) {
+        return false;
+    }
+    // Responses to credentials must not go to other clients.
+    for (std::string_view field : { "Authorization", "Cookie" }) {
+        if (req.header(field)) {
+            auto keyed = std::ranges::any_of(m_options.keyHeaders, [field](const auto& h) { return equalFields(h, field); });
+            if (!keyed) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::string ResponseCache::key(const Request& req) const
+{
+    std::string k { req.url() };
+    for (const auto& field : m_options.keyHeaders) {
+        k += '\n';
+        if (auto value = req.header(field)) {
+            k += *value;
+        }
+    }
+    return k;
+}
+
+const ResponseCache::Entry* ResponseCache::find(const std::string& key)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        return nullptr;
+    }
+    if (m_eventLoop.time() >= it->second.m_expires) {
+        ++m_stats.expirations;
+        erase(it);
+        return nullptr;
+    }
+    m_lru.splice(m_lru.begin(), m_lru, it->second.m_lru);
+    return &it->second;
+}
+
+void ResponseCache::insert(const std::string& key, Response::Snapshot response)
+{
+    // The key is stored twice, in the map and in the LRU list.
+    auto size = 2 * key.size() + response.fields.size() + response.body.size() + response.etag.size();
+    if (size > m_options.maxBytes) {
+        return;
+    }
+    if (auto it = m_entries.find(key); it != m_entries.end()) {
+        erase(it);
+    }
+    while (m_size + size > m_options.maxBytes) {
+        ++m_stats.evictions;
+        erase(m_entries.find(m_lru.back()));
+    }
+
+    m_lru.push_front(key);
+    m_entries.emplace(key,
+        Entry {
+            std::make_shared<const Response::Snapshot>(std::move(response)),
+            size,
+            m_eventLoop.time() + m_options.ttl,
+            m_lru.begin(),
+        });
+    m_size += size;
+}
+
+void ResponseCache::erase(std::unordered_map<std::string, Entry>::iterator it)
+{
+    m_size -= it->second.m_size;
+    m_lru.erase(it->second.m_lru);
+    m_entries.erase(it);
+}
+
+void ResponseCache::finish(const std::string& key)
+{
+    auto it = m_fetches.find(key);
+    for (auto h : it->second.m_waiters) {
+        m_eventLoop.post([h] { h.resume(); });
+    }
+    m_fetches.erase(it);
+}
+
+Task<HandlerStatus> ResponseCache::reply(const Request& req, Response& resp, std::shared_ptr<const Response::Snapshot> response)
+{
+    if (auto tags = req.header("If-None-Match"); tags && matches(*tags, response->etag)) {
+        ++m_stats.notModified;
+        resp.setStatus(304);
+        resp.setHeader("ETag", response->etag);
+        co_await resp.send("");
+        co_return HandlerStatus::Accepted;
+    }
+    co_await resp.send(*response);
+    co_return HandlerStatus::Accepted;
+}
+} // namespace aifs::http
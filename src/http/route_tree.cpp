@@ -0,0 +1,148 @@
+#include "aifs/http/route_tree.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace aifs::http {
+struct RouteTree::Node {
+    // Static text matched on the way to this node; empty for parameters and
+    // wildcards, which have a name instead.
+    std::string prefix;
+    std::string name;
+
+    // Static children, whose prefixes all start with a different character,
+    // listed in indices for a quick scan.
+    std::string indices;
+    std::vector<std::unique_ptr<Node>> children;
+
+    std::unique_ptr<Node> param;
+    std::unique_ptr<Node> wildcard;
+
+    HandlerFn handler;
+
+    const HandlerFn* match(std::string_view path, RouteParams& params) const;
+};
+
+namespace {
+    std::size_t commonPrefix(std::string_view a, std::string_view b)
+    {
+        return static_cast<std::size_t>(std::ranges::mismatch(a, b).in1 - a.begin());
+    }
+} // namespace
+
+RouteTree::RouteTree()
+    : m_root { std::make_unique<Node>() }
+{
+}
+
+RouteTree::~RouteTree() = default;
+
+void RouteTree::insert(std::string_view pattern, HandlerFn fn)
+{
+    auto fail = [pattern](const char* what) {
+        throw std::invalid_argument(std::string { what } + ": " + std::string { pattern });
+    };
+
+    Node* node = m_root.get();
+    std::size_t params = 0;
+    std::string_view rest = pattern;
+    while (!rest.empty()) {
+        if (rest.front() == ':' || rest.front() == '*') {
+            bool wildcard = rest.front() == '*';
+            auto end = wildcard ? rest.size() : std::min(rest.find('/'), rest.size());
+            std::string_view name = rest.substr(1, end - 1);
+            if (wildcard && name.find('/') != std::string_view::npos) {
+                fail("Wildcard not at the end of route");
+            }
+            if (!wildcard && name.empty()) {
+                fail("Unnamed parameter in route");
+            }
+            if (++params > RouteParams::max_params) {
+                fail("Too many parameters in route");
+            }
+            auto& child = wildcard ? node->wildcard : node->param;
+            if (!child) {
+                child = std::make_unique<Node>();
+                child->name = name;
+            } else if (child->name != name) {
+                fail("Conflicting parameter name in route");
+            }
+            node = child.get();
+            rest.remove_prefix(end);
+            continue;
+        }
+
+        auto text = rest.substr(0, rest.find_first_of(":*"));
+        auto index = node->indices.find(text.front());
+        if (index == std::string::npos) {
+            auto child = std::make_unique<Node>();
+            child->prefix = text;
+            node->indices += text.front();
+            node->children.push_back(std::move(child));
+            node = node->children.back().get();
+            rest.remove_prefix(text.size());
+            continue;
+        }
+
+        auto* child = node->children[index].get();
+        auto common = commonPrefix(child->prefix, text);
+        if (common < child->prefix.size()) {
+            // Split the child where the new text diverges.
+            auto split = std::make_unique<Node>();
+            split->prefix = child->prefix.substr(0, common);
+            child->prefix.erase(0, common);
+            split->indices += child->prefix.front();
+            split->children.push_back(std::move(node->children[index]));
+            node->children[index] = std::move(split);
+            child = node->children[index].get();
+        }
+        node = child;
+        rest.remove_prefix(common);
+    }
+
+    if (node->handler) {
+        fail("Route already exists");
+    }
+    node->handler = std::move(fn);
+}
+
+const HandlerFn* RouteTree::find(std::string_view path, RouteParams& params) const
+{
+    return m_root->match(path, params);
+}
+
+const HandlerFn* RouteTree::Node::match(std::string_view path, RouteParams& params) const
+{
+    if (path.empty()) {
+        if (handler) {
+            return &handler;
+        }
+    } else if (auto index = indices.find(path.front()); index != std::string::npos) {
+        const auto& child = *children[index];
+        if (path.starts_with(child.prefix)) {
+            if (auto* found = child.match(path.substr(child.prefix.size()), params)) {
+                return found;
+            }
+        }
+    }
+
+    if (param && !path.empty()) {
+        auto value = path.substr(0, path.find('/'));
+        if (!value.empty()) {
+            params.push(param->name, value);
+            if (auto* found = param->match(path.substr(value.size()), params)) {
+                return found;
+            }
+            params.pop();
+        }
+    }
+
+    if (wildcard && wildcard->handler) {
+        params.push(wildcard->name, path);
+        return &wildcard->handler;
+    }
+    return nullptr;
+}
+} // namespace aifs::http
@@ -0,0 +1,191 @@
+#include "aifs/http/static_files.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <optional>
+#include <system_error>
+#include <utility>
+
+#include <sys/stat.h>
+
+#include <fmt/format.h>
+
+namespace aifs::http {
+namespace {
+    std::optional<std::string> decodePath(std::string_view path)
+    {
+        std::string decoded;
+        decoded.reserve(path.size());
+        for (std::size_t i = 0; i < path.size(); ++i) {
+            if (path[i] != '%') {
+                decoded += path[i];
+                continue;
+            }
+            unsigned value = 0;
+            if (i + 2 >= path.size()
+                || std::from_chars(path.data() + i + 1, path.data() + i + 3, value, 16).ptr != path.data() + i + 3) {
+                return std::nullopt;
+            }
+            decoded += static_cast<char>(value);
+            i += 2;
+        }
+        return decoded;
+    }
+
+    // The path below the root, or nothing if path would leave it.
+    std::optional<std::filesystem::path> relativePath(std::string_view url)
+    {
+        url = url.substr(0, url.find_first_of("?#"));
+        auto decoded = decodePath(url);
+        if (!decoded || decoded->find('\0') != std::string::npos) {
+            return std::nullopt;
+        }
+
+        std::filesystem::path relative;
+        std::string_view rest = *decoded;
+        while (!rest.empty()) {
+            auto end = rest.find('/');
+            auto segment = rest.substr(0, end);
+            rest = end == std::string_view::npos ? std::string_view {} : rest.substr(end + 1);
+            if (segment.empty() || segment == ".") {
+                continue;
+            }
+            if (segment == "..") {
+                return std::nullopt;
+            }
+            relative /= segment;
+        }
+        return relative;
+    }
+
+    std::string_view contentType(const std::filesystem::path& path)
+    {
+        static constexpr std::array<std::pair<std::string_view, std::string_view>, 14> types { {
+            { ".html", "text/html; charset=utf-8" },
+            { ".htm", "text/html; charset=utf-8" },
+            { ".css", "text/css; charset=utf-8" },
+            { ".js", "text/javascript; charset=utf-8" },
+            { ".json", "application/json" },
+            { ".txt", "text/plain; charset=utf-8" },
+            { ".svg", "image/svg+xml" },
+            { ".png", "image/png" },
+            { ".jpg", "image/jpeg" },
+            { ".jpeg", "image/jpeg" },
+            { ".gif", "image/gif" },
+            { ".ico", "image/x-icon" },
+            { ".wasm", "application/wasm" },
+            { ".pdf", "application/pdf" },
+        } };
+        auto extension = path.extension().native();
+        for (const auto& [ext, type] : types) {
+            if (ext == extension) {
+                return type;
+            }
+        }
+        return "application/octet-stream";
+    }
+} // namespace
+
+void StaticFiles::mount(ExpressRouter& router, std::string prefix)
+{
+    router.use(prefix, [this, prefix](const Request& req, Response& resp) {
+        return serve(std::string_view { req.url() }.substr(prefix.size()), req, resp);
+    });
+}
+
+Task<HandlerStatus> StaticFiles::serve(std::string_view path, const Request& req, Response& resp)
+{
+    auto relative = relativePath(path);
+    if (!relative) {
+        co_return HandlerStatus::NotAccepted;
+    }
+
+    auto filePath = m_root / *relative;
+    std::shared_ptr<const CachedFile> file;
+    try {
+        file = m_cache.open(filePath);
+        if (S_ISDIR(file->m_stat.st_mode)) {
+            filePath /= "index.html";
+            file = m_cache.open(filePath);
+        }
+    } catch (const std::system_error&) {
+        co_return HandlerStatus::NotAccepted;
+    }
+    if (!S_ISREG(file->m_stat.st_mode)) {
+        co_return HandlerStatus::NotAccepted;
+    }
+
+    auto size = file->size();
+    detail::ByteRange range;
+    if (auto header = req.header("Range")) {
+        range = detail::parseRange(*header, size);
+    }
+
+    resp.setHeader("Content-Type", std::string { contentType(filePath) });
+    resp.setHeader("Accept-Ranges", "bytes");
+    switch (range.kind) {
+    case detail::ByteRange::whole:
+        resp.setStatus(200);
+        co_await resp.sendFile(file->m_fd, 0, size);
+        break;
+    case detail::ByteRange::partial:
+        resp.setStatus(206);
+        resp.setHeader("Content-Range", fmt::format("bytes {}-{}/{}", range.first, range.last, size));
+        co_await resp.sendFile(file->m_fd, static_cast<off_t>(range.first), range.last - range.first + 1);
+        break;
+    case detail::ByteRange::unsatisfiable:
+        resp.setStatus(416);
+        resp.setHeader("Content-Range", fmt::format("bytes */{}", size));
+        co_await resp.send("");
+        break;
+    }
+    co_return HandlerStatus::Accepted;
+}
+
+namespace detail {
+    ByteRange parseRange(std::string_view header, std::size_t size)
+    {
+        constexpr std::string_view unit = "bytes=";
+        if (!header.starts_with(unit) || header.find(',') != std::string_view::npos) {
+            return {};
+        }
+        auto spec = header.substr(unit.size());
+        auto dash = spec.find('-');
+        if (dash == std::string_view::npos) {
+            return {};
+        }
+
+        auto parse = [](std::string_view s, std::size_t& value) {
+            auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+            return !s.empty() && ec == std::errc {} && ptr == s.data() + s.size();
+        };
+        auto firstText = spec.substr(0, dash);
+        auto lastText = spec.substr(dash + 1);
+        std::size_t first = 0;
+        std::size_t last = 0;
+
+        if (firstText.empty()) {
+            // Suffix range: the final last bytes.
+            if (!parse(lastText, last)) {
+                return {};
+            }
+            if (last == 0 || size == 0) {
+                return { ByteRange::unsatisfiable };
+            }
+            return { ByteRange::partial, size - std::min(last, size), size - 1 };
+        }
+
+        if (!parse(firstText, first) || (!lastText.empty() && (!parse(lastText, last) || last < first))) {
+            return {};
+        }
+        if (first >= size) {
+            return { ByteRange::unsatisfiable };
+        }
+        if (lastText.empty() || last >= size) {
+            last = size - 1;
+        }
+        return { ByteRange::partial, first, last };
+    }
+} // namespace detail
+} // namespace aifs::http
@@ -0,0 +1,501 @@
+#include "aifs/io_uring_reactor.h"
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+namespace aifs {
+namespace detail {
+    // The low bits of an SQE's user_data tell what completed. Registrations
+    // and accept queues are at least 8 byte aligned, which leaves room for a
+    // tag. Cancel requests are internal, with the registration of the
+    // descriptor they cancel for, if any.
+    constexpr std::uint64_t tag_internal = 0;
+    constexpr std::uint64_t tag_io = 1; // + OpType
+    constexpr std::uint64_t tag_poll = 4; // + OpType
+    constexpr std::uint64_t tag_accept = 7;
+    constexpr std::uint64_t tag_mask = 7;
+
+    inline std::uint64_t user_data(const void* p, std::uint64_t tag)
+    {
+        return reinterpret_cast<std::uint64_t>(p) | tag;
+    }
+
+    inline int io_uring_setup(unsigned entries, io_uring_params* p)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+    }
+
+    inline int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, std::size_t argsz)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz));
+    }
+
+    inline int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    constexpr std::uint32_t to_poll(OpType type)
+    {
+        switch (type) {
+        case read_op:
+            return POLLIN | POLLRDHUP;
+        case write_op:
+            return POLLOUT;
+        default:
+            return POLLPRI;
+        }
+    }
+
+    void check_support(int fd, unsigned features)
+    {
+        if ((features & IORING_FEAT_EXT_ARG) == 0 || (features & IORING_FEAT_NODROP) == 0) {
+            throw std::system_error(ENOTSUP, std::generic_category(), "io_uring: kernel too old");
+        }
+
+        constexpr unsigned num_ops = 256;
+        std::vector<char> buf(sizeof(io_uring_probe) + num_ops * sizeof(io_uring_probe_op));
+        auto* probe = reinterpret_cast<io_uring_probe*>(buf.data());
+        if (io_uring_register(fd, IORING_REGISTER_PROBE, probe, num_ops) < 0) {
+            throw std::system_error(errno, std::generic_category(), "io_uring_register");
+        }
+        for (auto op : { IORING_OP_RECV, IORING_OP_SEND, IORING_OP_RECVMSG, IORING_OP_SENDMSG, IORING_OP_ACCEPT, IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL }) {
+            if (op >= probe->ops_len || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+                throw std::system_error(ENOTSUP, std::generic_category(), "io_uring: missing opcode");
+            }
+        }
+    }
+} // namespace detail
+
+IoUringReactor::IoUringReactor(unsigned entries)
+    : m_fd { -1 }
+    , m_features { 0 }
+    , m_sqRing { MAP_FAILED }
+    , m_sqRingSize { 0 }
+    , m_cqRing { MAP_FAILED }
+    , m_cqRingSize { 0 }
+    , m_sqes { nullptr }
+    , m_sqesSize { 0 }
+    , m_sqHead { nullptr }
+    , m_sqTail { nullptr }
+    , m_sqMask { 0 }
+    , m_sqEntries { 0 }
+    , m_cqHead { nullptr }
+    , m_cqTail { nullptr }
+    , m_cqMask { 0 }
+    , m_cqes { nullptr }
+    , m_toSubmit { 0 }
+    , m_multishotAccept { true }
+{
+    io_uring_params params {};
+    m_fd = detail::io_uring_setup(entries, &params);
+    if (m_fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+    }
+
+    try {
+        detail::check_support(m_fd, params.features);
+        m_features = params.features;
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (m_features & IORING_FEAT_SINGLE_MMAP) {
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        }
+
+        m_sqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap");
+        }
+        if (m_features & IORING_FEAT_SINGLE_MMAP) {
+            m_cqRing = m_sqRing;
+        } else {
+            m_cqRing = ::mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+            if (m_cqRing == MAP_FAILED) {
+                throw std::system_error(errno, std::generic_category(), "mmap");
+            }
+        }
+
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap");
+        }
+        m_sqes = static_cast<io_uring_sqe*>(sqes);
+    } catch (...) {
+        release();
+        throw;
+    }
+
+    auto* sq = static_cast<char*>(m_sqRing);
+    m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sqEntries = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+
+    // SQEs are always used in ring order, so the indirection array is the
+    // identity mapping.
+    auto* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < m_sqEntries; ++i) {
+        array[i] = i;
+    }
+
+    auto* cq = static_cast<char*>(m_cqRing);
+    m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+IoUringReactor::~IoUringReactor()
+{
+    for (auto& [_, queue] : m_acceptQueues) {
+        for (int fd : queue->backlog) {
+            ::close(fd);
+        }
+    }
+    release();
+}
+
+void IoUringReactor::release()
+{
+    if (m_sqes) {
+        ::munmap(m_sqes, m_sqesSize);
+    }
+    if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) {
+        ::munmap(m_cqRing, m_cqRingSize);
+    }
+    if (m_sqRing != MAP_FAILED) {
+        ::munmap(m_sqRing, m_sqRingSize);
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+bool IoUringReactor::supported()
+{
+    try {
+        IoUringReactor probe { 2 };
+        return true;
+    } catch (const std::system_error&) {
+        return false;
+    }
+}
+
+io_uring_sqe* IoUringReactor::nextSqe()
+{
+    unsigned tail = *m_sqTail;
+    unsigned head = std::atomic_ref { *m_sqHead }.load(std::memory_order_acquire);
+    if (tail - head == m_sqEntries) {
+        // The submission queue is full, hand what we have to the kernel
+        // without waiting for completions.
+        if (detail::io_uring_enter(m_fd, m_toSubmit, 0, 0, nullptr, 0) < 0) {
+            throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+        }
+        m_toSubmit = tail - std::atomic_ref { *m_sqHead }.load(std::memory_order_acquire);
+    }
+
+    auto* sqe = &m_sqes[tail & m_sqMask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    std::atomic_ref { *m_sqTail }.store(tail + 1, std::memory_order_release);
+    ++m_toSubmit;
+    return sqe;
+}
+
+bool IoUringReactor::submit(Descriptor* desc, OpType type, const IoRequest& io, Operation* op)
+{
+    if (io.kind == IoRequest::accept && m_multishotAccept) {
+        auto& queue = m_acceptQueues[desc];
+        if (!queue) {
+            queue = std::make_unique<AcceptQueue>(AcceptQueue { desc });
+        }
+        queue->waiter = op;
+        if (!queue->backlog.empty()) {
+            op->completion = queue->backlog.front();
+            queue->backlog.pop_front();
+            queue->waiter = nullptr;
+            m_immediate.push_back({ desc, opMask(type) });
+        } else if (!queue->armed) {
+            armAccept(*queue);
+        }
+        return true;
+    }
+
+    auto& reg = registration(desc);
+    auto* sqe = nextSqe();
+    ++reg.inFlight;
+    sqe->fd = desc->m_fd;
+    sqe->user_data = detail::user_data(&reg, detail::tag_io + type);
+    switch (io.kind) {
+    case IoRequest::poll:
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = detail::to_poll(type);
+        sqe->user_data = detail::user_data(&reg, detail::tag_poll + type);
+        break;
+    case IoRequest::receive:
+        sqe->opcode = IORING_OP_RECV;
+        sqe->addr = reinterpret_cast<std::uint64_t>(io.data);
+        sqe->len = static_cast<std::uint32_t>(io.size);
+        break;
+    case IoRequest::send:
+        sqe->opcode = IORING_OP_SEND;
+        sqe->addr = reinterpret_cast<std::uint64_t>(io.data);
+        sqe->len = static_cast<std::uint32_t>(io.size);
+        sqe->msg_flags = MSG_NOSIGNAL;
+        break;
+    case IoRequest::receive_msg:
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->addr = reinterpret_cast<std::uint64_t>(io.data);
+        sqe->len = 1;
+        break;
+    case IoRequest::send_msg:
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->addr = reinterpret_cast<std::uint64_t>(io.data);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        break;
+    case IoRequest::accept:
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        break;
+    }
+    return true;
+}
+
+void IoUringReactor::armAccept(AcceptQueue& queue)
+{
+    auto* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = queue.desc->m_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = detail::user_data(&queue, detail::tag_accept);
+    queue.armed = true;
+}
+
+IoUringReactor::Registration& IoUringReactor::registration(Descriptor* desc)
+{
+    if (!desc->m_backend) {
+        auto reg = std::make_unique<Registration>(Registration { desc });
+        desc->m_backend = reg.get();
+        m_registrations.emplace(reg.get(), std::move(reg));
+    }
+    return *static_cast<Registration*>(desc->m_backend);
+}
+
+void IoUringReactor::cancelRequest(std::uint64_t userData, Registration* reg)
+{
+    auto* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData;
+    sqe->user_data = detail::user_data(reg, detail::tag_internal);
+    if (reg) {
+        // The canceled request may complete at once, and the registration
+        // has to outlive the cancel's reference to it.
+        ++reg->inFlight;
+    }
+}
+
+bool IoUringReactor::cancel(Descriptor* desc, OpType type, Operation* op)
+{
+    if (auto it = m_acceptQueues.find(desc); it != m_acceptQueues.end() && it->second->waiter == op) {
+        auto& queue = *it->second;
+        queue.waiter = nullptr;
+        op->ec = std::make_error_code(std::errc::operation_canceled);
+        m_immediate.push_back({ desc, opMask(type) });
+        // Nobody is accepting any more, so stop taking connections as well.
+        if (queue.armed) {
+            cancelRequest(detail::user_data(&queue, detail::tag_accept));
+        }
+        return true;
+    }
+
+    // The operation is either waiting for readiness or performing I/O. Only
+    // one of the two cancellations will find it.
+    auto& reg = registration(desc);
+    cancelRequest(detail::user_data(&reg, detail::tag_io + type), &reg);
+    cancelRequest(detail::user_data(&reg, detail::tag_poll + type), &reg);
+    return true;
+}
+
+void IoUringReactor::deregister(Descriptor* desc)
+{
+    std::erase_if(m_immediate, [desc](const Event& event) { return event.desc == desc; });
+
+    if (auto* reg = static_cast<Registration*>(std::exchange(desc->m_backend, nullptr))) {
+        if (reg->inFlight == 0) {
+            m_registrations.erase(reg);
+        } else {
+            reg->desc = nullptr;
+            for (int i = 0; i < max_op; ++i) {
+                if (desc->m_ops[i]) {
+                    reg->orphans[i] = std::exchange(desc->m_ops[i], nullptr);
+                    cancelRequest(detail::user_data(reg, detail::tag_io + i), reg);
+                    cancelRequest(detail::user_data(reg, detail::tag_poll + i), reg);
+                }
+            }
+        }
+    }
+
+    auto it = m_acceptQueues.find(desc);
+    if (it == m_acceptQueues.end()) {
+        return;
+    }
+
+    auto queue = std::move(it->second);
+    m_acceptQueues.erase(it);
+    for (int fd : queue->backlog) {
+        ::close(fd);
+    }
+    queue->backlog.clear();
+    if (queue->armed) {
+        // Keep the queue alive until the kernel reports the multishot request
+        // as finished.
+        cancelRequest(detail::user_data(queue.get(), detail::tag_accept));
+        queue->closed = true;
+        m_closedQueues.push_back(std::move(queue));
+    }
+}
+
+void IoUringReactor::wait(Timeout timeout, std::vector<Event>& events)
+{
+    unsigned head = *m_cqHead;
+    bool have_completions = !m_immediate.empty()
+        || head != std::atomic_ref { *m_cqTail }.load(std::memory_order_acquire);
+
+    unsigned flags = 0;
+    unsigned min_complete = 0;
+    __kernel_timespec ts {};
+    io_uring_getevents_arg arg {};
+    if (!have_completions) {
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        min_complete = 1;
+        if (timeout) {
+            auto sec = std::chrono::duration_cast<std::chrono::seconds>(*timeout);
+            ts.tv_sec = sec.count();
+            ts.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(*timeout - sec).count();
+            arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+        }
+    }
+
+    if (m_toSubmit > 0 || min_complete > 0) {
+        int ret = detail::io_uring_enter(m_fd, m_toSubmit, min_complete, flags,
+            flags ? &arg : nullptr, flags ? sizeof(arg) : 0);
+        if (ret < 0 && errno != EINTR && errno != ETIME && errno != EAGAIN && errno != EBUSY) {
+            throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+        }
+        m_toSubmit = *m_sqTail - std::atomic_ref { *m_sqHead }.load(std::memory_order_acquire);
+    }
+
+    events.insert(events.end(), m_immediate.begin(), m_immediate.end());
+    m_immediate.clear();
+
+    unsigned tail = std::atomic_ref { *m_cqTail }.load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+        complete(m_cqes[head & m_cqMask], events);
+    }
+    std::atomic_ref { *m_cqHead }.store(head, std::memory_order_release);
+}
+
+void IoUringReactor::complete(const io_uring_cqe& cqe, std::vector<Event>& events)
+{
+    auto tag = cqe.user_data & detail::tag_mask;
+    auto* ptr = reinterpret_cast<void*>(cqe.user_data & ~detail::tag_mask);
+
+    if (tag == detail::tag_accept) {
+        completeAccept(*static_cast<AcceptQueue*>(ptr), cqe, events);
+        return;
+    }
+    auto* reg = static_cast<Registration*>(ptr);
+    if (!reg) {
+        return;
+    }
+
+    --reg->inFlight;
+    auto* desc = reg->desc;
+    if (tag == detail::tag_internal) {
+        if (!desc && reg->inFlight == 0) {
+            m_registrations.erase(reg);
+        }
+        return;
+    }
+
+    auto type = static_cast<OpType>(tag >= detail::tag_poll ? tag - detail::tag_poll : tag - detail::tag_io);
+    if (!desc) {
+        // The kernel is done with the request, and so with the operation's
+        // buffers.
+        if (auto* op = std::exchange(reg->orphans[type], nullptr)) {
+            op->ec = std::make_error_code(std::errc::operation_canceled);
+            events.push_back({ nullptr, 0, op });
+        }
+        if (reg->inFlight == 0) {
+            m_registrations.erase(reg);
+        }
+        return;
+    }
+
+    auto* op = desc->m_ops[type];
+    if (!op) {
+        return;
+    }
+    if (cqe.res == -ECANCELED) {
+        op->ec = std::make_error_code(std::errc::operation_canceled);
+    } else if (tag < detail::tag_poll) {
+        op->completion = cqe.res;
+    }
+    // Poll results only signal readiness; the operation does its own I/O.
+    events.push_back({ desc, opMask(type) });
+}
+
+void IoUringReactor::completeAccept(AcceptQueue& queue, const io_uring_cqe& cqe, std::vector<Event>& events)
+{
+    if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+        queue.armed = false;
+    }
+
+    if (queue.closed) {
+        if (cqe.res >= 0) {
+            ::close(cqe.res);
+        }
+        if (!queue.armed) {
+            std::erase_if(m_closedQueues, [&](const auto& q) { return q.get() == &queue; });
+        }
+        return;
+    }
+
+    if (cqe.res == -EINVAL && !queue.armed && queue.waiter) {
+        // Multishot accept needs Linux 5.19. Fall back to one request per
+        // accept for every listener from now on.
+        m_multishotAccept = false;
+        auto* op = std::exchange(queue.waiter, nullptr);
+        submit(queue.desc, read_op, IoRequest { IoRequest::accept }, op);
+        return;
+    }
+
+    if (cqe.res != -ECANCELED) {
+        if (auto* op = std::exchange(queue.waiter, nullptr)) {
+            op->completion = cqe.res;
+            events.push_back({ queue.desc, opMask(read_op) });
+        } else if (cqe.res >= 0) {
+            queue.backlog.push_back(cqe.res);
+        }
+    }
+
+    if (!queue.armed && queue.waiter && m_multishotAccept) {
+        armAccept(queue);
+    }
+}
+} // namespace aifs
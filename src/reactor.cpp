@@ -0,0 +1,255 @@
+#include "aifs/reactor.h"
+
+#include <spdlog/spdlog.h>
+#include <sys/select.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+
+#include "aifs/io_uring_reactor.h"
+
+namespace aifs {
+namespace detail {
+    template <typename Duration>
+    void to_timeval(Duration&& d, struct timeval& tv)
+    {
+        std::chrono::seconds const sec = std::chrono::duration_cast<std::chrono::seconds>(d);
+        tv.tv_sec = sec.count();
+        tv.tv_usec = std::chrono::duration_cast<std::chrono::microseconds>(d - sec).count();
+    }
+
+    constexpr uint32_t to_epoll(unsigned mask)
+    {
+        uint32_t events = 0;
+        if (mask & opMask(read_op)) {
+            events |= EPOLLIN | EPOLLRDHUP;
+        }
+        if (mask & opMask(write_op)) {
+            events |= EPOLLOUT;
+        }
+        if (mask & opMask(pri_op)) {
+            events |= EPOLLPRI;
+        }
+        return events;
+    }
+} // namespace detail
+
+void SelectReactor::update(Descriptor* desc)
+{
+    if (desc->m_interest == 0) {
+        m_descriptors.erase(desc);
+        return;
+    }
+    if (desc->m_fd < 0 || desc->m_fd >= FD_SETSIZE) {
+        throw std::system_error(EBADF, std::generic_category(), "select: descriptor out of range");
+    }
+    m_descriptors.insert(desc);
+}
+
+void SelectReactor::deregister(Descriptor* desc)
+{
+    m_descriptors.erase(desc);
+    desc->m_interest = 0;
+}
+
+void SelectReactor::wait(Timeout timeout, std::vector<Event>& events)
+{
+    // Build the fd_sets based on pending operations.
+    int max_fd = -1;
+    fd_set fd_sets[max_op];
+    for (int i = 0; i < max_op; ++i) {
+        FD_ZERO(&fd_sets[i]);
+    }
+    for (auto* desc : m_descriptors) {
+        for (int i = 0; i < max_op; ++i) {
+            if (desc->m_interest & opMask(static_cast<OpType>(i))) {
+                FD_SET(desc->m_fd, &fd_sets[i]);
+            }
+        }
+        if (desc->m_fd > max_fd) {
+            max_fd = desc->m_fd;
+        }
+    }
+
+    struct timeval to = { 0, 0 };
+    struct timeval* tv = nullptr;
+    if (timeout) {
+        detail::to_timeval(*timeout, to);
+        tv = &to;
+    }
+
+    int num_events = ::select(max_fd + 1, &fd_sets[0], &fd_sets[1], &fd_sets[2], tv);
+    if (num_events < 0) {
+        if (errno == EINTR) {
+            return;
+        }
+        throw std::system_error(errno, std::generic_category(), "select");
+    }
+    if (num_events == 0) {
+        return;
+    }
+
+    for (auto* desc : m_descriptors) {
+        unsigned ready = 0;
+        for (int i = 0; i < max_op; ++i) {
+            if (FD_ISSET(desc->m_fd, &fd_sets[i]) != 0) {
+                ready |= opMask(static_cast<OpType>(i));
+            }
+        }
+        if (ready) {
+            events.push_back({ desc, ready });
+        }
+    }
+}
+
+EpollReactor::EpollReactor()
+    : m_epfd { ::epoll_create1(EPOLL_CLOEXEC) }
+    , m_pwait2 { true }
+    , m_events {}
+{
+    if (m_epfd < 0) {
+        throw std::system_error(errno, std::generic_category(), "epoll_create1");
+    }
+}
+
+EpollReactor::~EpollReactor()
+{
+    ::close(m_epfd);
+}
+
+void EpollReactor::update(Descriptor* desc)
+{
+    // Only ever widen the registration here; stale interest is dropped in
+    // wait() once the kernel reports it.
+    if ((desc->m_interest & ~desc->m_armed) == 0) {
+        return;
+    }
+    control(desc, desc->m_armed | desc->m_interest);
+}
+
+void EpollReactor::control(Descriptor* desc, unsigned armed)
+{
+    if (armed == 0) {
+        if (desc->m_registered) {
+            // The descriptor may already be closed, which removed it from the
+            // epoll set, so failure here is not an error.
+            ::epoll_ctl(m_epfd, EPOLL_CTL_DEL, desc->m_fd, nullptr);
+        }
+        desc->m_registered = false;
+        desc->m_armed = 0;
+        return;
+    }
+
+    epoll_event ev {};
+    ev.events = detail::to_epoll(armed);
+    ev.data.ptr = desc;
+
+    int ret = ::epoll_ctl(m_epfd, desc->m_registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, desc->m_fd, &ev);
+    if (ret < 0 && errno == EEXIST) {
+        ret = ::epoll_ctl(m_epfd, EPOLL_CTL_MOD, desc->m_fd, &ev);
+    } else if (ret < 0 && errno == ENOENT) {
+        ret = ::epoll_ctl(m_epfd, EPOLL_CTL_ADD, desc->m_fd, &ev);
+    }
+    if (ret < 0) {
+        throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+    }
+    desc->m_registered = true;
+    desc->m_armed = armed;
+}
+
+void EpollReactor::deregister(Descriptor* desc)
+{
+    desc->m_interest = 0;
+    control(desc, 0);
+}
+
+void EpollReactor::wait(Timeout timeout, std::vector<Event>& events)
+{
+    int num_events = -1;
+#ifdef SYS_epoll_pwait2
+    if (m_pwait2) {
+        // epoll_pwait2() (Linux 5.11) takes the timeout with nanosecond
+        // resolution, so sub-millisecond timers don't wake up early.
+        struct timespec ts {};
+        struct timespec* tsp = nullptr;
+        if (timeout) {
+            auto sec = std::chrono::duration_cast<std::chrono::seconds>(*timeout);
+            ts.tv_sec = sec.count();
+            ts.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(*timeout - sec).count();
+            tsp = &ts;
+        }
+        num_events = static_cast<int>(::syscall(SYS_epoll_pwait2, m_epfd, m_events, max_events, tsp, nullptr, 0));
+        if (num_events < 0 && errno == ENOSYS) {
+            m_pwait2 = false;
+        }
+    }
+#else
+    m_pwait2 = false;
+#endif
+    if (!m_pwait2) {
+        int timeout_ms = -1;
+        if (timeout) {
+            // Round up, waking up before the deadline would just spin.
+            auto ms = std::chrono::ceil<std::chrono::milliseconds>(*timeout).count();
+            timeout_ms = static_cast<int>(std::min<decltype(ms)>(ms, std::numeric_limits<int>::max()));
+        }
+        num_events = ::epoll_wait(m_epfd, m_events, max_events, timeout_ms);
+    }
+    if (num_events < 0) {
+        if (errno == EINTR) {
+            return;
+        }
+        throw std::system_error(errno, std::generic_category(), "epoll_wait");
+    }
+
+    for (int i = 0; i < num_events; ++i) {
+        auto* desc = static_cast<Descriptor*>(m_events[i].data.ptr);
+        auto what = m_events[i].events;
+
+        unsigned fired = 0;
+        if (what & (EPOLLIN | EPOLLRDHUP)) {
+            fired |= opMask(read_op);
+        }
+        if (what & EPOLLOUT) {
+            fired |= opMask(write_op);
+        }
+        if (what & EPOLLPRI) {
+            fired |= opMask(pri_op);
+        }
+        if (what & (EPOLLERR | EPOLLHUP)) {
+            // Let every waiting operation observe the error from its syscall.
+            fired |= desc->m_armed;
+        }
+
+        if (auto ready = fired & desc->m_interest) {
+            events.push_back({ desc, ready });
+        }
+        if (fired & ~desc->m_interest) {
+            control(desc, desc->m_interest);
+        }
+    }
+}
+
+std::unique_ptr<Reactor> makeReactor(Backend backend)
+{
+    switch (backend) {
+    case Backend::select:
+        return std::make_unique<SelectReactor>();
+    case Backend::epoll:
+        return std::make_unique<EpollReactor>();
+    case Backend::io_uring:
+        try {
+            return std::make_unique<IoUringReactor>();
+        } catch (const std::system_error& e) {
+            spdlog::warn("io_uring unavailable ({}), falling back to epoll", e.what());
+            return std::make_unique<EpollReactor>();
+        }
+    }
+    throw std::invalid_argument("unknown reactor backend");
+}
+} // namespace aifs
@@ -0,0 +1,141 @@
+#include "aifs/work_stealing_executor.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <exception>
+
+namespace aifs {
+namespace {
+    // The executor and index of the worker running on this thread, if any.
+    struct CurrentWorker {
+        WorkStealingExecutor* executor { nullptr };
+        std::size_t index { 0 };
+    };
+
+    thread_local CurrentWorker t_current;
+} // namespace
+
+WorkStealingExecutor::WorkStealingExecutor(std::size_t threads)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_workers.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    for (std::size_t i = 0; i < threads; ++i) {
+        m_workers[i]->m_thread = std::thread { [this, i] { run(i); } };
+    }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor()
+{
+    m_stopping = true;
+    m_epoch.fetch_add(1);
+    m_epoch.notify_all();
+    for (auto& worker : m_workers) {
+        worker->m_thread.join();
+    }
+}
+
+void WorkStealingExecutor::enqueue(PostedOperation* op)
+{
+    // Work created on a worker stays on it unless someone steals it.
+    if (t_current.executor == this) {
+        m_workers[t_current.index]->m_deque.push(op);
+    } else {
+        m_injected.push(op);
+    }
+    notify();
+}
+
+void WorkStealingExecutor::notify()
+{
+    // Pairs with the check for work an idle worker makes after announcing
+    // itself, so that either it finds the new work or it is woken up here.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_idle.load() > 0) {
+        m_epoch.fetch_add(1);
+        m_epoch.notify_one();
+    }
+}
+
+void WorkStealingExecutor::run(std::size_t index)
+{
+    t_current = { this, index };
+    for (;;) {
+        auto* op = findWork(index);
+        if (!op) {
+            auto epoch = m_epoch.load();
+            ++m_idle;
+            op = findWork(index);
+            if (!op) {
+                if (m_stopping) {
+                    --m_idle;
+                    break;
+                }
+                m_epoch.wait(epoch);
+                --m_idle;
+                continue;
+            }
+            --m_idle;
+        }
+
+        try {
+            op->perform(op->ec);
+        } catch (const std::exception& e) {
+            spdlog::error("Executor worker {} got exception: {}", index, e.what());
+        }
+    }
+    t_current = {};
+}
+
+PostedOperation* WorkStealingExecutor::findWork(std::size_t index)
+{
+    auto& self = *m_workers[index];
+    if (auto* op = self.m_deque.pop()) {
+        return op;
+    }
+    if (auto* op = takeInjected(self)) {
+        return op;
+    }
+    // Start with the next worker, so that thieves spread over the victims.
+    for (std::size_t i = 1; i < m_workers.size(); ++i) {
+        if (auto* op = m_workers[(index + i) % m_workers.size()]->m_deque.steal()) {
+            return op;
+        }
+    }
+    return nullptr;
+}
+
+PostedOperation* WorkStealingExecutor::takeInjected(Worker& worker)
+{
+    if (m_injectedBusy.test_and_set(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    // Move everything to this worker's deque, where the others can steal it.
+    auto* first = m_injected.pop();
+    bool more = false;
+    if (first) {
+        while (auto* op = m_injected.pop()) {
+            worker.m_deque.push(op);
+            more = true;
+        }
+    }
+    m_injectedBusy.clear();
+
+    // Work injected while the queue was taken may have been missed by a
+    // worker that found it busy. Whoever holds the queue now checks again
+    // once it lets go.
+    if (!more && !m_injectedBusy.test_and_set(std::memory_order_acquire)) {
+        more = !m_injected.empty();
+        m_injectedBusy.clear();
+    }
+    if (more) {
+        notify();
+    }
+    return first;
+}
+} // namespace aifs
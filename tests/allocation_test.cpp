@@ -0,0 +1,213 @@
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+
+#include "aifs/event_loop.h"
+#include "aifs/http/express_router.h"
+#include "aifs/http/http_connection.h"
+#include "aifs/steady_timer.h"
+#include "aifs/task.h"
+#include "aifs/tcp_acceptor.h"
+#include "aifs/tcp_socket.h"
+#include "aifs/unix_socket.h"
+
+// Replacing the global allocation functions counts every allocation in this
+// test program, which is why it is one of its own.
+namespace {
+std::size_t allocations = 0;
+
+void* allocate(std::size_t n)
+{
+    ++allocations;
+    if (void* p = std::malloc(n ? n : 1)) {
+        return p;
+    }
+    throw std::bad_alloc {};
+}
+
+void* allocate(std::size_t n, std::align_val_t align)
+{
+    ++allocations;
+    auto a = static_cast<std::size_t>(align);
+    if (void* p = std::aligned_alloc(a, (n + a - 1) / a * a)) {
+        return p;
+    }
+    throw std::bad_alloc {};
+}
+} // namespace
+
+void* operator new(std::size_t n) { return allocate(n); }
+void* operator new[](std::size_t n) { return allocate(n); }
+void* operator new(std::size_t n, std::align_val_t align) { return allocate(n, align); }
+void* operator new[](std::size_t n, std::align_val_t align) { return allocate(n, align); }
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept { return std::malloc(n ? n : 1); }
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept { return std::malloc(n ? n : 1); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+using namespace aifs;
+
+namespace {
+// A port nothing listens on, for the acceptor to bind.
+int freePort()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ::bind(fd, reinterpret_cast<sockaddr*>(&addr), len);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    ::close(fd);
+    return ntohs(addr.sin_port);
+}
+
+int connectTo(int port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<unsigned short>(port));
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        ADD_FAILURE() << "connect failed";
+    }
+    return fd;
+}
+
+struct Counts {
+    std::size_t accept { 0 };
+    std::size_t io { 0 };
+};
+
+// Accept a connection, then exchange data over it and wait for a timer,
+// through the concrete types and through the interfaces. Adds what each
+// part allocated to counts.
+Task<> roundTrip(EventLoop& ev, TCPAcceptor& acceptor, int port, Counts& counts)
+{
+    int client = connectTo(port);
+    char buf[16];
+
+    auto before = allocations;
+    auto socket = co_await acceptor.accept();
+    counts.accept += allocations - before;
+
+    before = allocations;
+    EXPECT_EQ(::write(client, "ping", 4), 4);
+    EXPECT_EQ(co_await socket->receive(buf), 4);
+    EXPECT_EQ(co_await socket->send({ "pong", 4 }), 4);
+    EXPECT_EQ(::read(client, buf, sizeof buf), 4);
+
+    StreamSocket& stream = *socket;
+    EXPECT_EQ(::write(client, "ping", 4), 4);
+    EXPECT_EQ(co_await stream.receive(buf), 4);
+    EXPECT_EQ(co_await stream.send({ "pong", 4 }), 4);
+    EXPECT_EQ(::read(client, buf, sizeof buf), 4);
+
+    SteadyTimer timer { ev, std::chrono::microseconds(1) };
+    co_await timer.wait();
+    Timer& erased = timer;
+    co_await erased.wait();
+    counts.io += allocations - before;
+
+    socket->close();
+    ::close(client);
+}
+} // namespace
+
+// Only the accepted socket is allocated; operations on it and on timers
+// are not, once the coroutine frame pools are warm. The rounds go on well
+// past the size at which a queue of the loop or the acceptor would need
+// more memory, had it not kept what it had.
+TEST(Allocation, RoundTripAllocatesOnlyTheAcceptedSocket)
+{
+#ifdef AIFS_NO_FRAME_POOL
+    GTEST_SKIP() << "Coroutine frames are allocated without AIFS_FRAME_POOL";
+#endif
+    EventLoop ev;
+    int port = freePort();
+    TCPAcceptor acceptor { ev, port, { .address = "127.0.0.1" } };
+
+    constexpr std::size_t warmup = 4;
+    constexpr std::size_t rounds = 200;
+    Counts warm;
+    Counts counts;
+    ev.spawn([](EventLoop& ev, TCPAcceptor& acceptor, int port, Counts& warm, Counts& counts) -> Task<> {
+        for (std::size_t i = 0; i < warmup; ++i) {
+            co_await roundTrip(ev, acceptor, port, warm);
+        }
+        for (std::size_t i = 0; i < rounds; ++i) {
+            co_await roundTrip(ev, acceptor, port, counts);
+        }
+    }(ev, acceptor, port, warm, counts));
+    ev.run();
+
+    EXPECT_EQ(counts.accept, rounds);
+    EXPECT_EQ(counts.io, 0u);
+}
+
+// A request on a keep-alive connection goes through the parser, the router
+// with a route parameter, a handler setting a header and the response. Once
+// warm, everything it needs comes from the loop's buffer pool, the output
+// queue's recycled buffers and chunks, inline awaitables and the coroutine
+// frame pools, except for the response's header table.
+TEST(Allocation, KeepAliveRequestAllocatesAFixedAmount)
+{
+#ifdef AIFS_NO_FRAME_POOL
+    GTEST_SKIP() << "Coroutine frames are allocated without AIFS_FRAME_POOL";
+#endif
+    using namespace aifs::http;
+
+    EventLoop ev;
+    ExpressRouter router;
+    router.get("/users/:id", [](const Request&, Response& resp) -> Task<HandlerStatus> {
+        resp.setHeader("Content-Type", "text/plain");
+        co_await resp.send("hello");
+        co_return HandlerStatus::Accepted;
+    });
+    auto [server, client] = UnixSocket::pair(ev);
+    HTTPConnection<> conn { ev, router, std::move(server) };
+    ev.spawn(conn.handle());
+
+    constexpr std::size_t warmup = 4;
+    constexpr std::size_t rounds = 200;
+    std::size_t allocated = 0;
+    std::size_t answered = 0;
+    ev.spawn([](UnixSocket& client, std::size_t& allocated, std::size_t& answered) -> Task<> {
+        constexpr std::string_view request = "GET /users/42 HTTP/1.1\r\nHost: example.com\r\nAccept: */*\r\n\r\n";
+        char buf[1024];
+        for (std::size_t i = 0; i < warmup + rounds; ++i) {
+            auto before = allocations;
+            EXPECT_EQ(co_await client.send(request), static_cast<ssize_t>(request.size()));
+            std::size_t received = 0;
+            while (received < 5 || std::string_view(buf + received - 5, 5) != "hello") {
+                received += static_cast<std::size_t>(co_await client.receive({ buf + received, sizeof buf - received }));
+            }
+            if (i >= warmup) {
+                allocated += allocations - before;
+                ++answered;
+            }
+        }
+        client.close();
+    }(*client, allocated, answered));
+    ev.run();
+
+    // One for the header table of the response, none for the rest.
+    EXPECT_EQ(answered, rounds);
+    EXPECT_LE(allocated, rounds);
+}
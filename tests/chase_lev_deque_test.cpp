@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "aifs/chase_lev_deque.h"
+
+using namespace aifs;
+
+TEST(ChaseLevDeque, OwnerPopsNewestAndThievesStealOldest)
+{
+    int items[4] {};
+    ChaseLevDeque<int> deque;
+    EXPECT_TRUE(deque.empty());
+    for (auto& item : items) {
+        deque.push(&item);
+    }
+    EXPECT_FALSE(deque.empty());
+
+    EXPECT_EQ(deque.steal(), &items[0]);
+    EXPECT_EQ(deque.pop(), &items[3]);
+    EXPECT_EQ(deque.steal(), &items[1]);
+    EXPECT_EQ(deque.pop(), &items[2]);
+    EXPECT_EQ(deque.pop(), nullptr);
+    EXPECT_EQ(deque.steal(), nullptr);
+    EXPECT_TRUE(deque.empty());
+}
+
+TEST(ChaseLevDeque, GrowsBeyondItsCapacity)
+{
+    std::vector<int> items(1000);
+    ChaseLevDeque<int> deque { 2 };
+    // Keep the top moving, so that growing copies a wrapped range.
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        deque.push(&items[i]);
+        if (i % 3 == 0) {
+            EXPECT_EQ(deque.steal(), &items[i / 3]);
+        }
+    }
+    for (auto i = items.size(); i-- > (items.size() + 2) / 3;) {
+        EXPECT_EQ(deque.pop(), &items[i]);
+    }
+    EXPECT_TRUE(deque.empty());
+}
+
+// The owner pushes and pops while many thieves steal, growing the deque as
+// it goes. Every item must be taken exactly once.
+TEST(ChaseLevDeque, HandsOutEveryItemOnceToManyThieves)
+{
+    constexpr std::size_t count = 200000;
+    constexpr std::size_t thieves = 8;
+    std::vector<int> items(count);
+    auto taken = std::make_unique<std::atomic<int>[]>(count);
+    auto take = [&](int* item) { taken[static_cast<std::size_t>(item - items.data())].fetch_add(1, std::memory_order_relaxed); };
+
+    ChaseLevDeque<int> deque { 4 };
+    std::atomic<bool> done { false };
+    std::atomic<std::size_t> stolen { 0 };
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < thieves; ++t) {
+        threads.emplace_back([&] {
+            while (!done.load(std::memory_order_acquire) || !deque.empty()) {
+                if (auto* item = deque.steal()) {
+                    take(item);
+                    stolen.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+
+    std::size_t popped = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        deque.push(&items[i]);
+        // Pop now and then, which races the thieves for the last item.
+        if (i % 4 == 0) {
+            if (auto* item = deque.pop()) {
+                take(item);
+                ++popped;
+            }
+        }
+    }
+    while (auto* item = deque.pop()) {
+        take(item);
+        ++popped;
+    }
+    done.store(true, std::memory_order_release);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(popped + stolen.load(), count);
+    for (std::size_t i = 0; i < count; ++i) {
+        ASSERT_EQ(taken[i].load(), 1) << "item " << i;
+    }
+}
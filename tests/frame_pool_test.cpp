@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "aifs/frame_pool.h"
+
+using namespace aifs;
+
+TEST(FramePool, ReusesFreedFramesOfTheSameSizeClass)
+{
+    auto* frame = FramePool::allocate(100);
+    FramePool::deallocate(frame, 100);
+    // 65 to 128 bytes share a class; 129 bytes does not.
+    auto* larger = FramePool::allocate(129);
+    auto* same = FramePool::allocate(128);
+    EXPECT_EQ(same, frame);
+    EXPECT_NE(larger, frame);
+    FramePool::deallocate(same, 128);
+    FramePool::deallocate(larger, 129);
+}
+
+TEST(FramePool, MovesFramesFreedOnAnotherThreadToThatThread)
+{
+    auto* frame = FramePool::allocate(200);
+    void* reused = nullptr;
+    std::thread { [&] {
+        FramePool::deallocate(frame, 200);
+        reused = FramePool::allocate(200);
+        FramePool::deallocate(reused, 200);
+    } }.join();
+    EXPECT_EQ(reused, frame);
+
+    // The block went away with the other thread's pool.
+    auto* other = FramePool::allocate(200);
+    EXPECT_NE(other, nullptr);
+    FramePool::deallocate(other, 200);
+}
+
+TEST(FramePool, PassesLargeFramesThrough)
+{
+    constexpr auto large = FramePool::num_classes * FramePool::granularity + 1;
+    auto* frame = FramePool::allocate(large);
+    FramePool::deallocate(frame, large);
+    auto* next = FramePool::allocate(large);
+    FramePool::deallocate(next, large);
+    SUCCEED();
+}
@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "aifs/event_loop.h"
+#include "aifs/http/http_connection.h"
+#include "aifs/unix_socket.h"
+
+using namespace aifs;
+using namespace aifs::http;
+
+namespace {
+// Answers every request with its URL, except for a few that get a status
+// without a body.
+class EchoRouter : public Router {
+public:
+    Task<HandlerStatus> handle(Request& req, Response& resp) override
+    {
+        auto url = req.url();
+        if (url == "/no-content") {
+            // Left for the connection to finish.
+            resp.setStatus(204);
+        } else if (url == "/streamed-no-content") {
+            resp.setStatus(204);
+            co_await resp.write("ignored");
+        } else if (url == "/streamed") {
+            co_await resp.write("streamed");
+        } else if (url == "/not-modified") {
+            resp.setStatus(304);
+            co_await resp.send("ignored");
+        } else {
+            co_await resp.send(std::string { url });
+        }
+        co_return HandlerStatus::Accepted;
+    }
+};
+
+template <typename Parser>
+class HTTPConnectionTest : public ::testing::Test {
+protected:
+    // Everything the connection answers to requests, sent in one piece,
+    // until it closes.
+    std::string answers(std::string_view requests, ConnectionOptions options = {})
+    {
+        EventLoop ev;
+        EchoRouter router;
+        auto [server, client] = UnixSocket::pair(ev);
+        HTTPConnection<Parser> conn { ev, router, std::move(server), options };
+        std::string received;
+        ev.spawn(conn.handle());
+        ev.spawn([](UnixSocket& client, std::string_view requests, std::string& received) -> Task<> {
+            EXPECT_EQ(co_await client.send(requests), static_cast<ssize_t>(requests.size()));
+            // The end of the stream is reported as connection_aborted.
+            char buf[4096];
+            try {
+                for (;;) {
+                    auto n = co_await client.receive(buf);
+                    received.append(buf, static_cast<std::size_t>(n));
+                }
+            } catch (const std::system_error& e) {
+                if (e.code() != std::errc::connection_aborted) {
+                    throw;
+                }
+            }
+        }(*client, requests, received));
+        ev.run();
+        return received;
+    }
+};
+
+// The responses without their Date headers, which change every second.
+std::string withoutDates(const std::string& responses)
+{
+    static const std::regex date { "Date: [A-Z][a-z]{2}, \\d{2} [A-Z][a-z]{2} \\d{4} \\d{2}:\\d{2}:\\d{2} GMT\r\n" };
+    EXPECT_TRUE(std::regex_search(responses, date)) << responses;
+    return std::regex_replace(responses, date, "");
+}
+
+using Parsers = ::testing::Types<RequestParser, FastRequestParser>;
+TYPED_TEST_SUITE(HTTPConnectionTest, Parsers);
+} // namespace
+
+TYPED_TEST(HTTPConnectionTest, AnswersPipelinedRequestsUpToTheLimit)
+{
+    auto responses = this->answers("GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+                                   "GET /b HTTP/1.1\r\nHost: x\r\n\r\n"
+                                   "GET /c HTTP/1.1\r\nHost: x\r\n\r\n",
+        { .maxRequests = 2 });
+    EXPECT_EQ(withoutDates(responses),
+        "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n/a"
+        "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\n/b");
+}
+
+TYPED_TEST(HTTPConnectionTest, KeepsHTTP10ConnectionOpenOnlyWhenAsked)
+{
+    EXPECT_EQ(withoutDates(this->answers("GET /a HTTP/1.0\r\n\r\nGET /b HTTP/1.0\r\n\r\n")),
+        "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\n/a");
+
+    EXPECT_EQ(withoutDates(this->answers("GET /a HTTP/1.0\r\nConnection: keep-alive\r\n\r\nGET /b HTTP/1.0\r\n\r\n")),
+        "HTTP/1.1 200 OK\r\nConnection: keep-alive\r\nContent-Length: 2\r\n\r\n/a"
+        "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\n/b");
+}
+
+TYPED_TEST(HTTPConnectionTest, ClosesIdleConnection)
+{
+    auto responses = this->answers("GET /a HTTP/1.1\r\nHost: x\r\n\r\n", { .idleTimeout = std::chrono::milliseconds(20) });
+    EXPECT_EQ(withoutDates(responses), "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n/a");
+}
+
+TYPED_TEST(HTTPConnectionTest, RejectsMalformedRequestAndCloses)
+{
+    // The reply is a complete response, Date header included.
+    auto responses = this->answers("GET /a HTTP/1.1\r\nHost\r\n\r\nGET /b HTTP/1.1\r\nHost: x\r\n\r\n");
+    EXPECT_EQ(withoutDates(responses), "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+}
+
+// Whatever body the handler gives, nothing follows the header block of a
+// 204 or 304, so the next response starts right after it.
+TYPED_TEST(HTTPConnectionTest, SendsNoBodyWithBodylessStatuses)
+{
+    auto responses = this->answers("GET /no-content HTTP/1.1\r\nHost: x\r\n\r\n"
+                                   "GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+                                   "GET /streamed-no-content HTTP/1.1\r\nHost: x\r\n\r\n"
+                                   "GET /not-modified HTTP/1.1\r\nHost: x\r\n\r\n"
+                                   "GET /b HTTP/1.1\r\nHost: x\r\n\r\n",
+        { .maxRequests = 5 });
+    EXPECT_EQ(withoutDates(responses),
+        "HTTP/1.1 204 No Content\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n/a"
+        "HTTP/1.1 204 No Content\r\n\r\n"
+        "HTTP/1.1 304 Not Modified\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\n/b");
+}
+
+// HEAD gets the header block a GET would, length included, and nothing
+// else.
+TYPED_TEST(HTTPConnectionTest, SendsNoBodyForHead)
+{
+    auto responses = this->answers("HEAD /a HTTP/1.1\r\nHost: x\r\n\r\n"
+                                   "HEAD /streamed HTTP/1.1\r\nHost: x\r\n\r\n"
+                                   "GET /streamed HTTP/1.1\r\nHost: x\r\n\r\n"
+                                   "GET /b HTTP/1.1\r\nHost: x\r\n\r\n",
+        { .maxRequests = 4 });
+    EXPECT_EQ(withoutDates(responses),
+        "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n8\r\nstreamed\r\n0\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\n/b");
+}
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "aifs/descriptor.h"
+#include "aifs/io_uring_reactor.h"
+
+using namespace aifs;
+using namespace std::chrono_literals;
+
+namespace {
+class IoUringReactorTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        if (!IoUringReactor::supported()) {
+            GTEST_SKIP() << "io_uring not supported";
+        }
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, m_fds), 0);
+        m_reactor = std::make_unique<IoUringReactor>();
+    }
+
+    void TearDown() override
+    {
+        m_reactor.reset();
+        for (int fd : m_fds) {
+            if (fd != -1) {
+                ::close(fd);
+            }
+        }
+    }
+
+    // Wait until events arrive, or for a while.
+    std::vector<Reactor::Event> poll()
+    {
+        std::vector<Reactor::Event> events;
+        for (int i = 0; i < 10 && events.empty(); ++i) {
+            m_reactor->wait(10ms, events);
+        }
+        return events;
+    }
+
+    int m_fds[2] { -1, -1 };
+    std::unique_ptr<IoUringReactor> m_reactor;
+};
+} // namespace
+
+TEST_F(IoUringReactorTest, CompletesReceive)
+{
+    Descriptor desc { m_fds[0] };
+    Operation op;
+    char buf[16];
+    desc.m_ops[read_op] = &op;
+    m_reactor->submit(&desc, read_op, IoRequest { IoRequest::receive, buf, sizeof buf }, &op);
+    ASSERT_EQ(::write(m_fds[1], "hello", 5), 5);
+
+    auto events = poll();
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].desc, &desc);
+    EXPECT_EQ(events[0].ready, opMask(read_op));
+    ASSERT_TRUE(op.completion);
+    EXPECT_EQ(*op.completion, 5);
+    m_reactor->deregister(&desc);
+}
+
+// The operation pending when its descriptor goes away is reported as
+// canceled on its own, once the kernel is done with the request.
+TEST_F(IoUringReactorTest, CancelsPendingOperationsOnDeregister)
+{
+    auto desc = std::make_unique<Descriptor>(Descriptor { m_fds[0] });
+    Operation op;
+    char buf[16];
+    desc->m_ops[read_op] = &op;
+    m_reactor->submit(desc.get(), read_op, IoRequest { IoRequest::receive, buf, sizeof buf }, &op);
+    std::vector<Reactor::Event> events;
+    m_reactor->wait(0us, events);
+    ASSERT_TRUE(events.empty());
+
+    // The receive is still in flight when its descriptor goes away.
+    m_reactor->deregister(desc.get());
+    ::close(std::exchange(m_fds[0], -1));
+    desc.reset();
+    ASSERT_EQ(::write(m_fds[1], "x", 1), 1);
+
+    events = poll();
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].desc, nullptr);
+    EXPECT_EQ(events[0].orphan, &op);
+    EXPECT_EQ(op.ec, std::errc::operation_canceled);
+    EXPECT_FALSE(op.completion);
+    EXPECT_TRUE(poll().empty());
+}
+
+TEST_F(IoUringReactorTest, CompletesOnceAfterCancelAndDeregister)
+{
+    auto desc = std::make_unique<Descriptor>(Descriptor { m_fds[0] });
+    Operation op;
+    desc->m_ops[read_op] = &op;
+    m_reactor->submit(desc.get(), read_op, IoRequest { IoRequest::poll }, &op);
+    std::vector<Reactor::Event> events;
+    m_reactor->wait(0us, events);
+
+    // Like an idle timeout canceling a receive, and the connection closing
+    // before the cancellation completes.
+    m_reactor->cancel(desc.get(), read_op, &op);
+    m_reactor->deregister(desc.get());
+    ::close(std::exchange(m_fds[0], -1));
+    desc.reset();
+
+    events = poll();
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].orphan, &op);
+    EXPECT_EQ(op.ec, std::errc::operation_canceled);
+    EXPECT_TRUE(poll().empty());
+}
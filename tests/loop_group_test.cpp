@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include <netinet/in.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "aifs/loop_group.h"
+#include "aifs/steady_timer.h"
+
+using namespace aifs;
+
+namespace {
+// The CPUs the calling thread may run on.
+std::vector<int> affinity()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    EXPECT_EQ(::sched_getaffinity(0, sizeof(set), &set), 0);
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// A port nothing listens on, for the group to bind.
+int freePort()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ::bind(fd, reinterpret_cast<sockaddr*>(&addr), len);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    ::close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// Connect to port, waiting for the group to listen on it.
+int connectTo(int port)
+{
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<unsigned short>(port));
+    for (;;) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+            return fd;
+        }
+        auto err = errno;
+        ::close(fd);
+        if (err != ECONNREFUSED) {
+            ADD_FAILURE() << "connect: " << std::strerror(err);
+            return -1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Send everything from the socket back until the peer closes it.
+Task<> echo(std::unique_ptr<TCPSocket> socket)
+{
+    char buf[256];
+    try {
+        for (;;) {
+            auto n = co_await socket->receive(buf);
+            co_await socket->send({ buf, static_cast<std::size_t>(n) });
+        }
+    } catch (const std::system_error& e) {
+        if (e.code() != std::errc::connection_aborted) {
+            ADD_FAILURE() << e.what();
+        }
+    }
+}
+} // namespace
+
+// Each loop is pinned to its own one of the CPUs the process may use,
+// whichever those are.
+TEST(LoopGroup, PinsLoopsToAllowedCpus)
+{
+    auto allowed = affinity();
+    LoopGroup group;
+    EXPECT_EQ(group.size(), allowed.size());
+
+    std::mutex mutex;
+    std::vector<std::vector<int>> pinned(group.size());
+    group.run([&](EventLoop&, std::size_t index) -> Task<> {
+        std::lock_guard lock { mutex };
+        pinned[index] = affinity();
+        co_return;
+    });
+
+    std::set<int> used;
+    for (const auto& cpus : pinned) {
+        ASSERT_EQ(cpus.size(), 1u);
+        EXPECT_NE(std::find(allowed.begin(), allowed.end(), cpus[0]), allowed.end()) << cpus[0];
+        used.insert(cpus[0]);
+    }
+    EXPECT_EQ(used.size(), allowed.size());
+}
+
+// The first loop accepts every connection and hands them to the loops in
+// turn, which then own them.
+TEST(LoopGroup, HandsConnectionsOutRoundRobin)
+{
+    constexpr std::size_t loops = 2;
+    constexpr std::size_t connections = 6;
+    int port = freePort();
+
+    std::vector<std::string> replies(connections);
+    std::thread clients([&] {
+        // All connect before any is served, so they are all handed out
+        // while the first loop is still accepting.
+        std::vector<int> fds;
+        for (std::size_t i = 0; i < connections; ++i) {
+            fds.push_back(connectTo(port));
+        }
+        for (std::size_t i = 0; i < connections; ++i) {
+            auto message = "hello " + std::to_string(i);
+            EXPECT_EQ(::write(fds[i], message.data(), message.size()), static_cast<ssize_t>(message.size()));
+            char buf[256];
+            while (replies[i].size() < message.size()) {
+                auto n = ::read(fds[i], buf, sizeof buf);
+                if (n <= 0) {
+                    break;
+                }
+                replies[i].append(buf, static_cast<std::size_t>(n));
+            }
+            ::close(fds[i]);
+        }
+    });
+
+    std::mutex mutex;
+    std::set<std::thread::id> servingThreads;
+    std::atomic<std::size_t> served { 0 };
+    LoopGroup group { { .threads = loops, .pinThreads = false, .acceptMode = AcceptMode::round_robin } };
+    group.listen(
+        port,
+        [&](EventLoop& loop, Acceptor<TCPSocket>& acceptor) -> Task<> {
+            // Each loop gets its share, one after the other.
+            for (std::size_t i = 0; i < connections / loops; ++i) {
+                auto socket = co_await acceptor.accept();
+                {
+                    std::lock_guard lock { mutex };
+                    servingThreads.insert(std::this_thread::get_id());
+                }
+                co_await echo(std::move(socket));
+                ++served;
+            }
+            // The first loop stops accepting once its server returns, so
+            // it waits for the others.
+            SteadyTimer poll { loop, std::chrono::milliseconds(1) };
+            while (served < connections) {
+                co_await poll.wait();
+            }
+        },
+        { .address = "127.0.0.1" });
+    clients.join();
+
+    EXPECT_EQ(servingThreads.size(), loops);
+    for (std::size_t i = 0; i < connections; ++i) {
+        EXPECT_EQ(replies[i], "hello " + std::to_string(i));
+    }
+}
@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+
+#include <http_parser.h>
+
+#include <cstddef>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "aifs/http/fast_request_parser.h"
+#include "aifs/http/http_connection.h"
+
+using namespace aifs::http;
+
+namespace {
+struct Parsed {
+    unsigned method { 0 };
+    std::string url;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    bool keepAlive { false };
+    bool http10 { false };
+
+    bool operator==(const Parsed&) const = default;
+};
+
+struct Result {
+    std::vector<Parsed> requests;
+    bool failed { false };
+
+    bool operator==(const Result&) const = default;
+};
+
+std::ostream& operator<<(std::ostream& os, const Result& result)
+{
+    for (const auto& r : result.requests) {
+        os << "\n  " << http_method_str(static_cast<http_method>(r.method)) << ' ' << r.url
+           << (r.keepAlive ? " keep-alive" : " close") << (r.http10 ? " 1.0" : "");
+        for (const auto& [f, v] : r.headers) {
+            os << "\n    [" << f << "]: [" << v << ']';
+        }
+        os << "\n    body [" << r.body << ']';
+    }
+    return os << (result.failed ? "\n  error" : "");
+}
+
+// Feed the pieces of input to a Parser the way HTTPConnection does. Every
+// piece is a buffer of its own and exactly as large, so that reading past
+// it shows up under AddressSanitizer.
+template <typename Parser>
+Result parse(std::string_view input, std::span<const std::size_t> splits)
+{
+    std::vector<std::vector<char>> pieces;
+    std::size_t begin = 0;
+    for (auto split : splits) {
+        pieces.emplace_back(input.begin() + begin, input.begin() + split);
+        begin = split;
+    }
+    pieces.emplace_back(input.begin() + begin, input.end());
+
+    Parser parser;
+    Result result;
+    for (const auto& piece : pieces) {
+        std::span<const char> data { piece };
+        while (!data.empty()) {
+            data = data.subspan(parser.consume(data));
+            if (parser.error() != 0) {
+                result.failed = true;
+                return result;
+            }
+            if (!parser.m_complete) {
+                break;
+            }
+            Parsed r { parser.m_method, std::string { parser.m_url }, {}, std::string { parser.m_body }, parser.keepAlive(), parser.http10() };
+            for (const auto& h : parser.m_headers) {
+                r.headers.emplace_back(h.field, h.value);
+            }
+            result.requests.push_back(std::move(r));
+            parser.next();
+        }
+    }
+    return result;
+}
+
+void expectSame(std::string_view input, std::span<const std::size_t> splits = {})
+{
+    auto expected = parse<RequestParser>(input, splits);
+    auto actual = parse<FastRequestParser>(input, splits);
+    std::string at;
+    for (auto split : splits) {
+        at += ' ' + std::to_string(split);
+    }
+    EXPECT_EQ(actual, expected) << "split at" << at << " of\n"
+                                << input;
+}
+
+const std::string_view cases[] = {
+    "GET / HTTP/1.1\r\nHost: example.com\r\n\r\n",
+    "GET /index.html?a=1&b=2 HTTP/1.0\r\n\r\n",
+    "GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n",
+    "GET / HTTP/1.1\r\nConnection: close\r\n\r\n",
+    "GET / HTTP/1.1\r\nConnection: Upgrade, Close\r\n\r\n",
+    "HEAD /x HTTP/1.1\r\nAccept: */*\r\nUser-Agent: test/1.0\r\n\r\n",
+    "GET / HTTP/1.1\nHost: example.com\n\n",
+    "GET / HTTP/1.1\r\nX-Empty:\r\nX-Space:   padded value\r\n\r\n",
+    "POST /submit HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello world",
+    "PUT /p HTTP/1.1\r\ncontent-length: 0\r\n\r\n",
+    "POST /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n",
+    "POST /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\na;ext=1\r\n0123456789\r\n0\r\n\r\n",
+    "GET /1 HTTP/1.1\r\n\r\nGET /2 HTTP/1.1\r\nConnection: close\r\n\r\n",
+    "POST /a HTTP/1.1\r\nContent-Length: 3\r\n\r\nabcDELETE /b HTTP/1.1\r\n\r\nOPTIONS * HTTP/1.1\r\n\r\n",
+    "PATCH /p HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\nTRACE / HTTP/1.1\r\n\r\n",
+    // | and ~ are token characters, unlike the { and } next to them.
+    "GET / HTTP/1.1\r\nX|Pipe~Tilde: x\r\nX-Field-Name-Longer|Than~A-Block: y\r\n\r\n",
+    // Errors
+    "G@T / HTTP/1.1\r\n\r\n",
+    "GET / HTTP/x.1\r\n\r\n",
+    "GET / HTTP/1.1\r\nBad(Name: x\r\n\r\n",
+    "GET / HTTP/1.1\r\nX: a\x01" "b\r\n\r\n",
+    "POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",
+    "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+    "GET / HTTP/1.1\r\n\r\nGET / HTTP/1.1\r\nBad(Name: x\r\n\r\n",
+    "GET / HTTP/1.1\r\nX-Field-Name-Longer|Than~A{Block: x\r\n\r\n",
+    "GET / HTTP/1.1\r\nX-Field-Name-Longer|Than~A}Block: x\r\n\r\n",
+};
+
+// Requests in which the URL, a field name, a field value or the whole
+// request ends just before, at or just after the edge of a block of the
+// given size.
+std::vector<std::string> blockEdgeRequests(std::size_t block)
+{
+    std::vector<std::string> requests;
+    for (std::size_t offset : { 3 * block - 1, 3 * block, 3 * block + 1, 4 * block - 1, 4 * block, 4 * block + 1 }) {
+        // "GET /" takes five bytes.
+        requests.push_back("GET /" + std::string(offset - 5, 'u') + " HTTP/1.1\r\n\r\n");
+
+        std::string head = "GET / HTTP/1.1\r\nX-";
+        requests.push_back(head + std::string(offset - head.size(), 'f') + ": v\r\n\r\n");
+        head += "A: ";
+        requests.push_back(head + std::string(offset - head.size(), 'v') + "\r\n\r\n");
+
+        // The whole request ends at the edge.
+        std::string whole = "GET / HTTP/1.1\r\nX: \r\n\r\n";
+        whole.insert(whole.size() - 4, std::string(offset - whole.size(), 'w'));
+        requests.push_back(std::move(whole));
+    }
+    return requests;
+}
+} // namespace
+
+TEST(RequestParser, FastParserMatchesHttpParserInOnePiece)
+{
+    for (auto input : cases) {
+        expectSame(input);
+    }
+}
+
+TEST(RequestParser, FastParserMatchesHttpParserAtEverySplit)
+{
+    for (auto input : cases) {
+        for (std::size_t i = 1; i < input.size(); ++i) {
+            std::size_t splits[] = { i };
+            expectSame(input, splits);
+        }
+    }
+}
+
+TEST(RequestParser, FastParserMatchesHttpParserByteByByte)
+{
+    for (auto input : cases) {
+        std::vector<std::size_t> splits;
+        for (std::size_t i = 1; i < input.size(); ++i) {
+            splits.push_back(i);
+        }
+        expectSame(input, splits);
+    }
+}
+
+TEST(RequestParser, FastParserMatchesHttpParserAtBlockEdges)
+{
+    for (std::size_t block : { 16, 32 }) {
+        for (const auto& input : blockEdgeRequests(block)) {
+            expectSame(input);
+            for (auto i : { block - 1, block, block + 1, input.size() - block }) {
+                std::size_t splits[] = { i };
+                expectSame(input, splits);
+            }
+        }
+    }
+}
+
+TEST(RequestParser, FastParserDeviatesAsDocumented)
+{
+    // Trailer fields are skipped.
+    std::string_view trailer = "POST /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n1\r\na\r\n0\r\nX: y\r\n\r\n";
+    auto expected = parse<RequestParser>(trailer, {});
+    ASSERT_EQ(expected.requests.size(), 1u);
+    expected.requests[0].headers.pop_back();
+    EXPECT_EQ(parse<FastRequestParser>(trailer, {}), expected);
+
+    // Field names must be tokens; http_parser lets a space through.
+    std::string_view space = "GET / HTTP/1.1\r\nBad Name: x\r\n\r\n";
+    EXPECT_FALSE(parse<RequestParser>(space, {}).failed);
+    EXPECT_TRUE(parse<FastRequestParser>(space, {}).failed);
+}
@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+
+#include <http_parser.h>
+
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <system_error>
+
+#include "aifs/event_loop.h"
+#include "aifs/http/express_router.h"
+#include "aifs/http/response_cache.h"
+#include "aifs/output_queue.h"
+#include "aifs/unix_socket.h"
+
+using namespace aifs;
+using namespace aifs::http;
+
+namespace {
+// One side of a connection, as the server sees it.
+struct Connection {
+    Connection(EventLoop& ev, std::size_t highWaterMark = OutputQueue::default_high_water_mark)
+        : sockets { UnixSocket::pair(ev) }
+        , output { ev, *sockets.first, highWaterMark }
+    {
+    }
+
+    std::pair<std::unique_ptr<UnixSocket>, std::unique_ptr<UnixSocket>> sockets;
+    OutputQueue output;
+};
+
+class ResponseCacheTest : public ::testing::Test {
+protected:
+    // Handle a GET for url through the cache, and return what was queued.
+    Task<std::string> get(std::string_view url, std::span<const Header> headers = {})
+    {
+        Connection conn { m_ev, 1 << 30 };
+        Request req { HTTP_GET, url, headers };
+        Response resp { conn.output };
+        co_await m_cache.handle(req, resp);
+        co_await conn.output.flush();
+        conn.sockets.first->close();
+
+        // The end of the stream is reported as connection_aborted.
+        std::string queued;
+        char buf[4096];
+        try {
+            for (;;) {
+                auto n = co_await conn.sockets.second->receive(buf);
+                queued.append(buf, static_cast<std::size_t>(n));
+            }
+        } catch (const std::system_error& e) {
+            if (e.code() != std::errc::connection_aborted) {
+                throw;
+            }
+        }
+        co_return queued;
+    }
+
+    // The cache belongs to one loop, which only runs once.
+    void run(std::function<Task<>()> test)
+    {
+        m_ev.spawn(test());
+        m_ev.run();
+    }
+
+    EventLoop m_ev;
+    ExpressRouter m_router;
+    ResponseCache m_cache { m_ev, m_router };
+    int m_calls { 0 };
+};
+} // namespace
+
+TEST_F(ResponseCacheTest, ServesRepeatedRequestsFromCache)
+{
+    m_router.get("/a", [this](const Request&, Response& resp) -> Task<HandlerStatus> {
+        ++m_calls;
+        co_await resp.send("A");
+        co_return HandlerStatus::Accepted;
+    });
+
+    run([this]() -> Task<> {
+        co_await get("/a");
+        auto second = co_await get("/a");
+        EXPECT_TRUE(second.starts_with("HTTP/1.1 200 OK\r\n")) << second;
+        EXPECT_TRUE(second.ends_with("\r\n\r\nA")) << second;
+    });
+    EXPECT_EQ(m_calls, 1);
+    EXPECT_EQ(m_cache.stats().misses, 1u);
+    EXPECT_EQ(m_cache.stats().hits, 1u);
+}
+
+TEST_F(ResponseCacheTest, AnswersMatchingIfNoneMatchWithNotModified)
+{
+    m_router.get("/a", [](const Request&, Response& resp) -> Task<HandlerStatus> {
+        resp.setHeader("ETag", "\"v1\"");
+        co_await resp.send("A");
+        co_return HandlerStatus::Accepted;
+    });
+
+    run([this]() -> Task<> {
+        co_await get("/a");
+        Header inm[] = { { "If-None-Match", "\"v0\", W/\"v1\"" } };
+        auto response = co_await get("/a", inm);
+        EXPECT_TRUE(response.starts_with("HTTP/1.1 304 Not Modified\r\n")) << response;
+        EXPECT_NE(response.find("ETag: \"v1\"\r\n"), std::string::npos);
+        EXPECT_TRUE(response.ends_with("\r\n\r\n"));
+    });
+    EXPECT_EQ(m_cache.stats().notModified, 1u);
+}
+
+TEST_F(ResponseCacheTest, WaitersDoNotWaitForSlowClient)
+{
+    // More than the socket and the output queue hold, so sending it to the
+    // first client, which never reads, does not finish.
+    const std::string body(8 << 20, 'x');
+    m_router.get("/big", [&](const Request&, Response& resp) -> Task<HandlerStatus> {
+        ++m_calls;
+        // Let the second request find this one in flight.
+        co_await m_ev.schedule();
+        co_await resp.send(body);
+        co_return HandlerStatus::Accepted;
+    });
+
+    Connection slow { m_ev };
+    Connection fast { m_ev, 1 << 30 };
+    Request req { HTTP_GET, "/big" };
+    Response slowResp { slow.output };
+    Response fastResp { fast.output };
+    bool fastDone = false;
+    m_ev.spawn([](ResponseCache& cache, Request& req, Response& resp) -> Task<> {
+        co_await cache.handle(req, resp);
+    }(m_cache, req, slowResp));
+    m_ev.spawn([](EventLoop& ev, ResponseCache& cache, Request& req, Response& resp, bool& done) -> Task<> {
+        co_await cache.handle(req, resp);
+        done = true;
+        ev.stop();
+    }(m_ev, m_cache, req, fastResp, fastDone));
+    m_ev.run();
+
+    EXPECT_TRUE(fastDone);
+    EXPECT_EQ(m_calls, 1);
+    EXPECT_EQ(m_cache.stats().coalesced, 1u);
+    EXPECT_GT(fast.output.queued(), body.size());
+}
+
+TEST_F(ResponseCacheTest, DoesNotStorePrivateResponses)
+{
+    struct Case {
+        const char* field;
+        const char* value;
+        bool stored;
+    };
+    const Case cases[] = {
+        { "Set-Cookie", "id=1", false },
+        { "Cache-Control", "no-store", false },
+        { "Cache-Control", "public, Private", false },
+        { "Cache-Control", "no-cache", false },
+        { "Cache-Control", "max-age=0", false },
+        { "Cache-Control", "max-age = \"0\"", false },
+        { "Cache-Control", "max-age=60", true },
+        { "Cache-Control", "max-age=0600", true },
+        { "Cache-Control", "x-no-store-hint", true },
+        { "Cache-Control", "public, proxy-revalidate", true },
+    };
+    const Case* current = nullptr;
+    m_router.get("/a", [this, &current](const Request&, Response& resp) -> Task<HandlerStatus> {
+        ++m_calls;
+        resp.setHeader(current->field, current->value);
+        co_await resp.send("A");
+        co_return HandlerStatus::Accepted;
+    });
+
+    run([this, &cases, &current]() -> Task<> {
+        for (const auto& c : cases) {
+            current = &c;
+            m_cache.clear();
+            m_calls = 0;
+            co_await get("/a");
+            co_await get("/a");
+            EXPECT_EQ(m_calls, c.stored ? 1 : 2) << c.field << ": " << c.value;
+        }
+    });
+}
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include "aifs/event_loop.h"
+#include "aifs/http/response.h"
+#include "aifs/output_queue.h"
+#include "aifs/unix_socket.h"
+
+using namespace aifs;
+using namespace aifs::http;
+
+namespace {
+// Everything fn makes a Response write to the connection.
+std::string written(std::function<Task<>(Response&)> fn)
+{
+    EventLoop ev;
+    auto [server, client] = UnixSocket::pair(ev);
+    OutputQueue output { ev, *server };
+    std::string received;
+    ev.spawn([](std::function<Task<>(Response&)>& fn, OutputQueue& output, UnixSocket& server, UnixSocket& client, std::string& received) -> Task<> {
+        Response resp { output };
+        co_await fn(resp);
+        co_await output.flush();
+        server.close();
+
+        // The end of the stream is reported as connection_aborted.
+        char buf[4096];
+        try {
+            for (;;) {
+                auto n = co_await client.receive(buf);
+                received.append(buf, static_cast<std::size_t>(n));
+            }
+        } catch (const std::system_error& e) {
+            if (e.code() != std::errc::connection_aborted) {
+                throw;
+            }
+        }
+    }(fn, output, *server, *client, received));
+    ev.run();
+    return received;
+}
+
+// The response without its Date header, which changes every second.
+std::string withoutDate(const std::string& response)
+{
+    static const std::regex date { "Date: [A-Z][a-z]{2}, \\d{2} [A-Z][a-z]{2} \\d{4} \\d{2}:\\d{2}:\\d{2} GMT\r\n" };
+    EXPECT_TRUE(std::regex_search(response, date)) << response;
+    return std::regex_replace(response, date, "");
+}
+} // namespace
+
+TEST(Response, WritesStatusLineHeadersAndContentLength)
+{
+    auto response = written([](Response& resp) -> Task<> {
+        resp.setHeader("Content-Type", "text/plain");
+        resp.setHeader("X-Id", "7");
+        co_await resp.send("hello");
+    });
+    EXPECT_EQ(withoutDate(response), "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nX-Id: 7\r\nContent-Length: 5\r\n\r\nhello");
+}
+
+TEST(Response, WritesStatusLines)
+{
+    for (auto [status, line] : { std::pair { 201u, "HTTP/1.1 201 Created\r\n" }, { 404u, "HTTP/1.1 404 Not Found\r\n" },
+             { 418u, "HTTP/1.1 418 \r\n" }, { 503u, "HTTP/1.1 503 Service Unavailable\r\n" }, { 599u, "HTTP/1.1 599 \r\n" } }) {
+        auto response = written([status](Response& resp) -> Task<> {
+            resp.setStatus(status);
+            co_await resp.send("");
+        });
+        EXPECT_TRUE(response.starts_with(line)) << response;
+    }
+
+    EventLoop ev;
+    auto [server, client] = UnixSocket::pair(ev);
+    OutputQueue output { ev, *server };
+    Response resp { output };
+    EXPECT_THROW(resp.setStatus(99), std::invalid_argument);
+    EXPECT_THROW(resp.setStatus(600), std::invalid_argument);
+}
+
+TEST(Response, ReplacesHeadersCaseInsensitively)
+{
+    auto response = written([](Response& resp) -> Task<> {
+        resp.setHeader("content-type", "text/plain");
+        resp.setHeader("Content-Type", "text/html");
+        co_await resp.send("");
+    });
+    EXPECT_EQ(withoutDate(response), "HTTP/1.1 200 OK\r\ncontent-type: text/html\r\nContent-Length: 0\r\n\r\n");
+}
+
+TEST(Response, KeepsDateSetByHandler)
+{
+    auto response = written([](Response& resp) -> Task<> {
+        resp.setHeader("Date", "Sun, 06 Nov 1994 08:49:37 GMT");
+        co_await resp.send("");
+    });
+    EXPECT_EQ(response, "HTTP/1.1 200 OK\r\nDate: Sun, 06 Nov 1994 08:49:37 GMT\r\nContent-Length: 0\r\n\r\n");
+}
+
+TEST(Response, LeavesOutLengthOfResponsesWithoutBody)
+{
+    for (unsigned status : { 101u, 204u, 304u }) {
+        auto response = written([status](Response& resp) -> Task<> {
+            resp.setStatus(status);
+            co_await resp.send("");
+        });
+        EXPECT_EQ(response.find("Content-Length"), std::string::npos) << response;
+        EXPECT_TRUE(response.ends_with("\r\n\r\n")) << response;
+    }
+}
+
+TEST(Response, StreamsChunkedBody)
+{
+    auto response = written([](Response& resp) -> Task<> {
+        co_await resp.write("hello");
+        co_await resp.write("");
+        co_await resp.write(std::string(26, 'x'));
+        co_await resp.end();
+    });
+    EXPECT_EQ(withoutDate(response),
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n1a\r\n" + std::string(26, 'x') + "\r\n0\r\n\r\n");
+}
+
+TEST(Response, RejectsSecondResponse)
+{
+    written([](Response& resp) -> Task<> {
+        co_await resp.send("a");
+        EXPECT_THROW(co_await resp.send("b"), std::runtime_error);
+    });
+}
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "aifs/http/route_tree.h"
+
+using namespace aifs;
+using namespace aifs::http;
+
+namespace {
+// A handler that tells which route it was added for.
+struct Route {
+    int id;
+
+    Task<HandlerStatus> operator()(const Request&, Response&) const { co_return HandlerStatus::Accepted; }
+};
+
+class RouteTreeTest : public ::testing::Test {
+protected:
+    void add(std::string_view pattern, int id) { m_tree.insert(pattern, Route { id }); }
+
+    // Id of the route for path, or 0 if there is none.
+    int find(std::string_view path)
+    {
+        m_params = {};
+        auto* fn = m_tree.find(path, m_params);
+        return fn ? fn->target<Route>()->id : 0;
+    }
+
+    std::optional<std::string_view> param(std::string_view name) const
+    {
+        for (const auto& p : m_params) {
+            if (p.name == name) {
+                return p.value;
+            }
+        }
+        return std::nullopt;
+    }
+
+    RouteTree m_tree;
+    RouteParams m_params;
+};
+} // namespace
+
+TEST_F(RouteTreeTest, SplitsNodesWhereRoutesDiverge)
+{
+    add("/users", 1);
+    add("/user/:id", 2);
+    add("/us", 3);
+    add("/usage", 4);
+    add("/", 5);
+
+    EXPECT_EQ(find("/users"), 1);
+    EXPECT_EQ(find("/user/7"), 2);
+    EXPECT_EQ(param("id"), "7");
+    EXPECT_EQ(find("/us"), 3);
+    EXPECT_EQ(find("/usage"), 4);
+    EXPECT_EQ(find("/"), 5);
+
+    // Prefixes of routes, and paths going past them, are not routes.
+    EXPECT_EQ(find(""), 0);
+    EXPECT_EQ(find("/u"), 0);
+    EXPECT_EQ(find("/use"), 0);
+    EXPECT_EQ(find("/user"), 0);
+    EXPECT_EQ(find("/users/"), 0);
+    EXPECT_EQ(find("/user/7/x"), 0);
+}
+
+TEST_F(RouteTreeTest, PrefersStaticThenParameterThenWildcard)
+{
+    add("/a/new", 1);
+    add("/a/:id", 2);
+    add("/a/*rest", 3);
+
+    EXPECT_EQ(find("/a/new"), 1);
+    EXPECT_EQ(find("/a/newer"), 2);
+    EXPECT_EQ(param("id"), "newer");
+    EXPECT_EQ(find("/a/5/x"), 3);
+    EXPECT_EQ(param("rest"), "5/x");
+    EXPECT_EQ(m_params.size(), 1u);
+}
+
+TEST_F(RouteTreeTest, BacktracksFromBranchesThatLeadNowhere)
+{
+    add("/files/static/readme", 1);
+    add("/files/:name/info", 2);
+    add("/p/:id/edit", 3);
+    add("/p/*rest", 4);
+
+    EXPECT_EQ(find("/files/static/readme"), 1);
+    EXPECT_EQ(find("/files/static/info"), 2);
+    EXPECT_EQ(param("name"), "static");
+
+    // The parameter taken on the way to the dead end is dropped again.
+    EXPECT_EQ(find("/p/5/view"), 4);
+    EXPECT_EQ(m_params.size(), 1u);
+    EXPECT_EQ(param("rest"), "5/view");
+    EXPECT_FALSE(param("id"));
+}
+
+TEST_F(RouteTreeTest, MatchesParametersAndWildcards)
+{
+    add("/users/:user/posts/:post", 1);
+    add("/static/*path", 2);
+    add("/:lang/docs", 3);
+
+    EXPECT_EQ(find("/users/ann/posts/42"), 1);
+    EXPECT_EQ(param("user"), "ann");
+    EXPECT_EQ(param("post"), "42");
+    EXPECT_EQ(find("/users//posts/42"), 0);
+
+    EXPECT_EQ(find("/static/css/site.css"), 2);
+    EXPECT_EQ(param("path"), "css/site.css");
+    EXPECT_EQ(find("/static/"), 2);
+    EXPECT_EQ(param("path"), "");
+
+    EXPECT_EQ(find("/en/docs"), 3);
+    EXPECT_EQ(param("lang"), "en");
+}
+
+TEST_F(RouteTreeTest, RejectsInvalidRoutes)
+{
+    add("/users/:id", 1);
+    EXPECT_THROW(add("/users/:id", 2), std::invalid_argument);
+    EXPECT_THROW(add("/users/:name/posts", 2), std::invalid_argument);
+    EXPECT_THROW(add("/a/*rest/b", 2), std::invalid_argument);
+    EXPECT_THROW(add("/a/:/b", 2), std::invalid_argument);
+    EXPECT_THROW(add("/:a/:b/:c/:d/:e/:f/:g/:h/:i", 2), std::invalid_argument);
+    EXPECT_NO_THROW(add("/:a/:b/:c/:d/:e/:f/:g/:h", 2));
+}
@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string_view>
+
+#include "aifs/event_loop.h"
+#include "aifs/task.h"
+
+using namespace aifs;
+
+namespace {
+Task<int> value(int v)
+{
+    co_return v;
+}
+
+Task<int> fail()
+{
+    throw std::runtime_error("failed");
+    co_return 0;
+}
+
+Task<int> sum(int a, int b)
+{
+    co_return co_await value(a) + co_await value(b);
+}
+
+Task<int> rethrow()
+{
+    co_return co_await fail() + 1;
+}
+
+// Recurses depth times, every level completing synchronously.
+Task<int> depth(int n)
+{
+    if (n == 0) {
+        co_return 0;
+    }
+    co_return co_await depth(n - 1) + 1;
+}
+
+// Run task to completion on a loop.
+template <typename T>
+T run(Task<T> task)
+{
+    EventLoop ev;
+    T result {};
+    ev.spawn([](Task<T> task, T& result) -> Task<> { result = co_await std::move(task); }(std::move(task), result));
+    ev.run();
+    return result;
+}
+} // namespace
+
+TEST(Task, ReturnsValuesOfNestedTasks)
+{
+    EXPECT_EQ(run(sum(2, 3)), 5);
+    EXPECT_EQ(run(depth(1000)), 1000);
+}
+
+TEST(Task, PropagatesExceptionsToTheAwaitingTask)
+{
+    bool caught = false;
+    EventLoop ev;
+    ev.spawn([](bool& caught) -> Task<> {
+        try {
+            co_await rethrow();
+        } catch (const std::runtime_error& e) {
+            caught = std::string_view { e.what() } == "failed";
+        }
+    }(caught));
+    ev.run();
+    EXPECT_TRUE(caught);
+}
+
+// Tasks that complete at once return to the awaiting coroutine instead of
+// transferring to it, so a long loop of them does not grow the stack even
+// without optimization.
+TEST(Task, CompletesLongLoopsWithoutGrowingTheStack)
+{
+    EXPECT_EQ(run([]() -> Task<int> {
+        int total = 0;
+        for (int i = 0; i < 1000000; ++i) {
+            total += co_await value(1);
+        }
+        co_return total;
+    }()),
+        1000000);
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "aifs/event_loop.h"
+#include "aifs/task.h"
+#include "aifs/tcp_acceptor.h"
+
+using namespace aifs;
+
+namespace {
+// A port nothing listens on, for the acceptor to bind.
+int freePort()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ::bind(fd, reinterpret_cast<sockaddr*>(&addr), len);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    ::close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// Connect count clients, which the kernel completes before anything is
+// accepted.
+std::vector<int> connectClients(int port, std::size_t count)
+{
+    std::vector<int> fds;
+    for (std::size_t i = 0; i < count; ++i) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<unsigned short>(port));
+        EXPECT_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+        fds.push_back(fd);
+    }
+    return fds;
+}
+
+void closeAll(const std::vector<int>& fds)
+{
+    for (int fd : fds) {
+        ::close(fd);
+    }
+}
+
+int noDelay(int fd)
+{
+    int value = -1;
+    socklen_t len = sizeof(value);
+    EXPECT_EQ(::getsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, &len), 0);
+    return value;
+}
+} // namespace
+
+// One readiness notification takes up to acceptBatch connections; accept()
+// hands out the first and acceptBatch() the rest of them, before going back
+// to the kernel for the others.
+TEST(TCPAcceptor, AcceptsPendingConnectionsInBatches)
+{
+    int port = freePort();
+    EventLoop ev;
+    TCPAcceptor acceptor { ev, port, { .address = "127.0.0.1", .acceptBatch = 4 } };
+    auto clients = connectClients(port, 6);
+
+    std::vector<std::size_t> sizes;
+    ev.spawn([](TCPAcceptor& acceptor, std::vector<std::size_t>& sizes) -> Task<> {
+        auto first = co_await acceptor.accept();
+        sizes.push_back(1);
+        while (sizes.size() < 3) {
+            auto sockets = co_await acceptor.acceptBatch();
+            sizes.push_back(sockets.size());
+        }
+    }(acceptor, sizes));
+    ev.run();
+    closeAll(clients);
+
+    EXPECT_EQ(sizes, (std::vector<std::size_t> { 1, 3, 2 }));
+}
+
+TEST(TCPAcceptor, SetsNoDelayOnAcceptedSockets)
+{
+    for (bool enabled : { false, true }) {
+        int port = freePort();
+        EventLoop ev;
+        TCPAcceptor acceptor { ev, port, { .address = "127.0.0.1", .noDelay = enabled } };
+        auto clients = connectClients(port, 1);
+
+        int value = -1;
+        ev.spawn([](TCPAcceptor& acceptor, int& value) -> Task<> {
+            auto socket = co_await acceptor.accept();
+            value = noDelay(socket->native_handle());
+        }(acceptor, value));
+        ev.run();
+        closeAll(clients);
+
+        EXPECT_EQ(value != 0, enabled);
+    }
+}
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+#include "aifs/event_loop.h"
+#include "aifs/io_uring_reactor.h"
+#include "aifs/task.h"
+#include "aifs/unix_socket.h"
+
+using namespace aifs;
+
+// I/O that can complete at once does so without suspending, until the
+// loop's speculation budget (16) is used up. The next operation waits for
+// the loop, which refills the budget when it performs it. UnixSocket has
+// the same operations as TCPSocket.
+TEST(BasicStreamSocket, CompletesReadyIoWithoutSuspendingUpToBudget)
+{
+    EventLoop ev;
+    auto [a, b] = UnixSocket::pair(ev);
+    std::string data(32, 'x');
+    ASSERT_EQ(::write(a->native_handle(), data.data(), data.size()), static_cast<ssize_t>(data.size()));
+
+    int immediate = 0;
+    bool done = false;
+    ev.spawn([](EventLoop& ev, UnixSocket& b, int& immediate, bool& done) -> Task<> {
+        char c;
+        for (int i = 0; i < 16; ++i) {
+            EXPECT_EQ(co_await b.receive({ &c, 1 }), 1);
+            ++immediate;
+        }
+        EXPECT_FALSE(ev.speculate());
+        EXPECT_EQ(co_await b.send({ "y", 1 }), 1);
+        EXPECT_TRUE(ev.speculate());
+        done = true;
+    }(ev, *b, immediate, done));
+
+    // Spawning runs the task up to its first suspension.
+    EXPECT_EQ(immediate, 16);
+    EXPECT_FALSE(done);
+    ev.run();
+    EXPECT_TRUE(done);
+}
+
+// Sending nothing succeeds at once, whatever errno held before.
+TEST(BasicStreamSocket, SendsEmptyBuffer)
+{
+    EventLoop ev;
+    auto [a, b] = UnixSocket::pair(ev);
+    bool sent = false;
+    ev.spawn([](UnixSocket& a, bool& sent) -> Task<> {
+        errno = EBADF;
+        EXPECT_EQ(co_await a.send({}), 0);
+        sent = true;
+    }(*a, sent));
+    ev.run();
+    EXPECT_TRUE(sent);
+}
+
+// Closing the socket completes the receive waiting on it, which would
+// otherwise keep the loop running for good.
+TEST(BasicStreamSocket, CancelsPendingReceiveOnClose)
+{
+    for (auto backend : { Backend::epoll, Backend::io_uring }) {
+        if (backend == Backend::io_uring && !IoUringReactor::supported()) {
+            continue;
+        }
+        EventLoop ev { backend };
+        auto [a, b] = UnixSocket::pair(ev);
+        std::error_code error;
+        ev.spawn([](UnixSocket& a, std::error_code& error) -> Task<> {
+            char buf[16];
+            try {
+                co_await a.receive(buf);
+            } catch (const std::system_error& e) {
+                error = e.code();
+            }
+        }(*a, error));
+        ev.spawn([](EventLoop& ev, UnixSocket& a) -> Task<> {
+            co_await ev.schedule();
+            a.close();
+        }(ev, *a));
+        ev.run();
+        EXPECT_EQ(error, std::errc::operation_canceled);
+    }
+}
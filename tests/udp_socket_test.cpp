@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "aifs/event_loop.h"
+#include "aifs/task.h"
+#include "aifs/udp_socket.h"
+
+using namespace aifs;
+
+namespace {
+int portOf(const sockaddr_storage& addr)
+{
+    return ntohs(reinterpret_cast<const sockaddr_in&>(addr).sin_port);
+}
+
+class UDPSocketTest : public ::testing::Test {
+protected:
+    // Run test on the loop.
+    template <typename Fn>
+    void run(Fn test)
+    {
+        m_ev.spawn(test());
+        m_ev.run();
+    }
+
+    EventLoop m_ev;
+    UDPSocket m_receiver { m_ev, 0, { .address = "127.0.0.1" } };
+    UDPSocket m_sender { m_ev, 0, { .address = "127.0.0.1" } };
+};
+} // namespace
+
+TEST_F(UDPSocketTest, SendsAndReceivesBatches)
+{
+    constexpr std::size_t count = 10;
+    std::vector<std::string> payloads;
+    for (std::size_t i = 0; i < count; ++i) {
+        payloads.push_back("datagram " + std::to_string(i));
+    }
+
+    run([&]() -> Task<> {
+        auto to = m_receiver.local_endpoint();
+        std::vector<iovec> iovecs(count);
+        std::vector<mmsghdr> messages(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            iovecs[i] = { payloads[i].data(), payloads[i].size() };
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_name = &to;
+            messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+        EXPECT_EQ(co_await m_sender.sendBatch(messages), count);
+
+        // Room for more than were sent; one receive takes all that are
+        // queued.
+        DatagramBatch batch { 2 * count, 64 };
+        std::size_t received = 0;
+        while (received < count) {
+            auto n = co_await m_receiver.receiveBatch(batch);
+            for (std::size_t i = 0; i < n; ++i) {
+                EXPECT_EQ(std::string_view(batch.data(i).data(), batch.data(i).size()), payloads[received + i]);
+                EXPECT_EQ(portOf(batch.peer(i)), portOf(m_sender.local_endpoint()));
+                EXPECT_EQ(batch.segmentSize(i), 0u);
+            }
+            received += n;
+        }
+        EXPECT_EQ(received, count);
+    });
+}
+
+TEST_F(UDPSocketTest, TruncatesDatagramsToBuffer)
+{
+    run([&]() -> Task<> {
+        std::string payload(100, 'x');
+        co_await m_sender.sendTo(payload, m_receiver.local_endpoint());
+        DatagramBatch batch { 4, 64 };
+        EXPECT_EQ(co_await m_receiver.receiveBatch(batch), 1u);
+        EXPECT_EQ(batch.data(0).size(), 64u);
+    });
+}
+
+TEST_F(UDPSocketTest, WaitsForDatagram)
+{
+    bool received = false;
+    m_ev.spawn([](UDPSocket& receiver, bool& received) -> Task<> {
+        char buf[16];
+        sockaddr_storage from {};
+        EXPECT_EQ(co_await receiver.receiveFrom(buf, from), 4u);
+        EXPECT_EQ(std::string_view(buf, 4), "ping");
+        received = true;
+    }(m_receiver, received));
+    EXPECT_FALSE(received);
+
+    run([&]() -> Task<> {
+        m_sender.connect("127.0.0.1", portOf(m_receiver.local_endpoint()));
+        EXPECT_EQ(co_await m_sender.send({ "ping", 4 }), 4u);
+    });
+    EXPECT_TRUE(received);
+}
+
+// With UDP_SEGMENT the kernel splits one send into datagrams of the segment
+// size; a receiver with UDP_GRO may get them merged again.
+TEST_F(UDPSocketTest, SegmentsSendsWithGso)
+{
+    std::unique_ptr<UDPSocket> gsoSender;
+    std::unique_ptr<UDPSocket> groReceiver;
+    try {
+        gsoSender = std::make_unique<UDPSocket>(m_ev, 0, UDPOptions { .address = "127.0.0.1", .gsoSegmentSize = 100 });
+        groReceiver = std::make_unique<UDPSocket>(m_ev, 0, UDPOptions { .address = "127.0.0.1", .gro = true });
+    } catch (const std::system_error& e) {
+        GTEST_SKIP() << "No UDP segmentation offload: " << e.what();
+    }
+
+    run([&]() -> Task<> {
+        std::string payload(350, 'x');
+        DatagramBatch batch { 8, 1024 };
+
+        co_await gsoSender->sendTo(payload, m_receiver.local_endpoint());
+        std::vector<std::size_t> sizes;
+        while (sizes.size() < 4) {
+            auto n = co_await m_receiver.receiveBatch(batch);
+            for (std::size_t i = 0; i < n; ++i) {
+                sizes.push_back(batch.data(i).size());
+            }
+        }
+        EXPECT_EQ(sizes, (std::vector<std::size_t> { 100, 100, 100, 50 }));
+
+        co_await gsoSender->sendTo(payload, groReceiver->local_endpoint());
+        std::size_t total = 0;
+        while (total < payload.size()) {
+            auto n = co_await groReceiver->receiveBatch(batch);
+            for (std::size_t i = 0; i < n; ++i) {
+                total += batch.data(i).size();
+                if (batch.data(i).size() > 100) {
+                    EXPECT_EQ(batch.segmentSize(i), 100u);
+                }
+            }
+        }
+        EXPECT_EQ(total, payload.size());
+    });
+}
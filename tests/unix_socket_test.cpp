@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include "aifs/event_loop.h"
+#include "aifs/http/express_router.h"
+#include "aifs/http/http_server.h"
+#include "aifs/socket_address.h"
+#include "aifs/steady_timer.h"
+#include "aifs/unix_socket.h"
+
+using namespace aifs;
+using namespace aifs::http;
+
+namespace {
+int connectTo(const std::string& path)
+{
+    sockaddr_un addr;
+    auto len = makeUnixAddress(path, addr);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), len) < 0) {
+        throw std::system_error(errno, std::generic_category(), "connect");
+    }
+    return fd;
+}
+
+// Send request and read the response, up to the end of its body "ok".
+std::string roundTrip(int fd, std::string_view request)
+{
+    EXPECT_EQ(::write(fd, request.data(), request.size()), static_cast<ssize_t>(request.size()));
+    std::string response;
+    char buf[4096];
+    while (!response.ends_with("ok")) {
+        auto n = ::read(fd, buf, sizeof buf);
+        if (n <= 0) {
+            break;
+        }
+        response.append(buf, static_cast<std::size_t>(n));
+    }
+    return response;
+}
+} // namespace
+
+TEST(UnixSocket, ServesConcurrentConnections)
+{
+    const std::string path = "@aifs-test-" + std::to_string(::getpid());
+    EventLoop ev;
+    UnixAcceptor acceptor { ev, path };
+    ExpressRouter router;
+    router.get("/", [](const Request&, Response& resp) -> Task<HandlerStatus> {
+        co_await resp.send("ok");
+        co_return HandlerStatus::Accepted;
+    });
+    HTTPServer<UnixSocket> server { ev, acceptor, router };
+    ev.spawn(server.start());
+
+    std::string first;
+    std::string second;
+    std::thread client([&] {
+        // Both connections stay open while requests go over either.
+        int a = connectTo(path);
+        int b = connectTo(path);
+        first = roundTrip(b, "GET / HTTP/1.1\r\n\r\n");
+        second = roundTrip(a, "GET / HTTP/1.1\r\n\r\n");
+        ::close(a);
+        ::close(b);
+        ev.post([&] { server.stop(); });
+    });
+    ev.run();
+    client.join();
+
+    EXPECT_TRUE(first.starts_with("HTTP/1.1 200 OK\r\n")) << first;
+    EXPECT_TRUE(second.starts_with("HTTP/1.1 200 OK\r\n")) << second;
+}
+
+TEST(UnixSocket, PassesDescriptors)
+{
+    EventLoop ev;
+    auto [a, b] = UnixSocket::pair(ev);
+    int pipeFds[2];
+    ASSERT_EQ(::pipe(pipeFds), 0);
+
+    std::vector<int> received;
+    ev.spawn([](UnixSocket& a, UnixSocket& b, int fd, std::vector<int>& received) -> Task<> {
+        const char data[] = "x";
+        co_await a.sendFds({ data, 1 }, { &fd, 1 });
+        char buf[8];
+        co_await b.receiveFds(buf, received);
+    }(*a, *b, pipeFds[1], received));
+    ev.run();
+
+    ASSERT_EQ(received.size(), 1u);
+    ASSERT_EQ(::write(received[0], "y", 1), 1);
+    char c = 0;
+    EXPECT_EQ(::read(pipeFds[0], &c, 1), 1);
+    EXPECT_EQ(c, 'y');
+    ::close(received[0]);
+    ::close(pipeFds[0]);
+    ::close(pipeFds[1]);
+}
+
+// Sending to a closed peer fails with EPIPE instead of raising SIGPIPE,
+// which would end the process.
+TEST(UnixSocket, ReportsBrokenPipeWithoutSignal)
+{
+    EventLoop ev;
+    auto [a, b] = UnixSocket::pair(ev);
+    b->close();
+
+    bool broken = false;
+    ev.spawn([](UnixSocket& a, bool& broken) -> Task<> {
+        try {
+            co_await a.send({ "x", 1 });
+        } catch (const std::system_error& e) {
+            broken = e.code() == std::errc::broken_pipe;
+        }
+    }(*a, broken));
+    ev.run();
+    EXPECT_TRUE(broken);
+}
+
+// With a backlog of 0 the second connect finds the backlog full, and only
+// completes once the first connection is accepted. Meanwhile the loop
+// goes on, which is what accepts it.
+TEST(UnixSocket, ConnectsOnceBacklogHasRoom)
+{
+    const std::string path = "@aifs-test-backlog-" + std::to_string(::getpid());
+    EventLoop ev;
+    UnixAcceptor acceptor { ev, path, 0 };
+    int accepted = 0;
+    int acceptedBeforeSecond = -1;
+
+    ev.spawn([](EventLoop& ev, UnixAcceptor& acceptor, int& accepted) -> Task<> {
+        SteadyTimer delay { ev, std::chrono::milliseconds(20) };
+        co_await delay.wait();
+        for (int i = 0; i < 2; ++i) {
+            auto socket = co_await acceptor.accept();
+            ++accepted;
+            char c = 0;
+            EXPECT_EQ(co_await socket->receive({ &c, 1 }), 1);
+            EXPECT_EQ(c, 'a' + i);
+        }
+    }(ev, acceptor, accepted));
+
+    ev.spawn([](EventLoop& ev, const std::string& path, int& accepted, int& acceptedBeforeSecond) -> Task<> {
+        auto first = co_await UnixSocket::connect(ev, path);
+        auto second = co_await UnixSocket::connect(ev, path);
+        acceptedBeforeSecond = accepted;
+        co_await first->send({ "a", 1 });
+        co_await second->send({ "b", 1 });
+    }(ev, path, accepted, acceptedBeforeSecond));
+    ev.run();
+
+    EXPECT_EQ(accepted, 2);
+    EXPECT_GE(acceptedBeforeSecond, 1);
+}
+
+TEST(UnixSocket, ReportsConnectToMissingSocket)
+{
+    EventLoop ev;
+    std::error_code error;
+    ev.spawn([](EventLoop& ev, std::error_code& error) -> Task<> {
+        try {
+            co_await UnixSocket::connect(ev, "@aifs-test-missing-" + std::to_string(::getpid()));
+        } catch (const std::system_error& e) {
+            error = e.code();
+        }
+    }(ev, error));
+    ev.run();
+    EXPECT_EQ(error, std::errc::connection_refused);
+}
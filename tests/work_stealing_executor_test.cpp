@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+#include "aifs/event_loop.h"
+#include "aifs/task.h"
+#include "aifs/work_stealing_executor.h"
+
+using namespace aifs;
+
+// Work posted from a worker goes to its own deque, so that the others
+// have to steal it.
+TEST(WorkStealingExecutor, RunsAllWorkBeforeItIsDestroyed)
+{
+    constexpr std::size_t producers = 64;
+    constexpr std::size_t children = 1000;
+    std::atomic<std::size_t> done { 0 };
+    {
+        WorkStealingExecutor executor { 4 };
+        EXPECT_EQ(executor.size(), 4u);
+        for (std::size_t i = 0; i < producers; ++i) {
+            executor.post([&] {
+                for (std::size_t j = 0; j < children; ++j) {
+                    executor.post([&] { done.fetch_add(1, std::memory_order_relaxed); });
+                }
+                done.fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+    }
+    EXPECT_EQ(done.load(), producers * (children + 1));
+}
+
+TEST(WorkStealingExecutor, MovesCoroutinesOffTheLoopAndBack)
+{
+    EventLoop ev;
+    WorkStealingExecutor executor { 2 };
+    auto loopThread = std::this_thread::get_id();
+    int hops = 0;
+    ev.spawn([](EventLoop& ev, WorkStealingExecutor& executor, std::thread::id loopThread, int& hops) -> Task<> {
+        for (int i = 0; i < 100; ++i) {
+            co_await executor.schedule();
+            EXPECT_NE(std::this_thread::get_id(), loopThread);
+            co_await ev.schedule();
+            EXPECT_EQ(std::this_thread::get_id(), loopThread);
+            ++hops;
+        }
+    }(ev, executor, loopThread, hops));
+    ev.run();
+    EXPECT_EQ(hops, 100);
+}